@@ -5,6 +5,7 @@
 
 #include <microptp/config.hpp>
 #include <microptp/clockservo.hpp>
+#include <microptp/ptpclock.hpp>
 #include <microptp/ports/systemport.hpp>
 
 namespace uptp {
@@ -14,13 +15,18 @@ namespace uptp {
 	//
 
 	ClockServo::ClockServo(PtpClock& clock)
-		: clock_(clock)
+		: slew_ppb_(0),
+		  slew_timer_(clock.get_system_port().make_timer(ulib::function<void()>(this, &ClockServo::on_slew_finished))),
+		  clock_(clock)
 	{
 		integrator_state_ = 0;
 	}
 	
 	ClockServo::~ClockServo()
 	{
+		if(slew_timer_) {
+			slew_timer_->stop();
+		}
 	}
 
 	void ClockServo::reset( int32 set_value )
@@ -28,8 +34,76 @@ namespace uptp {
 		integrator_state_ = integrator_state_.from(set_value);
 	}
 
+	void ClockServo::correct(const Time& offset)
+	{
+		const auto& cfg = clock_.get_config();
+		const int64 offset_nanos = offset.to_nanos();
+		const bool may_step = !(cfg.never_step_after_lock && clock_.is_locked());
+
+		cancel_slew();
+
+		if(offset_nanos == 0) {
+			return;
+		}
+
+		if((may_step && ulib::abs(offset_nanos) >= cfg.step_threshold_nanos) || !slew_timer_) {
+			TRACE("Stepping clock by %d secs %d nanos.\n", static_cast<int32>(offset.secs()), offset.nanos());
+			clock_.domain_clock().adjust_time(offset);
+		} else {
+			// Round the slew duration up to whole milliseconds for the timer
+			// and pick the rate that removes the offset exactly in that time.
+			// Offsets that would take longer than max_slew_msecs are slewed at
+			// max_slew_ppb for that long, the next correction takes the rest.
+			const int64 max_ppb = cfg.max_slew_ppb;
+			int64 msecs;
+
+			if(ulib::abs(offset_nanos) > max_slew_msecs * max_ppb / 1000) {
+				msecs = max_slew_msecs;
+				slew_ppb_ = static_cast<int32>(offset_nanos < 0 ? -max_ppb : max_ppb);
+			} else {
+				msecs = (ulib::abs(offset_nanos) * 1000 + max_ppb - 1) / max_ppb;
+				slew_ppb_ = static_cast<int32>(offset_nanos * 1000 / msecs);
+			}
+
+			TRACE("Slewing clock by %d nanos at %d ppb for %d ms.\n", static_cast<int32>(offset_nanos), slew_ppb_, static_cast<int32>(msecs));
+			slew_timer_->start(static_cast<uint32>(msecs));
+		}
+
+		if(output) {
+			output(integrator_state_.to<int32>() + slew_ppb_);
+		}
+	}
+
+	void ClockServo::cancel_slew()
+	{
+		if(slew_ppb_ != 0) {
+			slew_timer_->stop();
+			slew_ppb_ = 0;
+
+			if(output) {
+				output(integrator_state_.to<int32>());
+			}
+		}
+	}
+
+	bool ClockServo::slewing() const
+	{
+		return slew_ppb_ != 0;
+	}
+
+	void ClockServo::on_slew_finished()
+	{
+		TRACE("Slew finished.\n");
+		cancel_slew();
+	}
+
 	void ClockServo::feed(uint32 dt_nanos, int32 offset_nanos)
 	{
+		if(slewing()) {
+			// measured offsets still contain the part of the slew in flight
+			return;
+		}
+
 		// we're tolerating 1000 usecs offset before going back to synch state.
 		constexpr auto seconds_factor = FIXED_CONSTANT(1.e-9, 32);
 		using dt_nanos_type  = FIXED_RANGE_I(-00000000,2200000000);
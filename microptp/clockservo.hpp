@@ -8,6 +8,7 @@
 
 #pragma once
 #include <microptp/config.hpp>
+#include <microptp/ports/systemportapi.hpp>
 #include <microlib/functional.hpp>
 #include <fixed/fixed.hpp>
 
@@ -17,16 +18,30 @@ namespace uptp {
 
 	class ClockServo {
 	public:
+		// Longest single slew, within what the timers of all ports can count
+		static const int64 max_slew_msecs = 3600000;
+
 		ClockServo(PtpClock& clock);
 		~ClockServo();
 
 		void reset( int32 integrator );
 		void feed( uint32 dt, int32 offset );
 
+		// Removes a phase offset according to the step/slew policy in Config.
+		// A step is applied immediately, a slew runs on top of the integrator
+		// output until the slew timer fires. The PI loop is held while slewing.
+		void correct( const Time& offset );
+		void cancel_slew();
+		bool slewing() const;
+
 		ulib::function<void(int32)> output;
 
 	private:
+		void on_slew_finished();
+
 		FIXED_RANGE(-10000000, 10000000, 32) integrator_state_;
+		int32 slew_ppb_;
+		TimerHandle slew_timer_;
 		PtpClock& clock_;
 	};
 	
@@ -6,8 +6,10 @@
 #ifndef SYSTEM_MICROPTP_MICROPTP_CONFIG_HPP_
 #define SYSTEM_MICROPTP_MICROPTP_CONFIG_HPP_
 
+#include <array>
 #include <microptp_config.hpp>
 #include <microptp/ptpdatatypes.hpp>
+#include <microptp/net_address.hpp>
 #include <fixed/fixed.hpp>
 
 #ifndef PRINT
@@ -22,16 +24,118 @@
 #define UPTP_SLAVE_ONLY 1
 #endif
 
+// Delay_Req service sizes, a master serving thousands of slaves raises them in
+// its microptp_config.hpp
+#ifndef UPTP_DELAY_REQ_QUEUE_SIZE
+#define UPTP_DELAY_REQ_QUEUE_SIZE 32
+#endif
+
+#ifndef UPTP_DELAY_RESP_BATCH
+#define UPTP_DELAY_RESP_BATCH 8
+#endif
+
+#ifndef UPTP_DELAY_RESP_CLIENTS
+#define UPTP_DELAY_RESP_CLIENTS 256
+#endif
+
 namespace uptp {
 
 	struct Config {
+		// PTP ports of this clock, more than one makes a boundary clock
+		static const size_t num_ports = 1;
+
+		// IEEE 802.1AS (gPTP) profile: peer delay with neighbor rate ratio, asCapable,
+		// the Follow_Up information TLV and the 802.1AS default message intervals
+		static const bool gptp_profile = false;
+		static const int64 neighbor_prop_delay_thresh_nanos = 800;
+		static const uint8 allowed_lost_responses = 3;
+		static const uint8 rate_ratio_window = 8;	// Pdelay exchanges a neighbor rate ratio spans
+
 #if !UPTP_SLAVE_ONLY
-		ClockQuality clock_quality;
+		// Master role, announced data set and message rates (log2 seconds)
+		ClockQuality clock_quality = { 0xFFFF, 248, 0xFE };
+		uint8 priority1 = 128;
+		uint8 priority2 = 128;
+		int16 current_utc_offset = 37;
+		enum8 time_source = 0xA0;	// internal oscillator
+
+		int8 log_announce_interval = gptp_profile ? 0 : 1;
+		int8 log_sync_interval = gptp_profile ? -3 : 0;		// down to -7, i.e. 128 Hz
+		int8 log_min_delay_req_interval = 0;
+		uint8 announce_receipt_timeout = 3;		// announce intervals until we take over as master
+
+		// Delay_Req service: queue and client table sizes (powers of two), responses
+		// sent per batch and requests a slave may send ahead of its nominal rate.
+		// The client table is open addressed, keep it at about twice the slaves served.
+		static const size_t delay_req_queue_size = UPTP_DELAY_REQ_QUEUE_SIZE;
+		static const size_t delay_resp_batch = UPTP_DELAY_RESP_BATCH;
+		static const size_t delay_resp_clients = UPTP_DELAY_RESP_CLIENTS;
+		static const int64 delay_req_burst = 4;
 #endif
+		// Path delay: end-to-end Delay_Req/Delay_Resp with the master, or
+		// peer-to-peer Pdelay exchanges on the link (see PeerDelay)
+		enum class DelayMechanism { E2E, P2P };
+		static const DelayMechanism delay_mechanism = gptp_profile ? DelayMechanism::P2P : DelayMechanism::E2E;
+		int8 log_min_pdelay_req_interval = 0;
+
+		// Transport: UDP over IPv4 or IPv6, or PTP directly over Ethernet (ethertype 0x88F7).
+		// IPv6 uses the ff0X::181 group with X the scope below, peer delay ff02::6b.
+		enum class Transport { UdpIpv4, UdpIpv6, Ethernet };
+		static const Transport transport = Transport::UdpIpv4;
+		static const uint8 ipv6_multicast_scope = 0x0E;
+
+		// Unicast: masters are found through the unicast master table and every message
+		// stream is negotiated with REQUEST/GRANT/CANCEL_UNICAST_TRANSMISSION signaling,
+		// nothing is sent to the multicast group. Durations in seconds, grants are
+		// renewed once half of their duration has run out.
+		static const bool unicast = false;
+		static const size_t unicast_master_table_size = 4;
+		std::array<NetAddress, unicast_master_table_size> unicast_master_table = {{}};	// empty: unused
+		uint32 unicast_grant_duration = 300;
+		int8 unicast_log_announce_interval = 1;
+		int8 unicast_log_sync_interval = -4;		// requested only from the master we are Slave to
+		int8 unicast_log_delay_resp_interval = -4;
+#if !UPTP_SLAVE_ONLY
+		static const size_t unicast_max_clients = 16;
+		uint32 unicast_max_grant_duration = 1000;
+		int8 unicast_min_log_sync_interval = -7;	// faster Sync and Delay_Resp requests are denied
+		int8 unicast_max_log_interval = 6;			// slower requests of any stream are denied
+#endif
+
+		// Hybrid: Sync and Announce stay multicast, Delay_Reqs go unicast to the
+		// address the best master announces from and are answered unicast
+		static const bool hybrid = false;
+
+		static_assert(!(unicast && transport == Transport::Ethernet), "unicast negotiation needs a UDP transport");
+
+		// Transparent clock: bridged ports and event messages in flight for residence time
+		static const size_t tc_max_ports = 4;
+		static const size_t tc_max_pending = 16;
+
+		// Received packets, transmit completions and commands queued to the system
+		// port's thread, a power of two. A full mailbox drops and counts, see MpscQueue.
+		static const size_t port_mailbox_depth = 16;
+
 		static const bool two_step = true;
 		static const bool any_domain = false;
 		static const uint8 preferred_domain = 0;
 
+		// Domains tracked at once over the same sockets (see MultiDomainClock), each
+		// with its own PtpClock. With more than one, the system port clock runs free
+		// and every domain's servo drives a VirtualClock on top of it.
+		static const size_t num_domains = 1;
+		static const bool virtual_clocks = num_domains > 1;
+		uint8 domain_number = 0;	// messages of other domains are dropped unless any_domain
+
+		// Phase correction policy: offsets of at least step_threshold_nanos are stepped
+		// with adjust_time, smaller ones are slewed at no more than max_slew_ppb, so a
+		// slewed correction takes at most |offset| / max_slew_ppb seconds, in slews of
+		// up to an hour (ClockServo::max_slew_msecs).
+		// With never_step_after_lock set, every correction after the first lock is slewed.
+		static const int64 step_threshold_nanos = 1000000;
+		static const int32 max_slew_ppb = 500000;
+		static const bool never_step_after_lock = false;
+
 		static constexpr auto kp_ = FIXED_RANGE(0, 0.1, 32)::from(0.005);
 		static constexpr auto kn_ = FIXED_RANGE(0, 0.01, 32)::from(0.0005);
 	};
@@ -0,0 +1,184 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <microptp/config.hpp>
+#include <microptp/ptpclock.hpp>
+#include <microptp/delay_responder.hpp>
+#include <microptp/ports/systemport.hpp>
+
+#if !UPTP_SLAVE_ONLY
+
+namespace uptp {
+
+	DelayResponder::DelayResponder(PtpPort& port)
+		: head_(0), count_(0), stats_(), port_(port)
+	{
+		for(auto& client : clients_) {
+			client.used = false;
+		}
+
+		const int8 log_interval = port_.get_config().log_min_delay_req_interval;
+		const int64 interval_nanos = (log_interval >= 0) ? (1000000000ll << log_interval) : (1000000000ll >> -log_interval);
+		min_interval_ = Time::from_nanos(interval_nanos);
+		burst_ = Time::from_nanos(interval_nanos * Config::delay_req_burst);
+
+		flush_timer_ = port_.get_system_port().make_timer(ulib::function<void()>(this, &DelayResponder::flush));
+	}
+
+	DelayResponder::~DelayResponder()
+	{
+		if(flush_timer_) {
+			flush_timer_->stop();
+		}
+	}
+
+	void DelayResponder::on_delay_req(const msg::Header& header, const Time& receive_time, const NetAddress& address)
+	{
+		if(!admit(header.source_port_identity, receive_time)) {
+			++stats_.rate_limited;
+			return;
+		}
+
+		if(count_ == queue_size) {
+			++stats_.queue_overflows;
+			return;
+		}
+
+		auto& request = queue_[(head_ + count_) & (queue_size - 1)];
+		request.requester    = header.source_port_identity;
+		request.receive_time = receive_time;
+		request.correction   = header.correction_field;
+		request.address      = address;
+		request.sequence_id  = header.sequence_id;
+		++count_;
+
+		if(count_ >= batch_size) {
+			flush();
+		} else if(count_ == 1 && flush_timer_) {
+			flush_timer_->start(1);
+		}
+	}
+
+	void DelayResponder::flush()
+	{
+		using delay_resp_template = TransmitTemplate<msg::DelayResp>;
+
+		if(flush_timer_) {
+			flush_timer_->stop();
+		}
+
+		auto& port = port_.general_port();
+		const auto& resp_template = port_.transmit_templates().delay_resp;
+
+		while(count_) {
+			std::array<PacketHandle, batch_size> batch;
+			std::array<NetAddress, batch_size> addresses;
+			size_t filled = 0;
+
+			// fill the whole batch first, then send it back to back
+			for(; filled < batch_size && count_; ++filled, head_ = (head_ + 1) & (queue_size - 1), --count_) {
+				const auto& request = queue_[head_];
+				auto handle = resp_template.make(port, request.sequence_id);
+				if(!handle) {
+					break;
+				}
+
+				delay_resp_template::set_timestamp(handle, request.receive_time);
+				delay_resp_template::set_correction(handle, TimeInterval(request.correction));
+				delay_resp_template::set<msg::layouts::requesting_port_identity>(handle, request.requester);
+				if(request.address != ptp_multicast_group) {
+					delay_resp_template::set<msg::layouts::header_flag_field0>(handle, uint8(msg::Header::Field0Flags::Unicast));
+				}
+				batch[filled] = std::move(handle);
+				addresses[filled] = request.address;
+			}
+
+			system::send_batch(*port, addresses.data(), general_port_number, batch.data(), filled, untracked_transmit_id);
+			stats_.answered += filled;
+
+			if(filled < batch_size && count_) {
+				// out of transmit buffers, drop the rest rather than spin
+				stats_.send_failures += count_;
+				head_ = (head_ + count_) & (queue_size - 1);
+				count_ = 0;
+			}
+		}
+	}
+
+	bool DelayResponder::admit(const PortIdentity& identity, const Time& receive_time)
+	{
+		const size_t start = hash(identity);
+		Client* slot = nullptr;
+
+		// entries are only ever replaced, never freed, so the first free entry ends the probe
+		for(size_t i = 0; i < probe_window; ++i) {
+			auto& client = clients_[(start + i) & (table_size - 1)];
+			if(!client.used || client.identity == identity) {
+				slot = &client;
+				break;
+			}
+
+			// the least recently served entry of the window is the eviction candidate
+			if(!slot || client.next_due < slot->next_due) {
+				slot = &client;
+			}
+		}
+
+		if(!slot->used || slot->identity != identity) {
+			if(slot->used) {
+				++stats_.clients_evicted;
+			}
+
+			slot->identity = identity;
+			slot->next_due = receive_time;
+			slot->accepted = 0;
+			slot->rate_limited = 0;
+			slot->used = true;
+		}
+
+		// generic cell rate algorithm: a request is accepted unless it arrives more than
+		// the burst allowance ahead of its schedule
+		if(receive_time + burst_ < slot->next_due) {
+			++slot->rate_limited;
+			return false;
+		}
+
+		slot->next_due = ((slot->next_due < receive_time) ? receive_time : slot->next_due) + min_interval_;
+		++slot->accepted;
+		return true;
+	}
+
+	size_t DelayResponder::hash(const PortIdentity& identity)
+	{
+		// FNV-1a over clock identity and port number
+		uint32 h = 2166136261u;
+		for(auto byte : identity.clock.identity) {
+			h = (h ^ byte) * 16777619u;
+		}
+		h = (h ^ (identity.port & 0xFF)) * 16777619u;
+		h = (h ^ (identity.port >> 8)) * 16777619u;
+		return h & (table_size - 1);
+	}
+
+	const DelayResponder::Stats& DelayResponder::stats() const
+	{
+		return stats_;
+	}
+
+	const DelayResponder::Client* DelayResponder::find_client(const PortIdentity& identity) const
+	{
+		const size_t start = hash(identity);
+		for(size_t i = 0; i < probe_window; ++i) {
+			auto& client = clients_[(start + i) & (table_size - 1)];
+			if(client.used && client.identity == identity) {
+				return &client;
+			}
+		}
+		return nullptr;
+	}
+
+}
+
+#endif
@@ -0,0 +1,104 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_DELAY_RESPONDER_HPP__
+#define MICROPTP_DELAY_RESPONDER_HPP__
+
+#include <array>
+#include <microptp/config.hpp>
+#include <microptp/ptpdatatypes.hpp>
+#include <microptp/ports/systemportapi.hpp>
+
+#if !UPTP_SLAVE_ONLY
+
+namespace uptp {
+
+	class PtpPort;
+
+	namespace msg {
+		struct Header;
+	}
+
+	//
+	// Master-side Delay_Req service.
+	// Requests are reduced to what the Delay_Resp needs and queued, so the
+	// receive buffer goes back to the port right away. The queue is drained in
+	// batches of Config::delay_resp_batch: all responses of a batch are built
+	// from the Delay_Resp template first and then handed to the port with one
+	// send_batch, a single sendmmsg on Linux.
+	// A batch is flushed as soon as it is full, at the end of a receive batch
+	// of the port, or by a 1 ms timer otherwise.
+	//
+	// Every requester is accounted for in a fixed hash table and rate limited
+	// to one request per 2^log_min_delay_req_interval with a burst allowance
+	// of Config::delay_req_burst, so a misbehaving slave can't starve the rest.
+	//
+	class DelayResponder {
+	public:
+		struct Client {
+			PortIdentity identity;
+			Time next_due;			// virtual schedule for the rate limiter
+			uint32 accepted;
+			uint32 rate_limited;
+			bool used;
+		};
+
+		struct Stats {
+			uint32 answered;
+			uint32 rate_limited;
+			uint32 queue_overflows;	// queue full, request dropped
+			uint32 send_failures;	// port had no transmit buffer
+			uint32 clients_evicted;
+		};
+
+		DelayResponder(PtpPort& port);
+		~DelayResponder();
+
+		// Responses go to [address], the multicast group unless the request came unicast
+		void on_delay_req(const msg::Header& header, const Time& receive_time, const NetAddress& address);
+		void flush();
+
+		const Stats& stats() const;
+		const Client* find_client(const PortIdentity& identity) const;
+
+	private:
+		struct Request {
+			PortIdentity requester;
+			Time receive_time;
+			int64 correction;
+			NetAddress address;
+			uint16 sequence_id;
+		};
+
+		static const size_t queue_size    = Config::delay_req_queue_size;
+		static const size_t batch_size    = Config::delay_resp_batch;
+		static const size_t table_size    = Config::delay_resp_clients;
+		static const size_t probe_window  = 8;
+
+		static_assert((queue_size & (queue_size - 1)) == 0, "delay_req_queue_size must be a power of two");
+		static_assert((table_size & (table_size - 1)) == 0, "delay_resp_clients must be a power of two");
+
+		bool admit(const PortIdentity& identity, const Time& receive_time);
+		static size_t hash(const PortIdentity& identity);
+
+		std::array<Request, queue_size> queue_;
+		size_t head_;
+		size_t count_;
+
+		std::array<Client, table_size> clients_;
+		Stats stats_;
+
+		Time min_interval_;
+		Time burst_;
+
+		TimerHandle flush_timer_;
+		PtpPort& port_;
+	};
+
+}
+
+#endif
+
+#endif
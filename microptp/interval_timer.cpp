@@ -0,0 +1,64 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <microptp/interval_timer.hpp>
+#include <microptp/ports/systemport.hpp>
+
+namespace uptp {
+
+	IntervalTimer::IntervalTimer(SystemPort& port)
+		: timer_(port.make_timer(ulib::function<void()>(this, &IntervalTimer::on_timer))),
+		  interval_nanos_(0), remainder_nanos_(0)
+	{
+	}
+
+	IntervalTimer::~IntervalTimer()
+	{
+		stop();
+	}
+
+	void IntervalTimer::start(int8 log_interval)
+	{
+		if(log_interval < min_log_interval) {
+			log_interval = min_log_interval;
+		} else if(log_interval > max_log_interval) {
+			log_interval = max_log_interval;
+		}
+
+		interval_nanos_ = (log_interval >= 0) ? (1000000000ull << log_interval) : (1000000000ull >> -log_interval);
+		remainder_nanos_ = 0;
+
+		if(timer_) {
+			timer_->stop();
+			timer_->start(next_period());
+		}
+	}
+
+	void IntervalTimer::stop()
+	{
+		if(timer_) {
+			timer_->stop();
+		}
+	}
+
+	uint32 IntervalTimer::next_period()
+	{
+		remainder_nanos_ += interval_nanos_;
+		const uint64 msecs = remainder_nanos_ / 1000000;
+		remainder_nanos_ -= msecs * 1000000;
+		return static_cast<uint32>(msecs);
+	}
+
+	void IntervalTimer::on_timer()
+	{
+		// re-arm first, the callback may stop or restart the timer
+		timer_->advance(next_period());
+
+		if(on_expired) {
+			on_expired();
+		}
+	}
+
+}
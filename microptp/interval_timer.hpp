@@ -0,0 +1,49 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_INTERVAL_TIMER_HPP__
+#define MICROPTP_INTERVAL_TIMER_HPP__
+
+#include <microptp/types.hpp>
+#include <microptp/ports/systemportapi.hpp>
+#include <microlib/functional.hpp>
+
+namespace uptp {
+
+	class SystemPort;
+
+	//
+	// Periodic timer for PTP message intervals of 2^log_interval seconds.
+	// The port timers only take whole milliseconds, so the sub-millisecond
+	// remainder is carried over to the next period. 128 Hz (7.8125 ms) then
+	// alternates between 7 and 8 ms without drifting off the nominal rate.
+	// Each period runs from the previous deadline, so neither does the time
+	// the port takes to get to the callback add up.
+	//
+	class IntervalTimer {
+	public:
+		static const int8 min_log_interval = -7;
+		static const int8 max_log_interval = 16;		// about 18 hours, the millisecond periods still fit 32 bits
+
+		IntervalTimer(SystemPort& port);
+		~IntervalTimer();
+
+		void start(int8 log_interval);
+		void stop();
+
+		ulib::function<void()> on_expired;
+
+	private:
+		void on_timer();
+		uint32 next_period();
+
+		TimerHandle timer_;
+		uint64 interval_nanos_;
+		uint64 remainder_nanos_;
+	};
+
+}
+
+#endif
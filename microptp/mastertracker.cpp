@@ -61,12 +61,12 @@ namespace uptp {
 	//
 	// MasterDescriptor
 	//
-	MasterDescriptor::MasterDescriptor(const msg::Header& h, const msg::Announce& a)
+	MasterDescriptor::MasterDescriptor(const msg::Header& h, const msg::Announce& a, const NetAddress& source_address)
 	{
-		update(h, a);
+		update(h, a, source_address);
 	}
 
-	void MasterDescriptor::update(const msg::Header& h, const msg::Announce& a)
+	void MasterDescriptor::update(const msg::Header& h, const msg::Announce& a, const NetAddress& source_address)
 	{
 		port_identity = h.source_port_identity;
 		grandmaster_clock = a.grandmaster_identity;
@@ -80,6 +80,7 @@ namespace uptp {
 
 		domainNumber = h.domain_number;
 		timeSource = a.time_source;
+		address = source_address;
 	}
 
 
@@ -96,13 +97,13 @@ namespace uptp {
 	{
 	}
 
-	void MasterTracker::announce_master(const msg::Header& header, const msg::Announce& announce)
+	void MasterTracker::announce_master(const msg::Header& header, const msg::Announce& announce, const NetAddress& source_address)
 	{
 		auto* best = best_foreign();
 		
 		auto it = std::find_if(sorted_masters_.begin(), sorted_masters_.end(), [&](const auto& pm) { return pm->port_identity == header.source_port_identity;});
 		if (it != sorted_masters_.end()) {
-			(*it)->update(header, announce);
+			(*it)->update(header, announce, source_address);
 			sorted_masters_.restore(it);
 		} else {
 			if (sorted_masters_.size() == sorted_masters_.capacity() && bmc_compare(MasterDescriptor(header, announce), *sorted_masters_.max_element(), config_)) {
@@ -110,7 +111,7 @@ namespace uptp {
 			}
 
 			if (sorted_masters_.size() != sorted_masters_.capacity()) {
-				sorted_masters_.emplace_binary(foreign_masters_.make(header, announce));
+				sorted_masters_.emplace_binary(foreign_masters_.make(header, announce, source_address));
 			} 
 		}
 
@@ -11,8 +11,8 @@
 namespace uptp {
 
 	struct MasterDescriptor {
-		MasterDescriptor(const msg::Header& h, const msg::Announce& a);
-		void update(const msg::Header& h, const msg::Announce& a);
+		MasterDescriptor(const msg::Header& h, const msg::Announce& a, const NetAddress& source_address = NetAddress());
+		void update(const msg::Header& h, const msg::Announce& a, const NetAddress& source_address);
 
 		PortIdentity port_identity;		
 		ClockIdentity grandmaster_clock;
@@ -27,6 +27,8 @@ namespace uptp {
 		uint8 domainNumber;
 		enum8 timeSource;
 
+		NetAddress address;		// address the Announces come from, empty if the port doesn't tell
+
 		TimerHandle watchdog;
 	};
 
@@ -60,7 +62,7 @@ namespace uptp {
 		MasterTracker(const Config&);
 		~MasterTracker();
 
-		void announce_master(const msg::Header& header, const msg::Announce& announce);
+		void announce_master(const msg::Header& header, const msg::Announce& announce, const NetAddress& source_address = NetAddress());
 
 		ulib::function<void()> foreign_set_changed;
 		ulib::function<void()> best_master_changed;
@@ -10,71 +10,40 @@ namespace uptp {
 
 	namespace msg {
 		
-		namespace {
-
-			template<size_t Offset>
-			void serialize(net_buffer buff, const ClockIdentity& host)
-			{
-				buff.serialize<uint8[8], Offset>(host.identity);
-			}
-
-			template<size_t Offset>
-			void deserialize(net_const_buffer buff, ClockIdentity& host)
-			{
-				buff.deserialize<uint8[8], Offset>(host.identity);
-			}
-
-			template<size_t Offset>
-			void serialize(net_buffer buff, const PortIdentity& host)
-			{
-				serialize<Offset>(buff, host.clock);
-				buff.serialize<uint16, Offset + 8>(host.port);
-			}
-
-			template<size_t Offset>
-			void deserialize(net_const_buffer buff, PortIdentity& host)
-			{
-				deserialize<Offset>(buff, host.clock);
-				buff.deserialize<uint16, Offset + 8>(host.port);
-			}
-
-			template<size_t Offset>
-			void serialize(net_buffer buff, const Time& time)
-			{
-				buff.serialize<uint16, Offset, uint16>((time.secs_ >> 32) & 0xFFFF)
-					.serialize<uint32, Offset + 2, uint32>(time.secs_ & 0xFFFFFFFF)
-					.serialize<uint32, Offset + 6, uint32>(time.nanos_);
-			}
-
-			template<size_t Offset>
-			void deserialize(net_const_buffer buff, Time& time)
-			{
-				uint16 temp16;
-				uint32 temp32;
-
-				buff.deserialize<uint16, Offset>(temp16)
-					.deserialize<uint32, Offset + 2>(temp32)
-					.deserialize<uint32, Offset + 6>(time.nanos_);
-
-				time.secs_ = (static_cast<uint64>(temp16) << 32) | temp32;
-			}
-
-			template<size_t Offset>
-			void serialize(net_buffer buff, const ClockQuality& quality)
-			{
-				buff.serialize<uint8, Offset>(quality.clock_class)
-					.serialize<uint8, Offset + 1>(quality.clock_accuracy)
-					.serialize<uint16, Offset + 2>(quality.offset_scaled_log_variance);
+		size_t message_size(MessageTypes type)
+		{
+			switch(type) {
+			case MessageTypes::Synch:                 return message_size<Sync>();
+			case MessageTypes::DelayRequest:          return message_size<DelayReq>();
+			case MessageTypes::PeerDelayReq:          return message_size<PDelayReq>();
+			case MessageTypes::PeerDelayResp:         return message_size<PDelayResp>();
+			case MessageTypes::FollowUp:              return message_size<FollowUp>();
+			case MessageTypes::DelayResp:             return message_size<DelayResp>();
+			case MessageTypes::PeerDelayRespFollowUp: return message_size<PDelayRespFollowUp>();
+			case MessageTypes::Announce:              return message_size<Announce>();
+			case MessageTypes::Signaling:             return message_size<Signaling>();
+			default:                                  return message_size<Header>();
 			}
+		}
 
-			template<size_t Offset>
-			void deserialize(net_const_buffer buff, ClockQuality& quality)
-			{
-				buff.deserialize<uint8, Offset>(quality.clock_class)
-					.deserialize<uint8, Offset + 1>(quality.clock_accuracy)
-					.deserialize<uint16, Offset + 2>(quality.offset_scaled_log_variance);
+		uint8 control_field(MessageTypes type)
+		{
+			switch(type) {
+			case MessageTypes::Synch:        return 0;
+			case MessageTypes::DelayRequest: return 1;
+			case MessageTypes::FollowUp:     return 2;
+			case MessageTypes::DelayResp:    return 3;
+			case MessageTypes::Management:   return 4;
+			default:                         return 5;
 			}
+		}
 
+		bool validate(const Header& header, size_t packet_size)
+		{
+			const size_t required = message_size(static_cast<MessageTypes>(header.message_type));
+			return packet_size >= required
+				&& header.message_length >= required
+				&& header.message_length <= packet_size;
 		}
 
 		//
@@ -82,39 +51,12 @@ namespace uptp {
 		//
 		void serialize(net_buffer buff, const Header& host)
 		{
-			buff
-				.serialize<uint4u,  0>(host.transport_specific)
-				.serialize<uint4l,  0>(host.message_type)
-				.serialize<uint4u,  1>(0)
-				.serialize<uint4l,  1>(host.version_ptp)
-				.serialize<uint16,  2>(host.message_length)
-				.serialize<uint8,   4>(host.domain_number)
-				.serialize<uint8,   5>(0)
-				.serialize<uint8,   6>(host.flag_field0)
-				.serialize<uint8,   7>(host.flag_field1)
-				.serialize<uint64,  8>(host.correction_field)
-				.serialize<uint32, 16>(0)
-				.serialize_nested<PortIdentity, &serialize<20>>(host.source_port_identity)
-				.serialize<uint16, 30>(host.sequence_id)
-				.serialize<uint8,  32>(host.control_field)
-				.serialize<int8,   33>(host.log_message_interval);
+			layouts::header::serialize(buff, host);
 		}
 
 		void deserialize(net_const_buffer buff, Header& host)
 		{
-			buff
-				.deserialize<uint4u,  0>(host.transport_specific)
-				.deserialize<uint4l,  0>(host.message_type)
-				.deserialize<uint4l,  1>(host.version_ptp)
-				.deserialize<uint16,  2>(host.message_length)
-				.deserialize<uint8,   4>(host.domain_number)
-				.deserialize<uint8,   6>(host.flag_field0)
-				.deserialize<uint8,   7>(host.flag_field1)
-				.deserialize<uint64,  8>(host.correction_field)
-				.deserialize_nested <PortIdentity, &deserialize<20>>(host.source_port_identity)
-				.deserialize<uint16, 30>(host.sequence_id)
-				.deserialize<uint8,  32>(host.control_field)
-				.deserialize<int8,   33>(host.log_message_interval);
+			layouts::header::deserialize(buff, host);
 		}
 
 		//
@@ -122,28 +64,12 @@ namespace uptp {
 		// 
 		void serialize(net_buffer buff, const Announce& host)
 		{
-			buff
-				.serialize_nested<Time, &serialize<34>>(host.origin_timestamp)
-				.serialize<uint16, 44>(host.current_utc_offset)
-				.serialize<uint8,  47>(host.grandmaster_priority1)
-				.serialize_nested<ClockQuality, &serialize<48>>(host.grandmaster_clock_quality)
-				.serialize<uint8, 52>(host.grandmaster_priority2)
-				.serialize_nested<ClockIdentity, &serialize<53>>(host.grandmaster_identity)
-				.serialize<uint16, 61>(host.steps_removed) // unaligned write!
-				.serialize<uint8,  63>(host.time_source);
+			layouts::announce::serialize(buff, host);
 		}
 
 		void deserialize(net_const_buffer buff, Announce& host)
 		{
-			buff
-				.deserialize_nested<Time, &deserialize<34>>(host.origin_timestamp)
-				.deserialize<uint16, 44>(host.current_utc_offset)
-				.deserialize<uint8, 47>(host.grandmaster_priority1)
-				.deserialize_nested<ClockQuality, &deserialize<48>>(host.grandmaster_clock_quality)
-				.deserialize<uint8, 52>(host.grandmaster_priority2)
-				.deserialize_nested<ClockIdentity, &deserialize<53>>(host.grandmaster_identity)
-				.deserialize<uint16, 61>(host.steps_removed)	// unaligned read!
-				.deserialize<uint8, 63>(host.time_source);
+			layouts::announce::deserialize(buff, host);
 		}
 
 		//
@@ -151,13 +77,12 @@ namespace uptp {
 		//
 		void serialize(net_buffer buff, const Sync& host)
 		{
-			serialize<34>(buff, host.origin_timestamp);
+			layouts::sync::serialize(buff, host);
 		}
 
 		void deserialize(net_const_buffer buff, Sync& host)
 		{
-			deserialize<34>(buff, host.origin_timestamp);
-			//buff.deserialize_nested<Time, &deserialize<34>>(host.origin_timestamp);
+			layouts::sync::deserialize(buff, host);
 		}
 
 		//
@@ -165,12 +90,12 @@ namespace uptp {
 		//
 		void serialize(net_buffer buff, const FollowUp& host)
 		{
-			serialize<34>(buff, host.precise_origin_timestamp);
+			layouts::follow_up::serialize(buff, host);
 		}
 
 		void deserialize(net_const_buffer buff, FollowUp& host)
 		{
-			deserialize<34>(buff, host.precise_origin_timestamp);
+			layouts::follow_up::deserialize(buff, host);
 		}
 
 		//
@@ -178,12 +103,12 @@ namespace uptp {
 		//
 		void serialize(net_buffer buff, const PDelayReq& host)
 		{
-			serialize<34>(buff, host.timestamp);
+			layouts::pdelay_req::serialize(buff, host);
 		}
 
 		void deserialize(net_const_buffer buff, PDelayReq& host)
 		{
-			deserialize<34>(buff, host.timestamp);
+			layouts::pdelay_req::deserialize(buff, host);
 		}
 
 		//
@@ -191,14 +116,12 @@ namespace uptp {
 		//
 		void serialize(net_buffer buff, const PDelayResp& host)
 		{
-			serialize<34>(buff, host.port_identity);
-			serialize<44>(buff, host.timestamp);
+			layouts::pdelay_resp::serialize(buff, host);
 		}
 
 		void deserialize(net_const_buffer buff, PDelayResp& host)
 		{
-			deserialize<34>(buff, host.port_identity);
-			deserialize<44>(buff, host.timestamp);
+			layouts::pdelay_resp::deserialize(buff, host);
 		}
 
 		//
@@ -206,12 +129,12 @@ namespace uptp {
 		//
 		void serialize(net_buffer buff, const PDelayRespFollowUp& host)
 		{
-			serialize<34>(buff, host.precise_origin_timestamp);
+			layouts::pdelay_resp_follow_up::serialize(buff, host);
 		}
 
 		void deserialize(net_const_buffer buff, PDelayRespFollowUp& host)
 		{
-			deserialize<34>(buff, host.precise_origin_timestamp);
+			layouts::pdelay_resp_follow_up::deserialize(buff, host);
 		}
 
 		//
@@ -219,12 +142,12 @@ namespace uptp {
 		//
 		void serialize(net_buffer buff, const DelayReq& host)
 		{
-			serialize<34>(buff, host.timestamp);
+			layouts::delay_req::serialize(buff, host);
 		}
 
 		void deserialize(net_const_buffer buff, DelayReq& host)
 		{
-			deserialize<34>(buff, host.timestamp);
+			layouts::delay_req::deserialize(buff, host);
 		}
 
 		//
@@ -232,14 +155,118 @@ namespace uptp {
 		//
 		void serialize(net_buffer buff, const DelayResp& host)
 		{
-			serialize<34>(buff, host.timestamp);
-			serialize<44>(buff, host.port_identity);
+			layouts::delay_resp::serialize(buff, host);
 		}
 
 		void deserialize(net_const_buffer buff, DelayResp& host)
 		{
-			deserialize<34>(buff, host.timestamp);
-			deserialize<44>(buff, host.port_identity);
+			layouts::delay_resp::deserialize(buff, host);
+		}
+
+
+		//
+		// 802.1AS Follow_Up
+		//
+		void serialize(net_buffer buff, const GptpFollowUp& host)
+		{
+			layouts::gptp_follow_up::serialize(buff, host);
+		}
+
+		void deserialize(net_const_buffer buff, GptpFollowUp& host)
+		{
+			layouts::gptp_follow_up::deserialize(buff, host);
+		}
+
+		FollowUpInformation make_follow_up_information(RateOffset cumulative_rate_offset)
+		{
+			FollowUpInformation info;
+			info.tlv_type = FollowUpInformation::tlv_type_value;
+			info.length_field = FollowUpInformation::length_value;
+			info.organization_id = {{ 0x00, 0x80, 0xC2 }};
+			info.organization_sub_type = {{ 0x00, 0x00, 0x01 }};
+			info.cumulative_scaled_rate_offset = static_cast<int32>(cumulative_rate_offset.scaled_);
+			info.gm_time_base_indicator = 0;
+			info.last_gm_phase_change.fill(0);
+			info.scaled_last_gm_freq_change = 0;
+			return info;
+		}
+
+		bool is_follow_up_information(const FollowUpInformation& info)
+		{
+			return info.tlv_type == FollowUpInformation::tlv_type_value
+				&& info.length_field == FollowUpInformation::length_value
+				&& info.organization_id[0] == 0x00 && info.organization_id[1] == 0x80 && info.organization_id[2] == 0xC2
+				&& info.organization_sub_type[0] == 0x00 && info.organization_sub_type[1] == 0x00 && info.organization_sub_type[2] == 0x01;
+		}
+
+
+		//
+		// Signaling
+		//
+		void serialize(net_buffer buff, const Signaling& host)
+		{
+			layouts::signaling::serialize(buff, host);
+		}
+
+		void deserialize(net_const_buffer buff, Signaling& host)
+		{
+			layouts::signaling::deserialize(buff, host);
+		}
+
+		void deserialize(net_const_buffer buff, TlvHeader& host)
+		{
+			layouts::tlv_header::deserialize(buff, host);
+		}
+
+		void serialize(net_buffer buff, const UnicastTransmissionTlv& host)
+		{
+			if(host.is(TlvTypes::RequestUnicastTransmission)) {
+				layouts::request_unicast_transmission::serialize(buff, host);
+			} else if(host.is(TlvTypes::GrantUnicastTransmission)) {
+				layouts::grant_unicast_transmission::serialize(buff, host);
+			} else {
+				layouts::cancel_unicast_transmission::serialize(buff, host);
+			}
+		}
+
+		void deserialize(net_const_buffer buff, UnicastTransmissionTlv& host)
+		{
+			layouts::tlv_header::deserialize(buff, host);
+			host.log_inter_message_period = 0;
+			host.duration = 0;
+			host.flags = 0;
+
+			if(host.is(TlvTypes::RequestUnicastTransmission)) {
+				layouts::request_unicast_transmission::deserialize(buff, host);
+			} else if(host.is(TlvTypes::GrantUnicastTransmission)) {
+				layouts::grant_unicast_transmission::deserialize(buff, host);
+			} else {
+				layouts::cancel_unicast_transmission::deserialize(buff, host);
+			}
+		}
+
+		UnicastTransmissionTlv make_unicast_tlv(TlvTypes type, MessageTypes message, int8 log_inter_message_period, uint32 duration)
+		{
+			UnicastTransmissionTlv tlv;
+			tlv.tlv_type = static_cast<uint16>(type);
+			tlv.message_type = static_cast<uint8>(message);
+			tlv.log_inter_message_period = log_inter_message_period;
+			tlv.duration = duration;
+			tlv.flags = 0;
+			tlv.length_field = unicast_tlv_length(type);
+			return tlv;
+		}
+
+		uint16 unicast_tlv_length(TlvTypes type)
+		{
+			switch(type) {
+			case TlvTypes::RequestUnicastTransmission:
+				return layouts::request_unicast_transmission::size - TlvHeader::size;
+			case TlvTypes::GrantUnicastTransmission:
+				return layouts::grant_unicast_transmission::size - TlvHeader::size;
+			default:
+				return layouts::cancel_unicast_transmission::size - TlvHeader::size;
+			}
 		}
 
 	}
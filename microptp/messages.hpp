@@ -125,8 +125,261 @@ namespace uptp {
 
 		struct PDelayRespFollowUp : public FollowUp
 		{
+			PortIdentity port_identity;
 		};
 
+		//
+		// IEEE 802.1AS Follow_Up information TLV
+		// (organization extension, 00-80-C2 subtype 1)
+		//
+		struct FollowUpInformation {
+			static constexpr uint16 tlv_type_value = 0x0003;
+			static constexpr uint16 length_value = 28;
+
+			uint16 tlv_type;
+			uint16 length_field;
+			std::array<uint8, 3> organization_id;
+			std::array<uint8, 3> organization_sub_type;
+			int32 cumulative_scaled_rate_offset;	// RateOffset of the grandmaster to the sender
+			uint16 gm_time_base_indicator;
+			std::array<uint8, 12> last_gm_phase_change;	// ScaledNs
+			int32 scaled_last_gm_freq_change;
+		};
+
+		FollowUpInformation make_follow_up_information(RateOffset cumulative_rate_offset);
+		bool is_follow_up_information(const FollowUpInformation& info);
+
+		// 802.1AS Follow_Up, the plain Follow_Up followed by the information TLV
+		struct GptpFollowUp : public FollowUp
+		{
+			FollowUpInformation information;
+		};
+
+		// Signaling body, the TLVs follow from offset 44 up to message_length
+		struct Signaling
+		{
+			PortIdentity target_port_identity;
+		};
+
+		enum class TlvTypes : uint16 {
+			RequestUnicastTransmission = 0x0004,
+			GrantUnicastTransmission = 0x0005,
+			CancelUnicastTransmission = 0x0006,
+			AcknowledgeCancelUnicastTransmission = 0x0007
+		};
+
+		struct TlvHeader {
+			static constexpr size_t size = 4;	// tlvType and lengthField, not counted in lengthField
+
+			uint16 tlv_type;
+			uint16 length_field;
+
+			bool is(TlvTypes type) const {
+				return tlv_type == static_cast<uint16>(type);
+			}
+		};
+
+		//
+		// Unicast negotiation TLVs, one struct for the request, grant, cancel and
+		// acknowledge cancel TLVs. Fields a TLV doesn't carry are left at zero.
+		//
+		struct UnicastTransmissionTlv : public TlvHeader {
+			enum class GrantFlags {
+				RenewalInvited = 0x01
+			};
+
+			uint8 message_type;
+			int8 log_inter_message_period;
+			uint32 duration;	// seconds, a grant of zero denies the request
+			uint8 flags;
+		};
+
+		UnicastTransmissionTlv make_unicast_tlv(TlvTypes type, MessageTypes message, int8 log_inter_message_period = 0, uint32 duration = 0);
+
+		// lengthField of a unicast negotiation TLV, a shorter one can't be deserialized
+		uint16 unicast_tlv_length(TlvTypes type);
+
+		//
+		// Wire layouts
+		// Offsets are absolute within the PTP message, bodies start after the 34 byte header.
+		//
+		namespace layouts {
+
+			using clock_identity = layout::table<
+				UPTP_FIELD(uint8[8], 0, &ClockIdentity::identity)
+			>;
+
+			using port_identity = layout::table<
+				UPTP_NESTED(clock_identity, 0, &PortIdentity::clock),
+				UPTP_FIELD(uint16, 8, &PortIdentity::port)
+			>;
+
+			using clock_quality = layout::table<
+				UPTP_FIELD(uint8,  0, &ClockQuality::clock_class),
+				UPTP_FIELD(uint8,  1, &ClockQuality::clock_accuracy),
+				UPTP_FIELD(uint16, 2, &ClockQuality::offset_scaled_log_variance)
+			>;
+
+			// fields patched into pre-serialized messages
+			using header_flag_field0 = UPTP_FIELD(uint8, 6, &Header::flag_field0);
+			using header_correction  = UPTP_FIELD(uint64, 8, &Header::correction_field);
+			using header_sequence_id = UPTP_FIELD(uint16, 30, &Header::sequence_id);
+
+			using header = layout::table<
+				UPTP_FIELD(uint4u,  0, &Header::transport_specific),
+				UPTP_FIELD(uint4l,  0, &Header::message_type),
+				layout::reserved<uint4u, 1>,
+				UPTP_FIELD(uint4l,  1, &Header::version_ptp),
+				UPTP_FIELD(uint16,  2, &Header::message_length),
+				UPTP_FIELD(uint8,   4, &Header::domain_number),
+				layout::reserved<uint8, 5>,
+				header_flag_field0,
+				UPTP_FIELD(uint8,   7, &Header::flag_field1),
+				header_correction,
+				layout::reserved<uint32, 16>,
+				UPTP_NESTED(port_identity, 20, &Header::source_port_identity),
+				header_sequence_id,
+				UPTP_FIELD(uint8,  32, &Header::control_field),
+				UPTP_FIELD(int8,   33, &Header::log_message_interval)
+			>;
+
+			using announce = layout::table<
+				UPTP_FIELD(timestamp, 34, &Announce::origin_timestamp),
+				UPTP_FIELD(uint16,    44, &Announce::current_utc_offset),
+				layout::reserved<uint8, 46>,
+				UPTP_FIELD(uint8,     47, &Announce::grandmaster_priority1),
+				UPTP_NESTED(clock_quality, 48, &Announce::grandmaster_clock_quality),
+				UPTP_FIELD(uint8,     52, &Announce::grandmaster_priority2),
+				UPTP_NESTED(clock_identity, 53, &Announce::grandmaster_identity),
+				UPTP_FIELD(uint16,    61, &Announce::steps_removed),
+				UPTP_FIELD(uint8,     63, &Announce::time_source)
+			>;
+
+			// Sync, Follow_Up, Delay_Req/Resp and the Pdelay messages all carry their timestamp here
+			using origin_timestamp = UPTP_FIELD(timestamp, 34, &Sync::origin_timestamp);
+
+			using sync = layout::table<
+				origin_timestamp
+			>;
+
+			using follow_up = layout::table<
+				UPTP_FIELD(timestamp, 34, &FollowUp::precise_origin_timestamp)
+			>;
+
+			using delay_req = layout::table<
+				UPTP_FIELD(timestamp, 34, &DelayReq::timestamp)
+			>;
+
+			using requesting_port_identity = UPTP_NESTED(port_identity, 44, &DelayResp::port_identity);
+
+			using delay_resp = layout::table<
+				UPTP_FIELD(timestamp, 34, &DelayResp::timestamp),
+				requesting_port_identity
+			>;
+
+			using pdelay_req = layout::table<
+				UPTP_FIELD(timestamp, 34, &PDelayReq::timestamp),
+				layout::reserved<uint8[10], 44>
+			>;
+
+			using pdelay_resp = layout::table<
+				UPTP_FIELD(timestamp, 34, &PDelayResp::timestamp),
+				UPTP_NESTED(port_identity, 44, &PDelayResp::port_identity)
+			>;
+
+			using pdelay_resp_follow_up = layout::table<
+				UPTP_FIELD(timestamp, 34, &PDelayRespFollowUp::precise_origin_timestamp),
+				UPTP_NESTED(port_identity, 44, &PDelayRespFollowUp::port_identity)
+			>;
+
+			using follow_up_information = layout::table<
+				UPTP_FIELD(uint16,    0, &FollowUpInformation::tlv_type),
+				UPTP_FIELD(uint16,    2, &FollowUpInformation::length_field),
+				UPTP_FIELD(uint8[3],  4, &FollowUpInformation::organization_id),
+				UPTP_FIELD(uint8[3],  7, &FollowUpInformation::organization_sub_type),
+				UPTP_FIELD(int32,    10, &FollowUpInformation::cumulative_scaled_rate_offset),
+				UPTP_FIELD(uint16,   14, &FollowUpInformation::gm_time_base_indicator),
+				UPTP_FIELD(uint8[12],16, &FollowUpInformation::last_gm_phase_change),
+				UPTP_FIELD(int32,    28, &FollowUpInformation::scaled_last_gm_freq_change)
+			>;
+
+			using gptp_follow_up = layout::table<
+				UPTP_FIELD(timestamp, 34, &GptpFollowUp::precise_origin_timestamp),
+				UPTP_NESTED(follow_up_information, 44, &GptpFollowUp::information)
+			>;
+
+			using signaling = layout::table<
+				UPTP_NESTED(port_identity, 34, &Signaling::target_port_identity)
+			>;
+
+			// TLV layouts are relative to the TLV's first byte
+			using tlv_header = layout::table<
+				UPTP_FIELD(uint16, 0, &TlvHeader::tlv_type),
+				UPTP_FIELD(uint16, 2, &TlvHeader::length_field)
+			>;
+
+			using request_unicast_transmission = layout::table<
+				UPTP_FIELD(uint16, 0, &UnicastTransmissionTlv::tlv_type),
+				UPTP_FIELD(uint16, 2, &UnicastTransmissionTlv::length_field),
+				layout::reserved<uint4l, 4>,
+				UPTP_FIELD(uint4u, 4, &UnicastTransmissionTlv::message_type),
+				UPTP_FIELD(int8,   5, &UnicastTransmissionTlv::log_inter_message_period),
+				UPTP_FIELD(uint32, 6, &UnicastTransmissionTlv::duration)
+			>;
+
+			using grant_unicast_transmission = layout::table<
+				UPTP_FIELD(uint16, 0, &UnicastTransmissionTlv::tlv_type),
+				UPTP_FIELD(uint16, 2, &UnicastTransmissionTlv::length_field),
+				layout::reserved<uint4l, 4>,
+				UPTP_FIELD(uint4u, 4, &UnicastTransmissionTlv::message_type),
+				UPTP_FIELD(int8,   5, &UnicastTransmissionTlv::log_inter_message_period),
+				UPTP_FIELD(uint32, 6, &UnicastTransmissionTlv::duration),
+				layout::reserved<uint8, 10>,
+				UPTP_FIELD(uint8, 11, &UnicastTransmissionTlv::flags)
+			>;
+
+			// CANCEL and ACKNOWLEDGE_CANCEL_UNICAST_TRANSMISSION
+			using cancel_unicast_transmission = layout::table<
+				UPTP_FIELD(uint16, 0, &UnicastTransmissionTlv::tlv_type),
+				UPTP_FIELD(uint16, 2, &UnicastTransmissionTlv::length_field),
+				layout::reserved<uint4l, 4>,
+				UPTP_FIELD(uint4u, 4, &UnicastTransmissionTlv::message_type),
+				layout::reserved<uint8, 5>
+			>;
+
+		}
+
+		template< typename Message > struct layout_of;
+
+		template<> struct layout_of<Header>             { using type = layouts::header; };
+		template<> struct layout_of<Announce>           { using type = layouts::announce; };
+		template<> struct layout_of<Sync>               { using type = layouts::sync; };
+		template<> struct layout_of<FollowUp>           { using type = layouts::follow_up; };
+		template<> struct layout_of<DelayReq>           { using type = layouts::delay_req; };
+		template<> struct layout_of<DelayResp>          { using type = layouts::delay_resp; };
+		template<> struct layout_of<PDelayReq>          { using type = layouts::pdelay_req; };
+		template<> struct layout_of<PDelayResp>         { using type = layouts::pdelay_resp; };
+		template<> struct layout_of<PDelayRespFollowUp> { using type = layouts::pdelay_resp_follow_up; };
+		template<> struct layout_of<GptpFollowUp>       { using type = layouts::gptp_follow_up; };
+		template<> struct layout_of<Signaling>          { using type = layouts::signaling; };
+
+		// Static wire size of a message including the header
+		template< typename Message >
+		constexpr size_t message_size()
+		{
+			return layout_of<Message>::type::size;
+		}
+
+		// Minimum wire size of a message type, the header size for types without a layout
+		size_t message_size(MessageTypes type);
+
+		// controlField value of a message type (PTPv1 compatibility)
+		uint8 control_field(MessageTypes type);
+
+		// Checks the header's message_length against the received packet size
+		// and the static size of its message type.
+		bool validate(const Header& header, size_t packet_size);
+
 		void serialize(net_buffer buff, const Header&);
 		void deserialize(net_const_buffer buff, Header&);
 
@@ -153,6 +406,17 @@ namespace uptp {
 
 		void serialize(net_buffer buff, const PDelayRespFollowUp&);
 		void deserialize(net_const_buffer buff, PDelayRespFollowUp&);
+
+		void serialize(net_buffer buff, const GptpFollowUp&);
+		void deserialize(net_const_buffer buff, GptpFollowUp&);
+
+		void serialize(net_buffer buff, const Signaling&);
+		void deserialize(net_const_buffer buff, Signaling&);
+
+		// TLVs, [buff] points at the TLV's first byte
+		void deserialize(net_const_buffer buff, TlvHeader&);
+		void serialize(net_buffer buff, const UnicastTransmissionTlv&);
+		void deserialize(net_const_buffer buff, UnicastTransmissionTlv&);
 	}
 
 }
@@ -3,12 +3,19 @@
 
 #include <config/config.h>
 
+// Linux hosts: #define MICROPTP_PORT_LINUX instead of the block below
 #ifndef STMLIB_LWIP_ONETHREAD
 #define MICROPTP_PORT_CORTEX_M4
 #else
 #define MICROPTP_PORT_CORTEX_M4_ONETHREAD
 #endif
 
+// A Linux master serving a few thousand slaves: a response batch fills one
+// sendmmsg (Socket::max_batch), the client table takes 320 kB
+//#define UPTP_DELAY_REQ_QUEUE_SIZE 64
+//#define UPTP_DELAY_RESP_BATCH 16
+//#define UPTP_DELAY_RESP_CLIENTS 8192
+
 #include <stmlib/trace.h>
 
 #define PRINT(Args...) trace_printf(0, Args)
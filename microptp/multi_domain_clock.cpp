@@ -0,0 +1,155 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <microptp/config.hpp>
+#include <microptp/multi_domain_clock.hpp>
+#include <microptp/ports/systemport.hpp>
+
+namespace uptp {
+
+	MultiDomainClock::MultiDomainClock(SystemPort& system_port, const Config& config, const std::array<uint8, num_domains>& domain_numbers)
+		: MultiDomainClock(system_port, config, domain_numbers, std::make_index_sequence<num_domains>())
+	{
+	}
+
+	template< size_t... Indices >
+	MultiDomainClock::MultiDomainClock(SystemPort& system_port, const Config& config, const std::array<uint8, num_domains>& domain_numbers, std::index_sequence<Indices...>)
+		: system_port_(system_port),
+		  clocks_{{ { system_port, domain_config(config, domain_numbers[Indices]) }... }}
+	{
+		for(size_t i = 0; i < interfaces_.size(); ++i) {
+			interfaces_[i].owner = this;
+			interfaces_[i].index = i;
+		}
+	}
+
+	Config MultiDomainClock::domain_config(const Config& config, uint8 domain_number)
+	{
+		Config result = config;
+		result.domain_number = domain_number;
+		return result;
+	}
+
+	PtpClock& MultiDomainClock::domain(size_t index)
+	{
+		return clocks_[index];
+	}
+
+	void MultiDomainClock::enable()
+	{
+		for(auto& clock : clocks_) {
+			clock.enable();
+		}
+	}
+
+	void MultiDomainClock::disable()
+	{
+		for(auto& clock : clocks_) {
+			clock.disable();
+		}
+	}
+
+	void MultiDomainClock::on_network_changed(ip_address ipaddr, const std::array<uint8, 6>& macaddr)
+	{
+		(void) ipaddr;
+
+		set_identity(macaddr);
+
+		auto sockets = open_interface(system_port_);
+		if( Config::transport == Config::Transport::Ethernet ) {
+			attach(0, std::move(sockets.event));
+		} else {
+			attach(0, std::move(sockets.event), std::move(sockets.general));
+		}
+	}
+
+	void MultiDomainClock::set_identity(const std::array<uint8, 6>& macaddr)
+	{
+		for(auto& clock : clocks_) {
+			clock.set_identity(macaddr);
+		}
+	}
+
+	void MultiDomainClock::attach(size_t port_index, NetHandle event, NetHandle general)
+	{
+		auto& interface = interfaces_[port_index];
+		interface.event   = std::move(event);
+		interface.general = std::move(general);
+
+		if( interface.event && interface.general ) {
+			interface.event->on_received   = ulib::function<void(PacketHandle)>(&interface, &Interface::on_event_message);
+			interface.general->on_received = ulib::function<void(PacketHandle)>(&interface, &Interface::on_general_message);
+			interface.event->on_transmit_completed = ulib::function<void(uint32, Time)>(&interface, &Interface::on_event_transmitted);
+		}
+
+		for(auto& clock : clocks_) {
+			clock.port(port_index).share(interface.event, interface.general);
+		}
+	}
+
+	void MultiDomainClock::attach(size_t port_index, NetHandle net)
+	{
+		auto& interface = interfaces_[port_index];
+		interface.event   = std::move(net);
+		interface.general = NetHandle();
+
+		if( interface.event ) {
+			interface.event->on_received = ulib::function<void(PacketHandle)>(&interface, &Interface::on_general_message);
+			interface.event->on_transmit_completed = ulib::function<void(uint32, Time)>(&interface, &Interface::on_event_transmitted);
+		}
+
+		for(auto& clock : clocks_) {
+			clock.port(port_index).share(interface.event, interface.event);
+		}
+	}
+
+	PtpPort* MultiDomainClock::find_port(uint8 domain_number, size_t port_index)
+	{
+		for(auto& clock : clocks_) {
+			if(clock.get_config().domain_number == domain_number) {
+				return &clock.port(port_index);
+			}
+		}
+
+		return nullptr;
+	}
+
+	PtpPort* MultiDomainClock::find_port(const PacketHandle& packet, size_t port_index)
+	{
+		if (!msg::layouts::header::fits(packet->size())) {
+			return nullptr;
+		}
+
+		// the port validates the header again, only the domain number is needed here
+		msg::Header header;
+		msg::deserialize(packet->get_data(), header);
+		return find_port(header.domain_number, port_index);
+	}
+
+	void MultiDomainClock::Interface::on_event_message(PacketHandle packet)
+	{
+		auto* port = owner->find_port(packet, index);
+		if (port) {
+			port->on_event_message(std::move(packet));
+		}
+	}
+
+	void MultiDomainClock::Interface::on_general_message(PacketHandle packet)
+	{
+		auto* port = owner->find_port(packet, index);
+		if (port) {
+			port->on_general_message(std::move(packet));
+		}
+	}
+
+	void MultiDomainClock::Interface::on_event_transmitted(uint32 id, Time time)
+	{
+		auto* port = owner->find_port(transmit_domain(id), index);
+		if (port) {
+			port->on_event_transmitted(id, time);
+		}
+	}
+
+}
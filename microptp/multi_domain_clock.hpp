@@ -0,0 +1,69 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_MULTI_DOMAIN_CLOCK_HPP__
+#define MICROPTP_MULTI_DOMAIN_CLOCK_HPP__
+
+#include <array>
+#include <utility>
+#include <microptp/ptpclock.hpp>
+
+namespace uptp {
+
+	class SystemPort;
+
+	//
+	// Config::num_domains PtpClocks on one box, sharing the sockets of every
+	// interface. Received messages and transmit completions are handed to the
+	// clock of their domain number, each clock's servo drives its own
+	// VirtualClock over the free running system timebase.
+	//
+	class MultiDomainClock
+	{
+	public:
+		static const size_t num_domains = Config::num_domains;
+
+		MultiDomainClock(SystemPort& env, const Config& cfg, const std::array<uint8, num_domains>& domain_numbers);
+
+	private:
+		template< size_t... Indices >
+		MultiDomainClock(SystemPort& env, const Config& cfg, const std::array<uint8, num_domains>& domain_numbers, std::index_sequence<Indices...>);
+
+	public:
+		void enable();
+		void disable();
+
+		// Invoked by systemport, see PtpClock
+		void on_network_changed(ip_address ipaddr, const std::array<uint8, 6>& macaddr);
+		void set_identity(const std::array<uint8, 6>& macaddr);
+		void attach(size_t port_index, NetHandle event, NetHandle general);
+		void attach(size_t port_index, NetHandle net);	// PTP over Ethernet
+
+		PtpClock& domain(size_t index);
+
+	private:
+		struct Interface {
+			void on_event_message(PacketHandle packet);
+			void on_general_message(PacketHandle packet);
+			void on_event_transmitted(uint32 id, Time time);
+
+			MultiDomainClock* owner;
+			size_t index;
+			NetHandle event;
+			NetHandle general;
+		};
+
+		static Config domain_config(const Config& cfg, uint8 domain_number);
+		PtpPort* find_port(const PacketHandle& packet, size_t port_index);
+		PtpPort* find_port(uint8 domain_number, size_t port_index);
+
+		SystemPort& system_port_;
+		std::array<PtpClock, num_domains> clocks_;
+		std::array<Interface, Config::num_ports> interfaces_;
+	};
+
+}
+
+#endif
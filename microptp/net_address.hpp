@@ -0,0 +1,107 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_NET_ADDRESS_HPP__
+#define MICROPTP_NET_ADDRESS_HPP__
+
+#include <cstddef>
+#include <microptp/types.hpp>
+
+namespace uptp {
+
+	//
+	// IPv4 or IPv6 address as it goes on the wire, the bytes in network order.
+	// IPv4 addresses take the first four bytes. A default constructed address
+	// is empty and converts to false, like the 0 IPv4 address used to.
+	//
+	struct NetAddress {
+		enum class Family : uint8 {
+			None,
+			Ipv4,
+			Ipv6
+		};
+
+		constexpr NetAddress()
+			: family(Family::None), bytes{}
+		{}
+
+		// from an IPv4 address in network byte order as it sits in memory, 0 gives the empty address
+		static constexpr NetAddress ipv4(uint32 address)
+		{
+			NetAddress result;
+			if(address) {
+				result.family = Family::Ipv4;
+				for(size_t i = 0; i < 4; ++i) {
+					result.bytes[i] = static_cast<uint8>(address >> (8 * i));
+				}
+			}
+			return result;
+		}
+
+		static constexpr NetAddress ipv6(const uint8 (&address)[16])
+		{
+			NetAddress result;
+			result.family = Family::Ipv6;
+			for(size_t i = 0; i < 16; ++i) {
+				result.bytes[i] = address[i];
+			}
+			return result;
+		}
+
+		// ff0<scope>::<group>
+		static constexpr NetAddress ipv6_multicast(uint8 scope, uint16 group)
+		{
+			NetAddress result;
+			result.family = Family::Ipv6;
+			result.bytes[0] = 0xFF;
+			result.bytes[1] = scope & 0x0F;
+			result.bytes[14] = static_cast<uint8>(group >> 8);
+			result.bytes[15] = static_cast<uint8>(group);
+			return result;
+		}
+
+		// IPv4 address in network byte order, 0 for other families
+		constexpr uint32 to_ipv4() const
+		{
+			uint32 result = 0;
+			if(family == Family::Ipv4) {
+				for(size_t i = 0; i < 4; ++i) {
+					result |= static_cast<uint32>(bytes[i]) << (8 * i);
+				}
+			}
+			return result;
+		}
+
+		explicit constexpr operator bool() const
+		{
+			return family != Family::None;
+		}
+
+		Family family;
+		uint8 bytes[16];
+	};
+
+	constexpr bool operator==(const NetAddress& a, const NetAddress& b)
+	{
+		if(a.family != b.family) {
+			return false;
+		}
+
+		for(size_t i = 0; i < 16; ++i) {
+			if(a.bytes[i] != b.bytes[i]) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	constexpr bool operator!=(const NetAddress& a, const NetAddress& b)
+	{
+		return !(a == b);
+	}
+
+}
+
+#endif
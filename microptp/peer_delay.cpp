@@ -0,0 +1,304 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <microptp/config.hpp>
+#include <microptp/ptpclock.hpp>
+#include <microptp/peer_delay.hpp>
+#include <microptp/ports/systemport.hpp>
+
+namespace uptp {
+
+	PeerDelay::PeerDelay(PeerDelayLink& port)
+		: request_timer_(port.get_system_port()),
+		  request_sequence_id_(0),
+		  request_pending_(false), t1_known_(false), response_received_(false), follow_up_needed_(false),
+		  t3_known_(false),
+		  lost_responses_(0),
+		  anchor_age_(0), anchor_valid_(false), rate_ratio_valid_(false),
+		  num_samples_(0),
+		  next_pending_(0),
+		  port_(port)
+	{
+		for(auto& pending : pending_responses_) {
+			pending.used = false;
+		}
+
+		request_timer_.on_expired = ulib::function<void()>(this, &PeerDelay::on_request_timer);
+	}
+
+	PeerDelay::~PeerDelay()
+	{
+		stop();
+	}
+
+	void PeerDelay::start()
+	{
+		request_timer_.start(port_.get_config().log_min_pdelay_req_interval);
+	}
+
+	void PeerDelay::stop()
+	{
+		request_timer_.stop();
+		request_pending_ = false;
+	}
+
+	bool PeerDelay::valid() const
+	{
+		return num_samples_ != 0;
+	}
+
+	TimeInterval PeerDelay::link_delay() const
+	{
+		return TimeInterval(link_delay_buffer_.average());
+	}
+
+	bool PeerDelay::as_capable() const
+	{
+		if(!Config::gptp_profile) {
+			return valid();
+		}
+
+		return valid() && rate_ratio_valid_
+			&& lost_responses_ <= Config::allowed_lost_responses
+			&& link_delay().to_nanos() <= Config::neighbor_prop_delay_thresh_nanos;
+	}
+
+	bool PeerDelay::rate_ratio_valid() const
+	{
+		return rate_ratio_valid_;
+	}
+
+	RateOffset PeerDelay::neighbor_rate_offset() const
+	{
+		return neighbor_rate_offset_;
+	}
+
+	void PeerDelay::on_message(const msg::Header& header, const PacketHandle& packet)
+	{
+		if(header.source_port_identity == port_.get_identity()) {
+			return;		// multicast loopback of our own messages
+		}
+
+		if(header.is(MessageTypes::PeerDelayReq)) {
+			on_request(header, packet);
+		} else if(header.is(MessageTypes::PeerDelayResp)) {
+			on_response(header, packet);
+		} else if(header.is(MessageTypes::PeerDelayRespFollowUp)) {
+			on_response_follow_up(header, packet);
+		}
+	}
+
+	void PeerDelay::on_transmitted(uint32 id, Time time)
+	{
+		const uint16 sequence_id = static_cast<uint16>(id);
+
+		switch(transmit_type(id)) {
+		case MessageTypes::PeerDelayReq:
+			if(request_pending_ && sequence_id == request_sequence_id_) {
+				t1_ = time;
+				t1_known_ = true;
+				try_complete();
+			}
+			break;
+
+		case MessageTypes::PeerDelayResp:
+			on_response_transmitted(transmit_tag(id), sequence_id, time);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	//
+	// Requester
+	//
+
+	void PeerDelay::on_request_timer()
+	{
+		auto& port = port_.event_port();
+		auto handle = port_.transmit_templates().pdelay_req.make(port, ++request_sequence_id_);
+
+		// an unanswered request is simply superseded
+		if(request_pending_ && lost_responses_ != 0xFF) {
+			++lost_responses_;
+		}
+		request_pending_ = false;
+
+		if(handle) {
+			t1_known_ = response_received_ = follow_up_needed_ = t3_known_ = false;
+			turnaround_ = TimeInterval();
+			request_pending_ = true;
+			port->send(ptp_peer_multicast_group, event_port_number, std::move(handle), port_.transmit_id(MessageTypes::PeerDelayReq, request_sequence_id_));
+		}
+	}
+
+	void PeerDelay::on_response(const msg::Header& header, const PacketHandle& packet)
+	{
+		msg::PDelayResp response;
+		msg::deserialize(packet->get_data(), response);
+
+		if(!request_pending_ || response_received_ || header.sequence_id != request_sequence_id_ || response.port_identity != port_.get_identity()) {
+			return;
+		}
+
+		t4_ = packet->time();
+		responder_ = header.source_port_identity;
+		response_received_ = true;
+
+		if(header.flag_field0 & uint8(msg::Header::Field0Flags::TwoStep)) {
+			// t2 in the body, t3 and the turnaround correction follow
+			t2_ = response.timestamp;
+			turnaround_ = TimeInterval(header.correction_field);
+			follow_up_needed_ = true;
+		} else {
+			// one-step: the turnaround time is part of the correction field
+			turnaround_ = TimeInterval(header.correction_field);
+		}
+
+		try_complete();
+	}
+
+	void PeerDelay::on_response_follow_up(const msg::Header& header, const PacketHandle& packet)
+	{
+		msg::PDelayRespFollowUp follow_up;
+		msg::deserialize(packet->get_data(), follow_up);
+
+		if(!follow_up_needed_ || header.sequence_id != request_sequence_id_ || header.source_port_identity != responder_ || follow_up.port_identity != port_.get_identity()) {
+			return;
+		}
+
+		t3_ = follow_up.precise_origin_timestamp;
+		t3_known_ = true;
+		turnaround_ = turnaround_ + TimeInterval(t3_ - t2_) + TimeInterval(header.correction_field);
+		follow_up_needed_ = false;
+
+		try_complete();
+	}
+
+	void PeerDelay::try_complete()
+	{
+		if(!t1_known_ || !response_received_ || follow_up_needed_) {
+			return;
+		}
+
+		request_pending_ = false;
+		lost_responses_ = 0;
+
+		if(t3_known_) {
+			update_rate_ratio();
+		}
+
+		TimeInterval request_to_response(t4_ - t1_);
+		if(Config::gptp_profile && rate_ratio_valid_) {
+			// 802.1AS: measure the requester's interval in the responder's time base
+			request_to_response = neighbor_rate_offset_.apply(request_to_response);
+		}
+
+		const TimeInterval delay = (request_to_response - turnaround_) / 2;
+		if(delay.to_nanos() < 0 || delay.to_nanos() > 50000000) {
+			TRACE("Peer delay: bad link delay %d\n", static_cast<int32>(delay.to_nanos()));
+			return;
+		}
+
+		if(num_samples_++ == 0) {
+			link_delay_buffer_.set(delay.scaled_nanos_);
+		} else {
+			link_delay_buffer_.add(delay.scaled_nanos_);
+		}
+	}
+
+	void PeerDelay::update_rate_ratio()
+	{
+		if(!anchor_valid_ || responder_ != responder_anchor_) {
+			anchor_t3_ = t3_;
+			anchor_t4_ = t4_;
+			anchor_age_ = 0;
+			anchor_valid_ = true;
+			responder_anchor_ = responder_;
+			rate_ratio_valid_ = false;
+			return;
+		}
+
+		if(++anchor_age_ < Config::rate_ratio_window) {
+			return;
+		}
+
+		const int64 responder_interval = (t3_ - anchor_t3_).to_nanos();
+		const int64 requester_interval = (t4_ - anchor_t4_).to_nanos();
+
+		// more than ~4000 ppm, more than RateOffset can scale (2^22 ns apart) or a stepped
+		// clock on either side: start over
+		const int64 difference = ulib::abs(responder_interval - requester_interval);
+		if(requester_interval <= 0 || difference > requester_interval / 256 || difference >= (1ll << 22)) {
+			anchor_valid_ = false;
+			rate_ratio_valid_ = false;
+			return;
+		}
+
+		neighbor_rate_offset_ = RateOffset::from_intervals(responder_interval, requester_interval);
+		rate_ratio_valid_ = true;
+
+		anchor_t3_ = t3_;
+		anchor_t4_ = t4_;
+		anchor_age_ = 0;
+	}
+
+	//
+	// Responder
+	//
+
+	void PeerDelay::on_request(const msg::Header& header, const PacketHandle& packet)
+	{
+		using pdelay_resp_template = TransmitTemplate<msg::PDelayResp>;
+
+		auto& port = port_.event_port();
+		auto handle = port_.transmit_templates().pdelay_resp.make(port, header.sequence_id);
+
+		if(handle) {
+			const size_t index = next_pending_;
+			auto& pending = pending_responses_[index];
+			next_pending_ = (next_pending_ + 1) % pending_responses_.size();
+
+			pending.requester = header.source_port_identity;
+			pending.correction = header.correction_field;
+			pending.sequence_id = header.sequence_id;
+			pending.used = true;
+
+			pdelay_resp_template::set_timestamp(handle, packet->time());
+			pdelay_resp_template::set<msg::layouts::requesting_port_identity>(handle, header.source_port_identity);
+			const uint32 id = port_.transmit_id(MessageTypes::PeerDelayResp, header.sequence_id);
+			port->send(ptp_peer_multicast_group, event_port_number, std::move(handle), tag_transmit_id(id, static_cast<uint8>(index)));
+		}
+	}
+
+	void PeerDelay::on_response_transmitted(size_t index, uint16 sequence_id, Time time)
+	{
+		using follow_up_template = TransmitTemplate<msg::PDelayRespFollowUp>;
+		static_assert(std::tuple_size<decltype(pending_responses_)>::value <= 16, "pending index must fit the transmit id tag");
+
+		if(index >= pending_responses_.size()) {
+			return;
+		}
+
+		// a later request may have taken the entry over
+		auto& pending = pending_responses_[index];
+		if(!pending.used || pending.sequence_id != sequence_id) {
+			return;
+		}
+		pending.used = false;
+
+		auto& port = port_.general_port();
+		auto handle = port_.transmit_templates().pdelay_resp_follow_up.make(port, sequence_id);
+
+		if(handle) {
+			follow_up_template::set_timestamp(handle, time);
+			follow_up_template::set_correction(handle, TimeInterval(pending.correction));
+			follow_up_template::set<msg::layouts::requesting_port_identity>(handle, pending.requester);
+			port->send(ptp_peer_multicast_group, general_port_number, std::move(handle), untracked_transmit_id);
+		}
+	}
+
+}
@@ -0,0 +1,139 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_PEER_DELAY_HPP__
+#define MICROPTP_PEER_DELAY_HPP__
+
+#include <array>
+#include <microlib/circular_buffer.hpp>
+#include <microptp/config.hpp>
+#include <microptp/messages.hpp>
+#include <microptp/ptpdatatypes.hpp>
+#include <microptp/interval_timer.hpp>
+#include <microptp/ports/systemportapi.hpp>
+
+namespace uptp {
+
+	class SystemPort;
+	struct TransmitTemplates;
+
+	//
+	// The port PeerDelay measures the link of: a PtpPort, or a port of a
+	// TransparentClock. Pdelay messages go out with its identity and
+	// templates, their transmit completions are handed back with its ids.
+	//
+	class PeerDelayLink {
+	public:
+		virtual SystemPort& get_system_port() = 0;
+		virtual const Config& get_config() const = 0;
+		virtual const PortIdentity& get_identity() const = 0;
+
+		virtual NetHandle& event_port() = 0;
+		virtual NetHandle& general_port() = 0;
+
+		virtual const TransmitTemplates& transmit_templates() const = 0;
+		virtual uint32 transmit_id(MessageTypes type, uint16 sequence_id) const = 0;
+
+	protected:
+		~PeerDelayLink() {}
+	};
+
+	//
+	// Peer-to-peer delay mechanism of the link.
+	// Owned by the port rather than a state: the link delay is measured
+	// continuously with Pdelay_Req/Pdelay_Resp/Pdelay_Resp_Follow_Up and
+	// survives master changes, so a new master can be followed right away.
+	// Pdelay_Reqs of the peer are answered two-step.
+	//
+	//   link delay = ((t4 - t1) - (t3 - t2) - corrections) / 2
+	//
+	// t1: Pdelay_Req sent, t2: received by the peer,
+	// t3: Pdelay_Resp sent by the peer, t4: received here
+	//
+	// With two-step peers the neighbor rate ratio (peer rate / our rate) is
+	// measured from t3 and t4 over Config::rate_ratio_window exchanges. Under
+	// the gPTP profile it scales (t4 - t1) as in 802.1AS, and as_capable()
+	// additionally requires the delay to stay below the neighbor propagation
+	// delay threshold with no more than allowed_lost_responses in a row lost.
+	//
+	class PeerDelay {
+	public:
+		PeerDelay(PeerDelayLink& port);
+		~PeerDelay();
+
+		void start();
+		void stop();
+
+		void on_message(const msg::Header& header, const PacketHandle& packet);
+		void on_transmitted(uint32 id, Time time);
+
+		bool valid() const;
+		TimeInterval link_delay() const;
+
+		bool as_capable() const;
+		bool rate_ratio_valid() const;
+		RateOffset neighbor_rate_offset() const;
+
+	private:
+		// requester side
+		void on_request_timer();
+		void on_response(const msg::Header& header, const PacketHandle& packet);
+		void on_response_follow_up(const msg::Header& header, const PacketHandle& packet);
+		void try_complete();
+		void update_rate_ratio();
+
+		// responder side
+		void on_request(const msg::Header& header, const PacketHandle& packet);
+		void on_response_transmitted(size_t index, uint16 sequence_id, Time time);
+
+		// Pdelay_Resps awaiting their transmit timestamp, found by the index in
+		// the transmit id tag as requesters may use the same sequence ids
+		struct PendingResponse {
+			PortIdentity requester;
+			int64 correction;
+			uint16 sequence_id;
+			bool used;
+		};
+
+		IntervalTimer request_timer_;
+		uint16 request_sequence_id_;
+
+		// the transmit timestamp may be reported before or after the response arrives
+		bool request_pending_;
+		bool t1_known_;
+		bool response_received_;
+		bool follow_up_needed_;
+
+		Time t1_;
+		Time t2_;
+		Time t3_;
+		Time t4_;
+		bool t3_known_;
+		TimeInterval turnaround_;	// (t3 - t2) plus all correction fields
+		PortIdentity responder_;
+
+		uint8 lost_responses_;
+
+		// rate ratio anchor: t3/t4 of the exchange the window started with
+		Time anchor_t3_;
+		Time anchor_t4_;
+		PortIdentity responder_anchor_;
+		uint8 anchor_age_;
+		bool anchor_valid_;
+		bool rate_ratio_valid_;
+		RateOffset neighbor_rate_offset_;
+
+		size_t num_samples_;
+		ulib::circular_averaging_buffer<int64, 8> link_delay_buffer_;	// scaled nanos
+
+		std::array<PendingResponse, 4> pending_responses_;
+		size_t next_pending_;
+
+		PeerDelayLink& port_;
+	};
+
+}
+
+#endif
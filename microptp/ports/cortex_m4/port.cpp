@@ -8,101 +8,17 @@
 #include <microlib/pool.hpp>
 #include <stmlib/eth/lwip/custom_buffer.hpp>
 #include <stmlib/eth.hpp>
-#include <microlib/variant.hpp>
 #include <microptp/ports/cortex_m4/port.hpp>
-#include <chmboxes.h>	// Mailbox for UPTP thread
-#include <chbsem.h>
+#include <chbsem.h>	// wakes the UPTP thread
 #include <stmlib/trace.h>
 
 namespace uptp {
 
-	struct sysport_message {
-		virtual void operator()(SystemPort* sysport) = 0;
-		virtual void free() = 0;
-		virtual ~sysport_message() {}
-	};
-
-	struct func_struct {
-		using callback_function = void (*)(uintptr_t arg1, uintptr_t arg2);
-
-		// would really need some thread safety here
-		callback_function func;
-		uintptr_t arg1;
-		uintptr_t arg2;
-	};
-
-	struct sysport_default_message : public sysport_message
-	{
-		util::static_union< func_struct, SystemPort::ThreadCommands, ip_addr_t > payload;
-
-		// fixme, use douple dispatch...
-		void operator()(SystemPort* sysport) {
-			if(payload.is<SystemPort::ThreadCommands>()) {
-				auto& ref = payload.as<SystemPort::ThreadCommands>();
-				sysport->on_command(ref);
-			} else if(payload.is<ip_addr_t>()) {
-				auto& ref = payload.as<ip_addr_t>();
-				sysport->on_ip_addr_changed(ref);
-			} else if(payload.is<func_struct>()) {
-				auto& ref = payload.as<func_struct>();
-				ref.func(ref.arg1, ref.arg2);
-			}
-		}
-
-		util::pool_ptr<sysport_default_message> lifetime_;
-
-		void free() override {
-			lifetime_.clear();
-		}
-	};
-
-	util::pool<sysport_default_message, 4, util::SysLock> default_message_pool;
-
-	struct recv_data_struct
-	{
-		PacketHandle packet;
-		ip_addr_t addr;
-		UdpStruct* udp_struct;
-	};
-
-	struct transmit_complete_struct {
-		UdpStruct* udp;
-		uint32 id;
-		uint64 time;
-	};
-
-	struct udp_messages : public sysport_message
-	{
-		util::static_union< recv_data_struct, transmit_complete_struct > payload;
-
-		void operator()(SystemPort* port)
-		{
-			if(payload.is< recv_data_struct >()) {
-				auto& ref = payload.as< recv_data_struct >();
-				ref.udp_struct->on_recv_portthread(ref);
-			} else if(payload.is<transmit_complete_struct>()) {
-				auto& ref = payload.as<transmit_complete_struct>();
-				ref.udp->on_transmit_completed_portthread(ref.id, ref.time);
-			}
-		}
-
-		void free() override {
-			lifetime_.clear();
-		}
-
-		~udp_messages() {
-		}
-
-		util::pool_ptr<udp_messages> lifetime_;
-	};
-
-	util::pool<udp_messages, 4, util::SysLock> udp_message_pool;
-
 	//
 	// UdpStruct
 	//
 	UdpStruct::UdpStruct(SystemPort* sysport, uint16 port)
-		: sysport_(sysport), udpport_(port), pcb_(nullptr)
+		: pcb_(nullptr), sysport_(sysport), udpport_(port)
 	{
 		tcpip_callback(&UdpStruct::create_udp, this);
 	}
@@ -125,79 +41,119 @@ namespace uptp {
 	// called in context of tcpip-thread
 	void UdpStruct::on_recv_tcpthread( void * arg, struct udp_pcb * upcb, struct pbuf * p, const ip_addr_t * addr, u16_t port)
 	{
+		(void) upcb;
+		(void) port;
+
 		UdpStruct& udp_struct = *reinterpret_cast<UdpStruct*>(arg);
-		PacketHandle handle(eth::lwip::ptr_from_pbuf(p));
-
-		// relay over udp_message() -> mailbox -> udp_message::operator() -> to on_recv_portthread
-		auto msg = udp_message_pool.make();
-		if(msg) {
-			auto& ref = msg->payload.to_type<recv_data_struct>();
-			ref.addr = *addr;
-			ref.packet = std::move(handle);
-			ref.udp_struct = &udp_struct;
-			udp_struct.sysport_->post_message(std::move(msg));
-		}
+
+		// relay over the port's mailbox to on_recv_portthread, a full mailbox drops the packet and counts it
+		SystemPort::Event event;
+		event.kind = SystemPort::Event::Kind::Received;
+		event.udp = &udp_struct;
+		event.packet = PacketHandle(eth::lwip::ptr_from_pbuf(p));
+		event.packet.set_source_address(addr ? addr->addr : 0);
+		udp_struct.sysport_->post(std::move(event));
 	}
 
-	void UdpStruct::on_recv_portthread( recv_data_struct& data )
+	void UdpStruct::on_recv_portthread( PacketHandle packet )
 	{
 		if(on_received) {
-			on_received(std::move(data.packet));
+			on_received(std::move(packet));
 		}
 	}
 
 
-	// Message payload to transfer send command from
-	// portthread to tcp thread
-	struct send_struct {
+	// Send command from the port thread to the tcpip thread. It stays taken until
+	// the driver reports the transmission and carries the packet's id along,
+	// so the port thread never waits for lwIP and several sends can be in flight.
+	// The port thread takes a free one, the tcpip thread gives it back.
+	struct send_message {
 		udp_pcb* upcb;
+		UdpStruct* udp;
 		PacketHandle handle;
 		ip_addr_t addr;
 		uint16 port;
-		BinarySemaphore sema;
+		uint32 id;
+
+		void on_transmitted(uint64 time, eth::lwip::custom_buffer_ptr buffer);
+		void on_send_failed();
+
+		std::atomic<bool> busy;
 	};
 
+	std::array<send_message, 8> send_messages;
+
 	void send_tcpthread(void* ptr);
 
-	// called in context of SystemPort-thread
-	void UdpStruct::send( uint32 ip, uint16 port, PacketHandle handle, uint32 id )
+	// called in context of SystemPort-thread, returns right away
+	void UdpStruct::send( const NetAddress& to, uint16 port, PacketHandle handle, uint32 id )
 	{
-		transmit_id = id;
+		send_message* msg = nullptr;
+		for(auto& candidate : send_messages) {
+			bool expected = false;
+			if(candidate.busy.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+				msg = &candidate;
+				break;
+			}
+		}
 
-		handle.set_transmit_callback(util::function<void(uint64,eth::lwip::custom_buffer_ptr)>(this, &UdpStruct::on_transmit_completed_tcpthread));
+		if(!msg) {
+			// too many sends in flight, lost like on the wire
+			return;
+		}
 
-		send_struct args;
-		args.upcb = pcb_;
-		args.handle = std::move(handle);
-		args.addr.addr = ip;
-		args.port = port;
-		// blocking call
-		chBSemInit(&args.sema, 1);
-		tcpip_callback(send_tcpthread, &args);
-		chBSemWait(&args.sema);
+		msg->upcb = pcb_;
+		msg->udp = this;
+		msg->addr.addr = to.to_ipv4();
+		msg->port = port;
+		msg->id = id;
+		handle.set_transmit_callback(ulib::function<void(uint64,eth::lwip::custom_buffer_ptr)>(msg, &send_message::on_transmitted));
+		msg->handle = std::move(handle);
+
+		if(tcpip_callback_with_block(send_tcpthread, msg, 0) != ERR_OK) {
+			msg->handle = PacketHandle();
+			msg->busy.store(false, std::memory_order_release);
+		}
 	}
 
 	void send_tcpthread(void* ptr)
 	{
-		auto* data = reinterpret_cast<send_struct*>(ptr);
+		auto* data = reinterpret_cast<send_message*>(ptr);
 		auto local = std::move(data->handle);
 		auto* pb = local.release_pbuf();
-		udp_sendto(data->upcb, pb, &data->addr, data->port );
-		chBSemReset((&data->sema), 0);
+		if(udp_sendto(data->upcb, pb, &data->addr, data->port ) != ERR_OK) {
+			pbuf_free(pb);
+			data->on_send_failed();
+		}
 	}
 
-	void UdpStruct::on_transmit_completed_tcpthread(uint64 time, eth::lwip::custom_buffer_ptr buffer)
+	// called in context of tcpip-thread if lwIP refused the packet: the driver never
+	// gets it, so on_transmitted won't come and the message must go now, or failed
+	// sends use up the pool
+	void send_message::on_send_failed()
 	{
-		auto msg = udp_message_pool.make();
-		if(msg) {
-			auto& ref = msg->payload.to_type<transmit_complete_struct>();
-			ref.udp = this;
-			ref.time = time;
-			ref.id = transmit_id;
-			auto* bare_pointer = msg.get_payload();
-			msg->lifetime_ = std::move(msg);
-			sysport_->post_message(bare_pointer);
-		}
+		SystemPort::Event event;
+		event.kind = SystemPort::Event::Kind::SendFailed;
+		event.udp = udp;
+		event.id = id;
+		udp->sysport_->post(std::move(event));
+
+		busy.store(false, std::memory_order_release);	// last, the port thread may take it right away
+	}
+
+	// called in context of tcpip-thread once the packet is out
+	void send_message::on_transmitted(uint64 time, eth::lwip::custom_buffer_ptr buffer)
+	{
+		(void) buffer;
+
+		SystemPort::Event event;
+		event.kind = SystemPort::Event::Kind::Transmitted;
+		event.udp = udp;
+		event.id = id;
+		event.time = time;
+		udp->sysport_->post(std::move(event));
+
+		busy.store(false, std::memory_order_release);	// last, the port thread may take it right away
 	}
 
 	void UdpStruct::on_transmit_completed_portthread(uint32 id, uint64 time)
@@ -222,16 +178,14 @@ namespace uptp {
 	}
 
 
-	util::pool<UdpStruct, 4> udp_pool;
-
 	//
 	// SystemPort
 	//
 
 	SystemPort::SystemPort(const Config& cfg)
-		: clock_(*this, cfg)
+		: failed_sends_(0), clock_(*this, cfg)
 	{
-
+		chBSemInit(&wakeup_, TRUE);
 	}
 
 	SystemPort::~SystemPort()
@@ -248,24 +202,66 @@ namespace uptp {
 	{
 		SystemPort& port = *static_cast<SystemPort*>(arg);
 
-		msg_t mailbox_buff[16];
-		chMBInit(&port.mailbox_, mailbox_buff, 16);
-
 		while(true) {
-			msg_t msg;
-			auto result = chMBFetch(&port.mailbox_, &msg, MS2ST(1000) );
-			if(result == RDY_OK) {
-				auto* port_msg = reinterpret_cast<sysport_message*>(msg);
-				(*port_msg)(&port);
-				port_msg->free();
-			} else if(result == RDY_RESET) {
+			auto result = chBSemWaitTimeout(&port.wakeup_, MS2ST(1000));
+			if(result == RDY_RESET) {
 				break;
 			}
+
+			Event event;
+			while(port.mailbox_.pop(event)) {
+				if(!port.dispatch(event)) {
+					return 0;
+				}
+			}
 		}
 
 		return 0;
 	}
 
+	bool SystemPort::dispatch(Event& event)
+	{
+		switch(event.kind) {
+		case Event::Kind::Received:
+			event.udp->on_recv_portthread(std::move(event.packet));
+			break;
+
+		case Event::Kind::Transmitted:
+			event.udp->on_transmit_completed_portthread(event.id, event.time);
+			break;
+
+		case Event::Kind::SendFailed:
+			// lost like on the wire, the clock gets no completion for it
+			TRACE("System Port: send %u failed.\n", static_cast<unsigned>(event.id));
+			++failed_sends_;
+			break;
+
+		case Event::Kind::Command:
+			if(event.command == ThreadCommands::Finish) {
+				return false;
+			}
+			on_command(event.command);
+			break;
+
+		case Event::Kind::TimerExpired:
+			event.timer->expired(event.id);
+			break;
+
+		case Event::Kind::NetworkChanged:
+			on_network_changed(event.addr, event.mac);
+			break;
+
+		case Event::Kind::Callback:
+			event.callback(event.arg1, event.arg2);
+			break;
+
+		default:
+			break;
+		}
+
+		return true;
+	}
+
 	void SystemPort::on_command(ThreadCommands cmds)
 	{
 		if(cmds == ThreadCommands::EnableClock) {
@@ -275,48 +271,68 @@ namespace uptp {
 		}
 	}
 
-	void SystemPort::on_ip_addr_changed( ip_addr_t addr )
+	void SystemPort::on_network_changed( ip_addr_t addr, const std::array<uint8, 6>& mac )
 	{
 		ip_address_ = addr;
-		clock_.on_network_changed();
+		clock_.on_network_changed(addr, mac);
 	}
 
-	void SystemPort::post_message(sysport_message* msg)
+	bool SystemPort::post(Event&& event)
 	{
-		chMBPost(&mailbox_, reinterpret_cast<msg_t>(msg), TIME_INFINITE);
+		// any thread, never blocks
+		if(!mailbox_.push(std::move(event))) {
+			return false;
+		}
+
+		chBSemSignal(&wakeup_);
+		return true;
 	}
 
-	void SystemPort::ip_addr_changed( ip_addr_t addr )
+	bool SystemPort::post_i(Event&& event)
 	{
-		auto msg = default_message_pool.make();
-		if(msg) {
-			auto& ref = msg->payload.to_type<ip_addr_t>();
-			ref = addr;
-			post_message(std::move(msg));
+		if(!mailbox_.push(std::move(event))) {
+			return false;
 		}
+
+		chBSemSignalI(&wakeup_);
+		return true;
 	}
 
+	MpscQueue<SystemPort::Event, Config::port_mailbox_depth>::Stats SystemPort::mailbox_stats() const
+	{
+		return mailbox_.stats();
+	}
+
+	uint32 SystemPort::failed_sends() const
+	{
+		return failed_sends_;
+	}
+
+	void SystemPort::network_changed( ip_address addr, const std::array<uint8, 6>& mac_address )
+	{
+		Event event;
+		event.kind = Event::Kind::NetworkChanged;
+		event.addr = addr;
+		event.mac = mac_address;
+		post(std::move(event));
+	}
 
 	void SystemPort::post_callback( void(*func)(uintptr_t, uintptr_t), uintptr_t arg1, uintptr_t arg2)
 	{
-		auto msg = default_message_pool.make();
-		if(msg) {
-			auto& ref = msg->payload.to_type<func_struct>();
-			ref.func = func;
-			ref.arg1 = arg1;
-			ref.arg2 = arg2;
-			post_message(std::move(msg));
-		}
+		Event event;
+		event.kind = Event::Kind::Callback;
+		event.callback = func;
+		event.arg1 = arg1;
+		event.arg2 = arg2;
+		post(std::move(event));
 	}
 
 	void SystemPort::post_thread_command(ThreadCommands cmd)
 	{
-		auto msg = default_message_pool.make();
-		if(msg) {
-			auto& ref = msg->payload.to_type<ThreadCommands>();
-			ref = cmd;
-			post_message(std::move(msg));
-		}
+		Event event;
+		event.kind = Event::Kind::Command;
+		event.command = cmd;
+		post(std::move(event));
 	}
 
 	// Port interface
@@ -324,24 +340,42 @@ namespace uptp {
 	{
 	}
 
-	void SystemPort::make_timer(size_t id, uint32 millis)
+	TimerHandle SystemPort::make_timer()
 	{
+		return timer_pool_.make(this);
+	}
 
+	TimerHandle SystemPort::make_timer(ulib::function<void()> func)
+	{
+		return timer_pool_.make(this, std::move(func));
 	}
 
-	void SystemPort::close_timer(size_t id)
+	NetHandle SystemPort::make_udp(NetAddress::Family family, uint16 port)
 	{
+		// lwIP is built without IPv6
+		if(family != NetAddress::Family::Ipv4) {
+			return NetHandle();
+		}
+		return udp_pool_.make(this, port);
+	}
 
+	NetHandle SystemPort::make_ethernet()
+	{
+		// lwIP only gives us UDP
+		return NetHandle();
 	}
 
-	NetHandle SystemPort::make_udp(uint16 port)
+	void SystemPort::join_multicast(const NetAddress& group)
 	{
-		return udp_pool.make(this, port);
+		uint32 multicast_addr = group.to_ipv4();
+		if(multicast_addr) {
+			igmp_joingroup( &ip_address_, (ip_addr_t*)&multicast_addr );
+		}
 	}
 
-	void SystemPort::join_multicast(uint32 multicast_addr)
+	void SystemPort::join_multicast(const std::array<uint8, 6>& multicast_mac)
 	{
-		auto result = igmp_joingroup( &ip_address_, (ip_addr_t*)&multicast_addr );
+		(void) multicast_mac;
 	}
 
 	void SystemPort::leave_multicast()
@@ -361,9 +395,9 @@ namespace uptp {
 
 	void SystemPort::adjust_time(Time delta)
 	{
-		uint32 subs = eth::ptp_nanos_to_subseconds(util::abs(delta.nanos_));
-		uint32 secs = static_cast<uint32>(util::abs(delta.secs_));
-		if(delta.secs_ < 0 || delta.nanos_ < 0) {
+		uint32 subs = eth::ptp_nanos_to_subseconds(ulib::abs(delta.nanos()));
+		uint32 secs = static_cast<uint32>(ulib::abs(delta.secs()));
+		if(delta.to_nanos() < 0) {
 			subs |= 1<<31;
 		} else {
 			trace_printf(0, "System Port: adding %d secs %d subs.\n", secs, subs);
@@ -387,13 +421,13 @@ namespace uptp {
 	//
 
 	PacketHandle::PacketHandle()
-		: buffer_(nullptr)
+		: buffer_(nullptr), source_address_(0)
 	{
 
 	}
 
 	PacketHandle::PacketHandle(eth::lwip::custom_buffer_ptr buffer)
-		: buffer_(std::move(buffer))
+		: buffer_(std::move(buffer)), source_address_(0)
 	{
 	}
 
@@ -405,11 +439,11 @@ namespace uptp {
 	}
 
 	PacketHandle::PacketHandle(PacketHandle&& other)
-		: buffer_(std::move(other.buffer_))
+		: buffer_(std::move(other.buffer_)), source_address_(other.source_address_)
 	{
 	}
 
-	void PacketHandle::set_transmit_callback(util::function<void(uint64, eth::lwip::custom_buffer_ptr)> func)
+	void PacketHandle::set_transmit_callback(ulib::function<void(uint64, eth::lwip::custom_buffer_ptr)> func)
 	{
 		if(buffer_) {
 			auto& ref = buffer_->enhance().to_type<eth::lwip::transmit_callback>();
@@ -420,6 +454,27 @@ namespace uptp {
 	PacketHandle& PacketHandle::operator=(PacketHandle&& other)
 	{
 		buffer_ = std::move(other.buffer_);
+		source_address_ = other.source_address_;
+		return *this;
+	}
+
+	PacketHandle* PacketHandle::operator->()
+	{
+		return this;
+	}
+
+	const PacketHandle* PacketHandle::operator->() const
+	{
+		return this;
+	}
+
+	PacketHandle& PacketHandle::operator*()
+	{
+		return *this;
+	}
+
+	const PacketHandle& PacketHandle::operator*() const
+	{
 		return *this;
 	}
 
@@ -448,6 +503,16 @@ namespace uptp {
 		}
 	}
 
+	NetAddress PacketHandle::source_address() const
+	{
+		return NetAddress::ipv4(source_address_);
+	}
+
+	void PacketHandle::set_source_address(uint32 address)
+	{
+		source_address_ = address;
+	}
+
 	void* PacketHandle::get_data()
 	{
 		return buffer_->data();
@@ -479,6 +544,108 @@ namespace uptp {
 		buffer_->pbuf.tot_len = size;
 	}
 
+	size_t PacketHandle::size() const
+	{
+		return buffer_->pbuf.tot_len;
+	}
+
+	//
+	// Timer
+	//
+
+	// Generations are unique across timers: an expiry still in the mailbox
+	// when its timer is freed can't match a timer made in the same pool slot.
+	static std::atomic<uint32> timer_generations(0);
+
+	Timer::Timer(SystemPort* sysport)
+		: sysport_(sysport), due_(0), generation_(0)
+	{
+		timer_.vt_func = nullptr;
+	}
+
+	Timer::Timer(SystemPort* sysport, ulib::function<void()> func)
+		: callback(std::move(func)), sysport_(sysport), due_(0), generation_(0)
+	{
+		timer_.vt_func = nullptr;
+	}
+
+	Timer::~Timer()
+	{
+		stop();
+	}
+
+	void Timer::start(uint32 msecs)
+	{
+		arm(chTimeNow() + MS2ST(msecs));
+	}
+
+	void Timer::reset(uint32 msecs)
+	{
+		arm(chTimeNow() + MS2ST(msecs));
+	}
+
+	void Timer::advance(uint32 msecs)
+	{
+		const systime_t now = chTimeNow();
+		const systime_t period = MS2ST(msecs);
+		systime_t due = due_ + period;
+		// systime_t wraps, compare the distances
+		if(static_cast<int32>(due - now) < -static_cast<int32>(period)) {
+			due = now + period;
+		}
+		arm(due);
+	}
+
+	void Timer::stop()
+	{
+		chSysLock();
+		generation_ = timer_generations.fetch_add(1, std::memory_order_relaxed) + 1;
+		if(chVTIsArmedI(&timer_)) {
+			chVTResetI(&timer_);
+		}
+		chSysUnlock();
+	}
+
+	void Timer::arm(systime_t due)
+	{
+		const systime_t now = chTimeNow();
+		// chVTSetI wants at least one tick
+		const systime_t delay = static_cast<int32>(due - now) > 0 ? due - now : 1;
+
+		chSysLock();
+		generation_ = timer_generations.fetch_add(1, std::memory_order_relaxed) + 1;
+		due_ = due;
+		if(chVTIsArmedI(&timer_)) {
+			chVTResetI(&timer_);
+		}
+		chVTSetI(&timer_, delay, &Timer::on_expired_isr, this);
+		chSysUnlock();
+	}
+
+	void Timer::on_expired_isr(void* arg)
+	{
+		Timer& timer = *reinterpret_cast<Timer*>(arg);
+
+		// virtual timers run from the tick interrupt with the kernel locked
+		SystemPort::Event event;
+		event.kind = SystemPort::Event::Kind::TimerExpired;
+		event.timer = &timer;
+		event.id = timer.generation_.load(std::memory_order_relaxed);
+		timer.sysport_->post_i(std::move(event));
+	}
+
+	void Timer::expired(uint32 generation)
+	{
+		// stopped or restarted since it was posted
+		if(generation != generation_.load(std::memory_order_relaxed)) {
+			return;
+		}
+
+		if(callback) {
+			callback();
+		}
+	}
+
 }
 
 #endif
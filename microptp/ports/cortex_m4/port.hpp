@@ -8,12 +8,13 @@
 #include <microptp/ptpclock.hpp>
 #include <microptp/ports/cortex_m4/port_types.hpp>
 #include <microptp/uptp.hpp>
+#include <microptp/util/mpsc_queue.hpp>
+#include <microlib/pool.hpp>
+#include <microlib/functional.hpp>
 #include <thread.hpp>
 
 namespace uptp {
 
-	struct sysport_message;
-
 	class SystemPort
 	{
 	public:
@@ -29,7 +30,8 @@ namespace uptp {
 	public:
 		void start();
 
-		void ip_addr_changed( ip_addr_t addr );
+		// Any thread
+		void network_changed( ip_address addr, const std::array<uint8, 6>& mac_address );
 
 		// Port interface
 	public:
@@ -37,12 +39,14 @@ namespace uptp {
 
 		void init();
 
-		void make_timer(size_t id, uint32 millis);
-		void close_timer(size_t id);
+		TimerHandle make_timer();
+		TimerHandle make_timer(ulib::function<void()> func);
 
-		NetHandle make_udp(uint16 port);
+		NetHandle make_udp(NetAddress::Family family, uint16 port);
+		NetHandle make_ethernet();
 
-		void join_multicast(uint32 multicast_addr);
+		void join_multicast(const NetAddress& group);
+		void join_multicast(const std::array<uint8, 6>& multicast_mac);
 		void leave_multicast();
 
 		Time get_time();
@@ -53,39 +57,69 @@ namespace uptp {
 		void close();
 
 	public:
+		// Everything the port thread is handed by the tcpip thread, the driver
+		// and the application goes through one mailbox
+		struct Event {
+			enum class Kind : uint8 {
+				None,
+				Received,
+				Transmitted,
+				SendFailed,
+				TimerExpired,
+				Command,
+				NetworkChanged,
+				Callback
+			};
+
+			Kind kind = Kind::None;
+			UdpStruct* udp = nullptr;
+			Timer* timer = nullptr;
+			PacketHandle packet;
+			uint32 id = 0;		// transmit id, or the generation of an expired timer
+			uint64 time = 0;
+			ThreadCommands command = ThreadCommands::EnableClock;
+			ip_addr_t addr;
+			std::array<uint8, 6> mac;
+			void (*callback)(uintptr_t, uintptr_t) = nullptr;
+			uintptr_t arg1 = 0;
+			uintptr_t arg2 = 0;
+		};
 
-		template<typename T>
-		void post_message(util::pool_ptr<T> msg) {
-			auto* bare_ptr = msg.get_payload();
-			msg->lifetime_ = std::move(msg);
-			post_message(bare_ptr);
-		}
+		// Any thread, false if the mailbox is full. Drops are counted in mailbox_stats().
+		bool post(Event&& event);
 
-		void post_message(sysport_message* msg);
+		// Interrupt context within chSysLockFromIsr, as post
+		bool post_i(Event&& event);
 
-		void post_ip_addr_changed( ip_addr_t );
 		void post_thread_command( ThreadCommands );
 		void post_callback( void(*)(uintptr_t, uintptr_t), uintptr_t, uintptr_t );
 
-	private:
-		// Mailbox
-		Mailbox mailbox_;
+		MpscQueue<Event, Config::port_mailbox_depth>::Stats mailbox_stats() const;
 
-		friend class sysport_default_message;
+		// Sends lwIP refused, they get no transmit completion
+		uint32 failed_sends() const;
 
+	private:
+		MpscQueue<Event, Config::port_mailbox_depth> mailbox_;
+		BinarySemaphore wakeup_;
+		uint32 failed_sends_;
+
+		bool dispatch(Event& event);
 		void on_command(ThreadCommands);
-		void on_ip_addr_changed(ip_addr_t arg);
+		void on_network_changed(ip_addr_t addr, const std::array<uint8, 6>& mac);
 
 	private:
 		static msg_t threadfunc(void* the_port);
 
-		util::static_thread<&SystemPort::threadfunc, 2048> thread_;	// warning: the mailbox buffer needs to fit into the stack!
+		util::static_thread<&SystemPort::threadfunc, 2048> thread_;
+		ulib::pool<UdpStruct, 4> udp_pool_;
+		ulib::pool<Timer, 13> timer_pool_; // as many as the onethread port
+
 		PtpClock clock_;
 		ip_addr_t ip_address_;
 	};
 		
 }
 
-#define UPTP_SLAVE_ONLY
 #endif
 #endif
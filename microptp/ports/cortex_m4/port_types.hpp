@@ -4,11 +4,15 @@
 #include <microptp_config.hpp>
 #ifdef MICROPTP_PORT_CORTEX_M4
 
+#include <atomic>
 #include <microlib/intrusive_pool.hpp>
 #include <microlib/functional.hpp>
+#include <microlib/pool.hpp>
 #include <microptp/ptpdatatypes.hpp>
+#include <microptp/net_address.hpp>
 #include <lwip/ip.h>
 #include <stmlib/eth/lwip/custom_buffer.hpp>
+#include <ch.h>
 
 namespace uptp {
 
@@ -42,58 +46,103 @@ namespace uptp {
 
 		size_t capacity() const;
 		void set_size(size_t size);
+		size_t size() const;
 
 		Time time() const;
+		NetAddress source_address() const;
 
+		// Used by System Port only
 	public:
 		void time_to_logical();
 		void time_to_physical();
 		PacketHandle(eth::lwip::custom_buffer_ptr buffer);
-	
+
 		pbuf* release_pbuf();
-		void set_transmit_callback(util::function<void(uint64, eth::lwip::custom_buffer_ptr)>);
+		void set_transmit_callback(ulib::function<void(uint64, eth::lwip::custom_buffer_ptr)>);
+		void set_source_address(uint32 address);
 
 	private:
 		eth::lwip::custom_buffer_ptr buffer_;
+		uint32 source_address_;
 	};
 
 	using ReceivePacketHandle = PacketHandle;
 	using TransmitPacketHandle = PacketHandle;
 
-	struct recv_data_struct;
-
 	class UdpStruct {
 	public:
 		UdpStruct(SystemPort* sysport, uint16 port);
 
-		void send( uint32 ip, uint16 port, PacketHandle handle, uint32 id );
+	public:
+		// [NetRep]
+		void send( const NetAddress& to, uint16 port, PacketHandle handle, uint32 id );
 
-		util::function<void(uint32 id, Time timestamp)> on_transmit_completed;
-		util::function<void(PacketHandle)> on_received;
+		ulib::function<void(uint32 id, Time timestamp)> on_transmit_completed;
+		ulib::function<void(PacketHandle)> on_received;
+		ulib::function<void(PacketHandle*, size_t)> on_received_batch;	// unused, lwIP hands out one pbuf at a time
 
 		explicit operator bool() const;
 
 		static PacketHandle acquire_transmit_handle();
 
 	private:
-		void on_transmit_completed_tcpthread(uint64 time, eth::lwip::custom_buffer_ptr buffer);
 		void on_transmit_completed_portthread(uint32 id, uint64 time);
 
-		// FIXME: temporal hack... should really store the id inside the buffers.
-		uint32 transmit_id;
-
 		static void create_udp( void* arg );
 		static void on_recv_tcpthread( void * arg, struct udp_pcb * upcb, struct pbuf * p, const ip_addr_t * addr, u16_t port);
 
-		friend class udp_messages;
-		void on_recv_portthread( recv_data_struct& data );
+		friend class SystemPort;
+		friend struct send_message;
+		void on_recv_portthread( PacketHandle packet );
 
 		udp_pcb* pcb_;
 		SystemPort* sysport_;
 		uint16 udpport_;
 	};
 
-	using NetHandle = util::pool_ptr<UdpStruct>;
+	using NetHandle = ulib::pool_ptr<UdpStruct>;
+
+	//
+	// [TimerRep] on a ChibiOS virtual timer. It expires in interrupt context and
+	// only posts to the port's mailbox, the callback runs on the port thread.
+	// Every start and stop moves the generation on, so an expiry that was
+	// already posted when the timer was stopped or restarted is ignored.
+	//
+	class Timer {
+	public:
+		Timer(SystemPort* sysport);
+		Timer(SystemPort* sysport, ulib::function<void()> func);
+		~Timer();
+
+		Timer(const Timer&) = delete;
+		Timer& operator=(const Timer&) = delete;
+
+	public:
+		// [TimerRep]
+		void start(uint32 msecs);
+		void reset(uint32 msecs);
+		void advance(uint32 msecs);
+		void stop();
+
+		ulib::function<void()> callback;
+
+		// Used by System Port only
+	public:
+		void expired(uint32 generation);
+
+	private:
+		void arm(systime_t due);
+		static void on_expired_isr(void* arg);
+
+		SystemPort* sysport_;
+		VirtualTimer timer_;
+		systime_t due_;
+		std::atomic<uint32> generation_;
+	};
+
+	using TimerHandle = ulib::pool_ptr<Timer>;
+
+	using ip_address = ip_addr_t;
 
 }
 
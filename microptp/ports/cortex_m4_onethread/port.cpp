@@ -5,6 +5,7 @@
 #include <lwip/tcpip.h>
 #include <lwip/udp.h>
 #include <lwip/igmp.h>
+#include <lwip/sys.h>
 #include <stmlib/eth/lwip/custom_buffer.hpp>
 #include <stmlib/eth/lwip_onethread/lwip_thread.hpp>
 #include <stmlib/eth.hpp>
@@ -19,7 +20,7 @@ namespace uptp {
 	// UdpStruct
 	//
 	UdpStruct::UdpStruct(SystemPort* sysport, uint16 port)
-		: pcb_(nullptr), sysport_(sysport), udpport_(port)
+		: transmit_head_(0), transmit_count_(0), pcb_(nullptr), sysport_(sysport), udpport_(port)
 	{
 		pcb_ = udp_new();
 		if (pcb_) {
@@ -36,29 +37,52 @@ namespace uptp {
 	{
 		(void) upcb;
 		(void) port;
-		(void) addr;
 
 		UdpStruct& udp_struct = *reinterpret_cast<UdpStruct*>(arg);
 		PacketHandle handle(eth::lwip::ptr_from_pbuf(p));
+		handle.set_source_address(addr ? addr->addr : 0);
 
 		if (udp_struct.on_received) {
 			udp_struct.on_received(std::move(handle));
 		}
 	}
 
-	// called in context of SystemPort-thread
-	void UdpStruct::send( uint32 ip, uint16 port, PacketHandle handle, uint32 id )
+	// called in context of SystemPort-thread, udp_sendto only queues the packet with the driver
+	void UdpStruct::send( const NetAddress& to, uint16 port, PacketHandle handle, uint32 id )
 	{
-		transmit_id = id;
+		if(transmit_count_ == transmit_ids_.size()) {
+			// too many sends in flight, lost like on the wire
+			return;
+		}
+
+		const uint32 ip = to.to_ipv4();
 		handle.set_transmit_callback(ulib::function<void(uint64,eth::lwip::custom_buffer_ptr)>(this, &UdpStruct::transmit_completed_callback));
-		udp_sendto(pcb_, handle.release_pbuf(), (const ip_addr_t*) &ip, port);
+
+		// queued first, the driver may complete the packet before udp_sendto returns
+		transmit_ids_[(transmit_head_ + transmit_count_) % transmit_ids_.size()] = id;
+		++transmit_count_;
+
+		auto* pb = handle.release_pbuf();
+		if(udp_sendto(pcb_, pb, (const ip_addr_t*) &ip, port) != ERR_OK) {
+			// refused, no completion will come for it
+			--transmit_count_;
+			pbuf_free(pb);
+		}
 	}
 
 	void UdpStruct::transmit_completed_callback(uint64 time, eth::lwip::custom_buffer_ptr buffer)
 	{
 		(void) buffer;
+		if(!transmit_count_) {
+			return;
+		}
+
+		const uint32 id = transmit_ids_[transmit_head_];
+		transmit_head_ = (transmit_head_ + 1) % transmit_ids_.size();
+		--transmit_count_;
+
 		if (on_transmit_completed) {
-			on_transmit_completed(transmit_id, Time(time));
+			on_transmit_completed(id, Time(time));
 		}
 	}
 
@@ -122,14 +146,32 @@ namespace uptp {
 		return timer_pool_.make();
 	}
 
-	NetHandle SystemPort::make_udp(uint16 port)
+	NetHandle SystemPort::make_udp(NetAddress::Family family, uint16 port)
 	{
+		// lwIP is built without IPv6
+		if(family != NetAddress::Family::Ipv4) {
+			return NetHandle();
+		}
 		return udp_pool_.make(this, port);
 	}
 
-	void SystemPort::join_multicast(uint32 multicast_addr)
+	NetHandle SystemPort::make_ethernet()
+	{
+		// lwIP only gives us UDP
+		return NetHandle();
+	}
+
+	void SystemPort::join_multicast(const NetAddress& group)
+	{
+		uint32 multicast_addr = group.to_ipv4();
+		if(multicast_addr) {
+			igmp_joingroup( &ip_address_, (ip_addr_t*)&multicast_addr );
+		}
+	}
+
+	void SystemPort::join_multicast(const std::array<uint8, 6>& multicast_mac)
 	{
-		igmp_joingroup( &ip_address_, (ip_addr_t*)&multicast_addr );
+		(void) multicast_mac;
 	}
 
 	void SystemPort::leave_multicast()
@@ -149,9 +191,9 @@ namespace uptp {
 	void SystemPort::adjust_time(Time delta)
 	{
 		// isn't this really an implementation detail inside the driver? maybe support Secs+Nanos AND Secs+Subsecs there as a type directly.
-		uint32 subs = eth::ptp_nanos_to_subseconds(ulib::abs(delta.nanos_));
-		uint32 secs = static_cast<uint32>(ulib::abs(delta.secs_));
-		if(delta.secs_ < 0 || delta.nanos_ < 0) {
+		uint32 subs = eth::ptp_nanos_to_subseconds(ulib::abs(delta.nanos()));
+		uint32 secs = static_cast<uint32>(ulib::abs(delta.secs()));
+		if(delta.to_nanos() < 0) {
 			subs |= 1<<31;
 		} else {
 			trace_printf(0, "System Port: adding %d secs %d subs.\n", secs, subs);
@@ -174,13 +216,13 @@ namespace uptp {
 	//
 
 	PacketHandle::PacketHandle()
-		: buffer_(nullptr)
+		: buffer_(nullptr), source_address_(0)
 	{
 
 	}
 
 	PacketHandle::PacketHandle(eth::lwip::custom_buffer_ptr buffer)
-		: buffer_(std::move(buffer))
+		: buffer_(std::move(buffer)), source_address_(0)
 	{
 	}
 
@@ -192,7 +234,7 @@ namespace uptp {
 	}
 
 	PacketHandle::PacketHandle(PacketHandle&& other)
-		: buffer_(std::move(other.buffer_))
+		: buffer_(std::move(other.buffer_)), source_address_(other.source_address_)
 	{
 	}
 
@@ -207,6 +249,7 @@ namespace uptp {
 	PacketHandle& PacketHandle::operator=(PacketHandle&& other)
 	{
 		buffer_ = std::move(other.buffer_);
+		source_address_ = other.source_address_;
 		return *this;
 	}
 
@@ -255,6 +298,16 @@ namespace uptp {
 		}
 	}
 
+	NetAddress PacketHandle::source_address() const
+	{
+		return NetAddress::ipv4(source_address_);
+	}
+
+	void PacketHandle::set_source_address(uint32 address)
+	{
+		source_address_ = address;
+	}
+
 	void* PacketHandle::get_data()
 	{
 		return buffer_->data();
@@ -286,26 +339,48 @@ namespace uptp {
 		buffer_->pbuf.tot_len = size;
 	}
 
+	size_t PacketHandle::size() const
+	{
+		return buffer_->pbuf.tot_len;
+	}
+
 	//
 	// Timer Handle
 	//
 	Timer::Timer()
+		: due_(0)
 	{}
 
 	Timer::Timer(ulib::function<void()> func)
-		: callback(std::move(func))
+		: callback(std::move(func)), due_(0)
 	{}
 
 	void Timer::start(uint32 timeout_msecs)
 	{
+		due_ = sys_now() + timeout_msecs;
 		eth::lwip::LwipThread::get().add_timeout_thread(timeout_msecs, &Timer::timer_func, this);
 	}
 
 	void Timer::reset(uint32 timeout_msecs)
 	{
+		due_ = sys_now() + timeout_msecs;
 		eth::lwip::LwipThread::get().update_timeout_thread(timeout_msecs, &Timer::timer_func, this);
 	}
 
+	void Timer::advance(uint32 timeout_msecs)
+	{
+		// lwIP timeouts are relative to now, so take off how late the last one ran;
+		// a deadline a whole period behind means a stall, don't catch up in a burst
+		const uint32 now = sys_now();
+		due_ += timeout_msecs;
+		if(static_cast<int32>(due_ - now) < -static_cast<int32>(timeout_msecs)) {
+			due_ = now + timeout_msecs;
+		}
+
+		const int32 delay = static_cast<int32>(due_ - now);
+		eth::lwip::LwipThread::get().add_timeout_thread(delay > 0 ? static_cast<uint32>(delay) : 0, &Timer::timer_func, this);
+	}
+
 	void Timer::stop()
 	{
 		eth::lwip::LwipThread::get().remove_timeout_thread(&Timer::timer_func, this);
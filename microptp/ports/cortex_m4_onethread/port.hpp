@@ -42,9 +42,11 @@ namespace uptp {
 		TimerHandle make_timer();
 		TimerHandle make_timer(ulib::function<void()> func);
 
-		NetHandle make_udp(uint16 port);
+		NetHandle make_udp(NetAddress::Family family, uint16 port);
+		NetHandle make_ethernet();
 		
-		void join_multicast(uint32 multicast_addr);
+		void join_multicast(const NetAddress& group);
+		void join_multicast(const std::array<uint8, 6>& multicast_mac);
 		void leave_multicast();
 
 		Time get_time();
@@ -59,7 +61,7 @@ namespace uptp {
 
 	private:
 		ulib::pool<UdpStruct, 4> udp_pool_;
-		ulib::pool<Timer, 5> timer_pool_; // a watchdog timer per remote master plus a delay_req timer
+		ulib::pool<Timer, 13> timer_pool_; // a watchdog timer per remote master plus delay_req, pdelay_req, slew and unicast negotiation timers, master: announce, sync, delay_resp flush and unicast grant timers
 
 		PtpClock clock_;
 		ip_addr_t ip_address_;		
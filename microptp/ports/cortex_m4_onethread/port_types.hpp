@@ -7,6 +7,7 @@
 #include <microlib/intrusive_pool.hpp>
 #include <microlib/functional.hpp>
 #include <microptp/ptpdatatypes.hpp>
+#include <microptp/net_address.hpp>
 #include <lwip/ip.h>
 #include <stmlib/eth/lwip/custom_buffer.hpp>
 
@@ -42,8 +43,10 @@ namespace uptp {
 
 		size_t capacity() const;
 		void set_size(size_t size);
+		size_t size() const;
 
 		Time time() const;
+		NetAddress source_address() const;
 
 		// Used by System Port only
 	public:
@@ -52,9 +55,11 @@ namespace uptp {
 		PacketHandle(eth::lwip::custom_buffer_ptr buffer);
 		pbuf* release_pbuf();
 		void set_transmit_callback(ulib::function<void(uint64, eth::lwip::custom_buffer_ptr)>);
+		void set_source_address(uint32 address);
 
 	private:
 		eth::lwip::custom_buffer_ptr buffer_;
+		uint32 source_address_;
 	};
 
 	using ReceivePacketHandle = PacketHandle;
@@ -68,10 +73,11 @@ namespace uptp {
 
 	public:
 		// [NetRep]
-		void send( uint32 ip, uint16 port, PacketHandle handle, uint32 id );
+		void send( const NetAddress& to, uint16 port, PacketHandle handle, uint32 id );
 
 		ulib::function<void(uint32 id, Time timestamp)> on_transmit_completed;
 		ulib::function<void(PacketHandle)> on_received;
+		ulib::function<void(PacketHandle*, size_t)> on_received_batch;	// unused, lwIP hands out one pbuf at a time
 
 		static PacketHandle acquire_transmit_handle();
 
@@ -79,9 +85,11 @@ namespace uptp {
 
 	private:
 		void transmit_completed_callback(uint64 time, eth::lwip::custom_buffer_ptr buffer);
-		
-		// FIXME: temporal hack... should really store the id inside the buffers.
-		uint32 transmit_id;
+
+		// ids of the sends in flight, the driver completes them in order
+		std::array<uint32, 8> transmit_ids_;
+		uint8 transmit_head_;
+		uint8 transmit_count_;
 
 		static void create_udp( void* arg );
 		static void on_recv( void * arg, struct udp_pcb * upcb, struct pbuf * p, const ip_addr_t * addr, u16_t port);
@@ -107,13 +115,15 @@ namespace uptp {
 		// [TimerRep]
 		void start(uint32 msecs);
 		void reset(uint32 msecs);
+		void advance(uint32 msecs);
 		void stop();
 
 		ulib::function<void()> callback;
 		
 	private:
 		static void timer_func(void* arg);
-		
+
+		uint32 due_;	// sys_now() of the deadline
 	};
 
 	using TimerHandle = ulib::pool_ptr<Timer>;
@@ -0,0 +1,2082 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "microptp_config.hpp"
+#ifdef MICROPTP_PORT_LINUX
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+#include <time.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/timex.h>
+#include <fcntl.h>
+#include <linux/errqueue.h>
+#include <linux/ethtool.h>
+#include <linux/if_packet.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#include <microptp/ports/linux/port.hpp>
+
+namespace uptp {
+
+	namespace {
+
+		// Ethernet NetReps only ever send to the two PTP groups
+		const std::array<uint8, 6>& group_mac(const NetAddress& group)
+		{
+			return group == ptp_peer_multicast_group ? ptp_peer_multicast_mac : ptp_multicast_mac;
+		}
+
+		Time from_timespec(const timespec& ts)
+		{
+			return Time(static_cast<int64>(ts.tv_sec), static_cast<int32>(ts.tv_nsec));
+		}
+
+		bool set_option(int fd, int level, int name, int value)
+		{
+			return setsockopt(fd, level, name, &value, sizeof(value)) == 0;
+		}
+
+		// Software stamps in ts[0], raw hardware stamps in ts[2]
+		Time from_timestamping(const cmsghdr* cmsg, bool hardware)
+		{
+			scm_timestamping stamps;
+			std::memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+			return from_timespec(stamps.ts[hardware ? 2 : 0]);
+		}
+
+		// Receive buffers of one datagram apart from the payload
+		struct ReceiveSlot {
+			sockaddr_storage source;
+			iovec iov;
+			alignas(cmsghdr) char control[CMSG_SPACE(sizeof(scm_timestamping))];
+
+			void prepare(msghdr& msg, void* data, size_t capacity)
+			{
+				iov.iov_base = data;
+				iov.iov_len  = capacity;
+
+				std::memset(&msg, 0, sizeof(msg));
+				msg.msg_name       = &source;
+				msg.msg_namelen    = sizeof(source);
+				msg.msg_iov        = &iov;
+				msg.msg_iovlen     = 1;
+				msg.msg_control    = control;
+				msg.msg_controllen = sizeof(control);
+			}
+
+			// kernel timestamp and sender of a received datagram
+			void complete(msghdr& msg, bool hardware, Time& time, NetAddress& source_address)
+			{
+				time = Time();
+				for(cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+					if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+						time = from_timestamping(cmsg, hardware);
+					}
+				}
+
+				source_address = NetAddress();
+				if(source.ss_family == AF_INET) {
+					source_address = NetAddress::ipv4(reinterpret_cast<const sockaddr_in&>(source).sin_addr.s_addr);
+				} else if(source.ss_family == AF_INET6) {
+					source_address = NetAddress::ipv6(reinterpret_cast<const sockaddr_in6&>(source).sin6_addr.s6_addr);
+				}
+			}
+
+			void complete(PacketHandle& packet, msghdr& msg, size_t size, bool hardware)
+			{
+				Time time;
+				NetAddress source_address;
+				complete(msg, hardware, time, source_address);
+				packet->set_received(size, time, source_address);
+			}
+		};
+
+		bool would_block(int error)
+		{
+			if(error == EAGAIN || error == EWOULDBLOCK || error == EINTR) {
+				return true;
+			}
+			TRACE("Linux Port: receive failed (%s).\n", std::strerror(error));
+			return false;
+		}
+
+		void signal_eventfd(int fd)
+		{
+			const uint64 one = 1;
+			if(fd >= 0 && ::write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+				PRINT("Linux Port: wakeup failed (%s).\n", std::strerror(errno));
+			}
+		}
+
+		void reset_eventfd(int fd)
+		{
+			uint64 value;
+			if(fd >= 0) {
+				(void) ::read(fd, &value, sizeof(value));
+			}
+		}
+
+		// Reads one entry off the socket's error queue, false once it is empty.
+		// [stamped] tells whether it was a transmit timestamp, [key] the send it belongs to.
+		bool read_transmit_stamp(int fd, bool hardware, bool& stamped, uint32& key, Time& time)
+		{
+			// SOF_TIMESTAMPING_OPT_TSONLY: no copy of the packet comes back, just the control messages
+			alignas(cmsghdr) char control[CMSG_SPACE(sizeof(scm_timestamping)) + CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_storage))];
+
+			msghdr msg;
+			std::memset(&msg, 0, sizeof(msg));
+			msg.msg_control    = control;
+			msg.msg_controllen = sizeof(control);
+
+			if(recvmsg(fd, &msg, MSG_ERRQUEUE) < 0) {
+				would_block(errno);
+				return false;
+			}
+
+			const cmsghdr* stamp = nullptr;
+			const sock_extended_err* error = nullptr;
+			for(cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+				if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+					stamp = cmsg;
+				} else if(	(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+							(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR) ||
+							(cmsg->cmsg_level == SOL_PACKET && cmsg->cmsg_type == PACKET_TX_TIMESTAMP) )
+				{
+					error = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+				}
+			}
+
+			stamped = stamp && error && error->ee_errno == ENOMSG && error->ee_origin == SO_EE_ORIGIN_TIMESTAMPING;
+			if(stamped) {
+				key  = error->ee_data;
+				time = from_timestamping(stamp, hardware);
+			}
+			return true;
+		}
+
+	}
+
+	//
+	// PacketHandle
+	//
+	PacketBuffer::PacketBuffer()
+		: offset(0), size(0)
+	{
+	}
+
+	PacketHandle::PacketHandle()
+	{
+	}
+
+	PacketHandle::PacketHandle(ulib::pool_ptr<PacketBuffer> buffer)
+		: buffer_(std::move(buffer))
+	{
+	}
+
+	PacketHandle::PacketHandle(PacketHandle&& other)
+		: buffer_(std::move(other.buffer_))
+	{
+	}
+
+	PacketHandle& PacketHandle::operator=(PacketHandle&& other)
+	{
+		buffer_ = std::move(other.buffer_);
+		return *this;
+	}
+
+	PacketHandle::~PacketHandle()
+	{
+	}
+
+	PacketHandle* PacketHandle::operator->()
+	{
+		return this;
+	}
+
+	const PacketHandle* PacketHandle::operator->() const
+	{
+		return this;
+	}
+
+	PacketHandle& PacketHandle::operator*()
+	{
+		return *this;
+	}
+
+	const PacketHandle& PacketHandle::operator*() const
+	{
+		return *this;
+	}
+
+	PacketHandle::operator bool() const
+	{
+		return buffer_ ? true : false;
+	}
+
+	void* PacketHandle::get_data()
+	{
+		return buffer_->data.data() + buffer_->offset;
+	}
+
+	const void* PacketHandle::get_data() const
+	{
+		return buffer_->data.data() + buffer_->offset;
+	}
+
+	size_t PacketHandle::capacity() const
+	{
+		return buffer_->data.size() - buffer_->offset;
+	}
+
+	void PacketHandle::set_size(size_t size)
+	{
+		buffer_->size = std::min(size, capacity());
+	}
+
+	size_t PacketHandle::size() const
+	{
+		return buffer_->size;
+	}
+
+	Time PacketHandle::time() const
+	{
+		return buffer_->time;
+	}
+
+	NetAddress PacketHandle::source_address() const
+	{
+		return buffer_->source_address;
+	}
+
+	void PacketHandle::set_received(size_t size, Time time, const NetAddress& source_address)
+	{
+		set_size(size);
+		buffer_->time = time;
+		buffer_->source_address = source_address;
+	}
+
+	void PacketHandle::set_offset(size_t offset)
+	{
+		buffer_->offset = std::min(offset, buffer_->data.size());
+		buffer_->size = std::min(buffer_->size, capacity());
+	}
+
+	//
+	// Socket
+	//
+	Socket::Socket(SystemPort* sysport, Kind kind, NetAddress::Family family, int fd)
+		: next(nullptr), generation(0), sysport_(sysport), kind_(kind), family_(family), fd_(fd), next_key_(0)
+	{
+		for(auto& pending : pending_) {
+			pending.used = false;
+		}
+		sysport_->link(this);
+	}
+
+	Socket::~Socket()
+	{
+		sysport_->unlink(this);
+		if(fd_ >= 0) {
+			::close(fd_);
+		}
+	}
+
+	void Socket::send( const NetAddress& to, uint16 port, PacketHandle handle, uint32 id )
+	{
+		sockaddr_storage addr;
+		socklen_t length;
+		if(!make_address(to, port, addr, length)) {
+			return;
+		}
+
+		// through io_uring if the port has it, failures come back in send_failed
+		if(sysport_->uses_uring()) {
+			if(!sysport_->submit_send(*this, handle, addr, length, next_key_)) {
+				return;
+			}
+		} else {
+			const ssize_t result = sendto(fd_, handle->get_data(), handle->size(), 0, reinterpret_cast<const sockaddr*>(&addr), length);
+			if(result < 0) {
+				TRACE("Linux Port: send failed (%s).\n", std::strerror(errno));
+				return;
+			}
+		}
+
+		sent(id);
+	}
+
+	void Socket::send_batch( const NetAddress* to, uint16 port, PacketHandle* handles, size_t count, uint32 id )
+	{
+		// the loop submits queued io_uring sends together anyway
+		if(sysport_->uses_uring()) {
+			for(size_t i = 0; i < count; ++i) {
+				send(to[i], port, std::move(handles[i]), id);
+			}
+			return;
+		}
+
+		size_t next = 0;
+		while(next < count) {
+			std::array<mmsghdr, max_batch> messages;
+			std::array<iovec, max_batch> iovs;
+			std::array<sockaddr_storage, max_batch> addresses;
+			size_t filled = 0;
+
+			for(; next < count && filled < max_batch; ++next) {
+				socklen_t length;
+				if(!make_address(to[next], port, addresses[filled], length)) {
+					continue;
+				}
+
+				iovs[filled].iov_base = handles[next]->get_data();
+				iovs[filled].iov_len  = handles[next]->size();
+
+				auto& message = messages[filled];
+				std::memset(&message, 0, sizeof(message));
+				message.msg_hdr.msg_name    = &addresses[filled];
+				message.msg_hdr.msg_namelen = length;
+				message.msg_hdr.msg_iov     = &iovs[filled];
+				message.msg_hdr.msg_iovlen  = 1;
+				++filled;
+			}
+
+			// sendmmsg stops at the first message that fails, that one is
+			// dropped like a failed sendto and the rest goes out with the next call
+			size_t done = 0;
+			while(done < filled) {
+				const int result = sendmmsg(fd_, messages.data() + done, filled - done, 0);
+				if(result <= 0) {
+					TRACE("Linux Port: send failed (%s).\n", std::strerror(errno));
+					++done;
+					continue;
+				}
+
+				for(int i = 0; i < result; ++i) {
+					sent(id);
+				}
+				done += result;
+			}
+		}
+
+		// the packets are out of the buffers
+		for(size_t i = 0; i < count; ++i) {
+			handles[i] = PacketHandle();
+		}
+	}
+
+	bool Socket::make_address( const NetAddress& to, uint16 port, sockaddr_storage& addr, socklen_t& length ) const
+	{
+		if(kind_ == Kind::Udp && to.family != family_) {
+			TRACE("Linux Port: address family mismatch, not sent.\n");
+			return false;
+		}
+
+		std::memset(&addr, 0, sizeof(addr));
+		if(kind_ == Kind::Ethernet) {
+			const auto& mac = group_mac(to);
+
+			auto& ll = reinterpret_cast<sockaddr_ll&>(addr);
+			ll.sll_family   = AF_PACKET;
+			ll.sll_protocol = htons(ptp_ethertype);
+			ll.sll_ifindex  = sysport_->interface_index();
+			ll.sll_halen    = mac.size();
+			std::copy(mac.begin(), mac.end(), ll.sll_addr);
+			length = sizeof(ll);
+		} else if(family_ == NetAddress::Family::Ipv6) {
+			auto& in6 = reinterpret_cast<sockaddr_in6&>(addr);
+			in6.sin6_family   = AF_INET6;
+			in6.sin6_port     = htons(port);
+			in6.sin6_scope_id = sysport_->interface_index();	// needed for link-local scopes, ignored otherwise
+			std::memcpy(in6.sin6_addr.s6_addr, to.bytes, sizeof(in6.sin6_addr.s6_addr));
+			length = sizeof(in6);
+		} else {
+			auto& in = reinterpret_cast<sockaddr_in&>(addr);
+			in.sin_family      = AF_INET;
+			in.sin_port        = htons(port);
+			in.sin_addr.s_addr = to.to_ipv4();
+			length = sizeof(in);
+		}
+		return true;
+	}
+
+	void Socket::sent(uint32 id)
+	{
+		// The kernel counts sends from 0 (SOF_TIMESTAMPING_OPT_ID) and reports
+		// the count with the timestamp on the error queue. A full table drops the oldest.
+		PendingTransmit* slot = &pending_[0];
+		for(auto& pending : pending_) {
+			if(!pending.used) {
+				slot = &pending;
+				break;
+			}
+			if(next_key_ - pending.key > next_key_ - slot->key) {
+				slot = &pending;
+			}
+		}
+
+		slot->key  = next_key_++;
+		slot->id   = id;
+		slot->used = true;
+	}
+
+	PacketHandle Socket::acquire_transmit_handle()
+	{
+		return sysport_->acquire_packet();
+	}
+
+	Socket::operator bool() const
+	{
+		return fd_ >= 0;
+	}
+
+	int Socket::fd() const
+	{
+		return fd_;
+	}
+
+	Socket::Kind Socket::kind() const
+	{
+		return kind_;
+	}
+
+	NetAddress::Family Socket::family() const
+	{
+		return family_;
+	}
+
+	bool Socket::receive()
+	{
+		auto packet = sysport_->acquire_packet();
+
+		// nothing to put it in, read it anyway so poll() doesn't spin on it
+		uint8 scratch[PacketBuffer::max_size];
+		void* data = packet ? packet->get_data() : scratch;
+		const size_t capacity = packet ? packet->capacity() : sizeof(scratch);
+
+		ReceiveSlot slot;
+		msghdr msg;
+		slot.prepare(msg, data, capacity);
+
+		const ssize_t size = recvmsg(fd_, &msg, 0);
+		if(size < 0) {
+			would_block(errno);
+			return false;
+		}
+
+		if(!packet) {
+			TRACE("Linux Port: out of packets, dropped a message.\n");
+			return true;
+		}
+
+		slot.complete(packet, msg, static_cast<size_t>(size), sysport_->hardware_timestamps());
+		sysport_->record_receive_latency(packet->time());
+		if(on_received) {
+			on_received(std::move(packet));
+		}
+
+		return true;
+	}
+
+	bool Socket::receive_batch()
+	{
+		std::array<PacketHandle, max_batch> packets;
+		std::array<ReceiveSlot, max_batch> slots;
+		std::array<mmsghdr, max_batch> msgs;
+
+		size_t count = 0;
+		for(; count < max_batch; ++count) {
+			packets[count] = sysport_->acquire_packet();
+			if(!packets[count]) {
+				break;
+			}
+			slots[count].prepare(msgs[count].msg_hdr, packets[count]->get_data(), packets[count]->capacity());
+		}
+
+		if(!count) {
+			return receive();	// drops one
+		}
+
+		const int received = recvmmsg(fd_, msgs.data(), count, 0, nullptr);
+		if(received <= 0) {
+			if(received < 0) {
+				would_block(errno);
+			}
+			return false;
+		}
+
+		for(int i = 0; i < received; ++i) {
+			slots[i].complete(packets[i], msgs[i].msg_hdr, msgs[i].msg_len, sysport_->hardware_timestamps());
+			sysport_->record_receive_latency(packets[i]->time());
+		}
+
+		if(on_received_batch) {
+			on_received_batch(packets.data(), static_cast<size_t>(received));
+		}
+
+		// a short batch means the queue is empty
+		return static_cast<size_t>(received) == count;
+	}
+
+	bool Socket::receive_timestamp()
+	{
+		bool stamped = false;
+		uint32 key = 0;
+		Time time;
+		if(!read_transmit_stamp(fd_, sysport_->hardware_timestamps(), stamped, key, time)) {
+			return false;
+		}
+
+		if(stamped) {
+			transmit_stamped(key, time);
+		}
+		return true;
+	}
+
+	void Socket::transmit_stamped(uint32 key, Time time)
+	{
+		for(auto& pending : pending_) {
+			if(pending.used && pending.key == key) {
+				pending.used = false;
+				sysport_->transmitted(*this, pending.id, time);
+				break;
+			}
+		}
+	}
+
+	void Socket::send_failed(uint32 key)
+	{
+		// sends after it got their keys one too high
+		for(auto& pending : pending_) {
+			if(!pending.used) {
+				continue;
+			}
+
+			if(pending.key == key) {
+				pending.used = false;
+			} else if(pending.key - key < next_key_ - key) {
+				--pending.key;
+			}
+		}
+		--next_key_;
+	}
+
+	//
+	// Timer
+	//
+	Timer::Timer(SystemPort* sysport)
+		: armed(false), deadline(0), next(nullptr), sysport_(sysport)
+	{
+		sysport_->link(this);
+	}
+
+	Timer::Timer(SystemPort* sysport, ulib::function<void()> func)
+		: callback(std::move(func)), armed(false), deadline(0), next(nullptr), sysport_(sysport)
+	{
+		sysport_->link(this);
+	}
+
+	Timer::~Timer()
+	{
+		sysport_->unlink(this);
+	}
+
+	void Timer::start(uint32 msecs)
+	{
+		deadline = SystemPort::monotonic_nanos() + static_cast<int64>(msecs) * 1000000ll;
+		armed = true;
+	}
+
+	void Timer::reset(uint32 msecs)
+	{
+		start(msecs);
+	}
+
+	void Timer::advance(uint32 msecs)
+	{
+		// a deadline a whole period behind means a stalled loop, don't catch up in a burst
+		const int64 period = static_cast<int64>(msecs) * 1000000ll;
+		const int64 now = SystemPort::monotonic_nanos();
+		deadline = deadline + period < now - period ? now + period : deadline + period;
+		armed = true;
+	}
+
+	void Timer::stop()
+	{
+		armed = false;
+	}
+
+	//
+	// SystemPort
+	//
+	SystemPort::SystemPort(const Config& cfg, const char* interface_name, Timestamping timestamping)
+		: SystemPort(cfg, interface_name, timestamping, ReceiveOptions())
+	{
+	}
+
+	SystemPort::SystemPort(const Config& cfg, const char* interface_name, Timestamping timestamping, const ReceiveOptions& receive)
+		: interface_index_(0), interface_address_(0),
+		  timestamping_(timestamping), clock_fd_(-1), clock_id_(CLOCK_REALTIME), running_(false),
+		  wakeup_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), loop_fd_(-1),
+		  sockets_(nullptr), timers_(nullptr), num_completions_(0),
+		  receive_(receive), receiving_(false), receive_sockets_changed_(false),
+		  receive_sockets_version_(0), receive_sockets_seen_(0), next_generation_(0),
+		  receive_wakeup_fd_(receive.thread || receive.busy_poll ? eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) : -1),
+		  uring_rearm_count_(0), uring_unsupported_(false), uring_dropped_sends_(0),
+		  clock_(*this, cfg)
+	{
+		receive_.thread = receive_.thread || receive_.busy_poll;
+		for(auto& send : uring_sends_) {
+			send.used = false;
+		}
+
+		interface_name_.fill(0);
+		std::strncpy(interface_name_.data(), interface_name, interface_name_.size() - 1);
+	}
+
+	SystemPort::~SystemPort()
+	{
+		detach();
+
+		if(clock_fd_ >= 0) {
+			::close(clock_fd_);
+		}
+
+		if(wakeup_fd_ >= 0) {
+			::close(wakeup_fd_);
+		}
+
+		if(receive_wakeup_fd_ >= 0) {
+			::close(receive_wakeup_fd_);
+		}
+	}
+
+	bool SystemPort::start()
+	{
+		const int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+		if(fd < 0) {
+			return false;
+		}
+
+		ifreq req;
+		std::memset(&req, 0, sizeof(req));
+		std::memcpy(req.ifr_name, interface_name_.data(), std::min(sizeof(req.ifr_name), interface_name_.size()));
+
+		std::array<uint8, 6> mac;
+		bool result = false;
+		if(ioctl(fd, SIOCGIFINDEX, &req) == 0) {
+			interface_index_ = req.ifr_ifindex;
+			if(ioctl(fd, SIOCGIFHWADDR, &req) == 0) {
+				std::copy_n(reinterpret_cast<const uint8*>(req.ifr_hwaddr.sa_data), mac.size(), mac.begin());
+				result = true;
+			}
+		}
+
+		// an Ethernet-only interface may well come without an address
+		if(result && ioctl(fd, SIOCGIFADDR, &req) == 0) {
+			interface_address_ = reinterpret_cast<const sockaddr_in&>(req.ifr_addr).sin_addr.s_addr;
+		}
+
+		if(result && timestamping_ == Timestamping::Hardware && !enable_hardware_timestamps(fd, req.ifr_name)) {
+			PRINT("Linux Port: no hardware timestamps on %s, using software timestamps.\n", interface_name_.data());
+			timestamping_ = Timestamping::Software;
+		}
+
+		::close(fd);
+
+		if(!result) {
+			PRINT("Linux Port: no such interface %s.\n", interface_name_.data());
+			return false;
+		}
+
+		clock_.on_network_changed(interface_address_, mac);
+		return true;
+	}
+
+	bool SystemPort::enable_hardware_timestamps(int fd, const char* name)
+	{
+		ifreq req;
+		std::memset(&req, 0, sizeof(req));
+		std::strncpy(req.ifr_name, name, sizeof(req.ifr_name) - 1);
+
+		// the driver may widen the filter, narrowing it would be an error
+		hwtstamp_config config;
+		std::memset(&config, 0, sizeof(config));
+		config.tx_type   = HWTSTAMP_TX_ON;
+		config.rx_filter = HWTSTAMP_FILTER_PTP_V2_EVENT;
+		req.ifr_data = reinterpret_cast<char*>(&config);
+		if(ioctl(fd, SIOCSHWTSTAMP, &req) != 0 || config.rx_filter == HWTSTAMP_FILTER_NONE) {
+			return false;
+		}
+
+		ethtool_ts_info info;
+		std::memset(&info, 0, sizeof(info));
+		info.cmd = ETHTOOL_GET_TS_INFO;
+		req.ifr_data = reinterpret_cast<char*>(&info);
+		if(ioctl(fd, SIOCETHTOOL, &req) != 0 || info.phc_index < 0) {
+			return false;
+		}
+
+		char device[32];
+		std::snprintf(device, sizeof(device), "/dev/ptp%d", info.phc_index);
+		clock_fd_ = open(device, O_RDWR | O_CLOEXEC);
+		if(clock_fd_ < 0) {
+			return false;
+		}
+
+		// FD_TO_CLOCKID of the kernel's posix-clock.h
+		clock_id_ = static_cast<clockid_t>((~static_cast<unsigned int>(clock_fd_) << 3) | 3);
+		return true;
+	}
+
+	bool SystemPort::enable_timestamping(int fd)
+	{
+		// OPT_TSONLY: transmit stamps come back without a copy of the packet
+		int flags = SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+		if(timestamping_ == Timestamping::Hardware) {
+			flags |= SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+		} else {
+			flags |= SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+		}
+
+		return set_option(fd, SOL_SOCKET, SO_TIMESTAMPING, flags);
+	}
+
+	void SystemPort::enable_busy_poll(int fd)
+	{
+		// more than net.core.busy_read takes CAP_NET_ADMIN, the socket works without
+		if(receive_.so_busy_poll_usecs > 0 && !set_option(fd, SOL_SOCKET, SO_BUSY_POLL, receive_.so_busy_poll_usecs)) {
+			PRINT("Linux Port: can't set SO_BUSY_POLL (%s).\n", std::strerror(errno));
+		}
+	}
+
+	void SystemPort::enable()
+	{
+		clock_.enable();
+	}
+
+	void SystemPort::disable()
+	{
+		clock_.disable();
+	}
+
+	void SystemPort::run()
+	{
+		running_ = true;
+		start_io();
+
+		while(running_) {
+			drain_mailbox();
+			drain_receive_ring();
+			deliver_completions();
+			run_timers();
+			if(!running_) {
+				break;
+			}
+
+			const int timeout = num_completions_ || receive_ring_.readable() ? 0 : next_timeout();
+			if(uring_) {
+				wait_uring(timeout);
+			} else {
+				poll_sockets(timeout);
+			}
+		}
+
+		stop_io();
+	}
+
+	void SystemPort::start_io()
+	{
+		if(receive_.thread) {
+			receive_sockets_changed_ = true;
+			receiving_ = true;
+			receive_thread_ = std::thread(&SystemPort::receive_thread, this);
+		} else if(receive_.backend == Backend::Uring && !start_uring()) {
+			PRINT("Linux Port: no io_uring (%s), using poll().\n", std::strerror(errno));
+		}
+	}
+
+	void SystemPort::stop_io()
+	{
+		stop_uring();
+
+		if(receive_thread_.joinable()) {
+			receiving_ = false;
+			signal_eventfd(receive_wakeup_fd_);
+			receive_thread_.join();
+		}
+	}
+
+	int SystemPort::attach()
+	{
+		if(loop_fd_ >= 0) {
+			return loop_fd_;
+		}
+
+		loop_fd_ = epoll_create1(EPOLL_CLOEXEC);
+		if(loop_fd_ < 0) {
+			PRINT("Linux Port: epoll_create1 failed (%s).\n", std::strerror(errno));
+			return -1;
+		}
+
+		running_ = true;
+		start_io();
+
+		// the eventfd covers posts and the receive thread, io_uring its own
+		// completions, and without either the port reads the sockets itself
+		watch(wakeup_fd_, true);
+		if(uring_) {
+			watch(uring_.fd(), true);
+		} else {
+			watch_sockets();
+		}
+		return loop_fd_;
+	}
+
+	void SystemPort::detach()
+	{
+		if(loop_fd_ < 0) {
+			return;
+		}
+
+		running_ = false;
+		stop_io();
+		::close(loop_fd_);
+		loop_fd_ = -1;
+	}
+
+	int SystemPort::fd() const
+	{
+		return loop_fd_;
+	}
+
+	int64 SystemPort::next_deadline() const
+	{
+		// completions queued by the last round are due right away
+		if(num_completions_) {
+			return 0;
+		}
+
+		int64 deadline = -1;
+		for(const Timer* timer = timers_; timer; timer = timer->next) {
+			if(timer->armed && (deadline < 0 || timer->deadline < deadline)) {
+				deadline = timer->deadline;
+			}
+		}
+		return deadline;
+	}
+
+	void SystemPort::process_ready()
+	{
+		drain_mailbox();
+		drain_receive_ring();
+		if(!running_) {
+			return;
+		}
+
+		// the sockets are level triggered in the epoll set, what is left
+		// after a burst keeps fd() readable for the next call
+		if(uring_) {
+			wait_uring(0);
+		} else {
+			poll_sockets(0);
+		}
+
+		// sends of the callbacks
+		if(uring_) {
+			uring_.submit();
+		}
+	}
+
+	void SystemPort::process_timers()
+	{
+		deliver_completions();
+		run_timers();
+
+		if(uring_) {
+			replenish_uring();
+			uring_.submit();
+		}
+	}
+
+	void SystemPort::watch(int fd, bool add)
+	{
+		epoll_event event;
+		std::memset(&event, 0, sizeof(event));
+		event.events  = EPOLLIN;
+		event.data.fd = fd;
+		if(epoll_ctl(loop_fd_, add ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, fd, &event) != 0 && add) {
+			PRINT("Linux Port: epoll_ctl failed (%s).\n", std::strerror(errno));
+		}
+	}
+
+	void SystemPort::watch_sockets()
+	{
+		// the receive thread, if there is one, has the sockets to itself
+		if(loop_fd_ < 0 || receive_.thread) {
+			return;
+		}
+
+		for(Socket* socket = sockets_; socket; socket = socket->next) {
+			watch(socket->fd(), true);
+		}
+	}
+
+	void SystemPort::stop()
+	{
+		running_ = false;
+	}
+
+	PtpClock& SystemPort::clock()
+	{
+		return clock_;
+	}
+
+	bool SystemPort::post(ulib::function<void()> func)
+	{
+		if(!mailbox_.push(std::move(func))) {
+			return false;
+		}
+
+		signal_eventfd(wakeup_fd_);
+		return true;
+	}
+
+	SystemPort::Mailbox::Stats SystemPort::mailbox_stats() const
+	{
+		return mailbox_.stats();
+	}
+
+	LatencyHistogram& SystemPort::receive_latency()
+	{
+		return receive_latency_;
+	}
+
+	void SystemPort::report_receive_latency() const
+	{
+		const auto& histogram = receive_latency_;
+		PRINT("Linux Port: receive latency, %s, %u samples: min %u, median %u, 99%% %u, 99.9%% %u, max %u ns\n",
+			!receive_.thread ? "port thread" : receive_.busy_poll ? "busy polling receive thread" : "receive thread",
+			histogram.count(), histogram.min(), histogram.percentile(500), histogram.percentile(990),
+			histogram.percentile(999), histogram.max());
+
+		for(size_t i = 0; i < LatencyHistogram::num_buckets; ++i) {
+			if(histogram.bucket(i)) {
+				PRINT("  < %10u ns: %u\n", LatencyHistogram::bucket_limit(i), histogram.bucket(i));
+			}
+		}
+	}
+
+	// Port interface
+	TimerHandle SystemPort::make_timer()
+	{
+		return timer_pool_.make(this);
+	}
+
+	TimerHandle SystemPort::make_timer(ulib::function<void()> func)
+	{
+		return timer_pool_.make(this, std::move(func));
+	}
+
+	NetHandle SystemPort::make_udp(NetAddress::Family family, uint16 port)
+	{
+		const bool ipv6 = family == NetAddress::Family::Ipv6;
+		const int fd = socket(ipv6 ? AF_INET6 : AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if(fd < 0) {
+			return NetHandle();
+		}
+
+		bool result = set_option(fd, SOL_SOCKET, SO_REUSEADDR, 1) && enable_timestamping(fd);
+		if(ipv6) {
+			sockaddr_in6 addr;
+			std::memset(&addr, 0, sizeof(addr));
+			addr.sin6_family = AF_INET6;
+			addr.sin6_port   = htons(port);
+			addr.sin6_addr   = in6addr_any;
+
+			// IPv6 only, so an IPv4 socket on the same port can coexist
+			result = result &&
+				set_option(fd, IPPROTO_IPV6, IPV6_V6ONLY, 1) &&
+				bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0 &&
+				set_option(fd, IPPROTO_IPV6, IPV6_MULTICAST_IF, interface_index_) &&
+				set_option(fd, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, 0);
+		} else {
+			sockaddr_in addr;
+			std::memset(&addr, 0, sizeof(addr));
+			addr.sin_family      = AF_INET;
+			addr.sin_port        = htons(port);
+			addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+			in_addr multicast_if;
+			multicast_if.s_addr = interface_address_;
+
+			result = result &&
+				bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0 &&
+				setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &multicast_if, sizeof(multicast_if)) == 0 &&
+				set_option(fd, IPPROTO_IP, IP_MULTICAST_LOOP, 0);
+		}
+
+		if(!result) {
+			PRINT("Linux Port: can't open UDP port %d (%s).\n", port, std::strerror(errno));
+			::close(fd);
+			return NetHandle();
+		}
+
+		enable_busy_poll(fd);
+		return socket_pool_.make(this, Socket::Kind::Udp, family, fd);
+	}
+
+	NetHandle SystemPort::make_ethernet()
+	{
+		const int fd = socket(AF_PACKET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, htons(ptp_ethertype));
+		if(fd < 0) {
+			PRINT("Linux Port: can't open packet socket (%s).\n", std::strerror(errno));
+			return NetHandle();
+		}
+
+		sockaddr_ll addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sll_family   = AF_PACKET;
+		addr.sll_protocol = htons(ptp_ethertype);
+		addr.sll_ifindex  = interface_index_;
+
+		if(	bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 ||
+			!enable_timestamping(fd) )
+		{
+			PRINT("Linux Port: can't bind packet socket (%s).\n", std::strerror(errno));
+			::close(fd);
+			return NetHandle();
+		}
+
+		enable_busy_poll(fd);
+		return socket_pool_.make(this, Socket::Kind::Ethernet, NetAddress::Family::None, fd);
+	}
+
+	void SystemPort::join_multicast(const NetAddress& group)
+	{
+		for(Socket* socket = sockets_; socket; socket = socket->next) {
+			if(socket->kind() != Socket::Kind::Udp || socket->family() != group.family) {
+				continue;
+			}
+
+			int result;
+			if(group.family == NetAddress::Family::Ipv6) {
+				ipv6_mreq req;
+				std::memcpy(req.ipv6mr_multiaddr.s6_addr, group.bytes, sizeof(req.ipv6mr_multiaddr.s6_addr));
+				req.ipv6mr_interface = interface_index_;
+				result = setsockopt(socket->fd(), IPPROTO_IPV6, IPV6_ADD_MEMBERSHIP, &req, sizeof(req));
+			} else {
+				ip_mreqn req;
+				std::memset(&req, 0, sizeof(req));
+				req.imr_multiaddr.s_addr = group.to_ipv4();
+				req.imr_ifindex          = interface_index_;
+				result = setsockopt(socket->fd(), IPPROTO_IP, IP_ADD_MEMBERSHIP, &req, sizeof(req));
+			}
+
+			if(result != 0 && errno != EADDRINUSE) {
+				PRINT("Linux Port: can't join multicast group (%s).\n", std::strerror(errno));
+			}
+		}
+	}
+
+	void SystemPort::join_multicast(const std::array<uint8, 6>& multicast_mac)
+	{
+		packet_mreq req;
+		std::memset(&req, 0, sizeof(req));
+		req.mr_ifindex = interface_index_;
+		req.mr_type    = PACKET_MR_MULTICAST;
+		req.mr_alen    = multicast_mac.size();
+		std::copy(multicast_mac.begin(), multicast_mac.end(), req.mr_address);
+
+		for(Socket* socket = sockets_; socket; socket = socket->next) {
+			if(socket->kind() == Socket::Kind::Ethernet) {
+				if(setsockopt(socket->fd(), SOL_PACKET, PACKET_ADD_MEMBERSHIP, &req, sizeof(req)) != 0) {
+					PRINT("Linux Port: can't join multicast group (%s).\n", std::strerror(errno));
+				}
+			}
+		}
+	}
+
+	void SystemPort::leave_multicast()
+	{
+		// memberships go away with the sockets
+	}
+
+	Time SystemPort::get_time()
+	{
+		timespec ts;
+		clock_gettime(clock_id_, &ts);
+		return from_timespec(ts);
+	}
+
+	void SystemPort::set_time(Time absolute)
+	{
+		timespec ts;
+		ts.tv_sec  = absolute.secs();
+		ts.tv_nsec = absolute.nanos();
+		if(clock_settime(clock_id_, &ts) != 0) {
+			PRINT("Linux Port: can't set the clock (%s).\n", std::strerror(errno));
+		}
+	}
+
+	void SystemPort::adjust_time(Time delta)
+	{
+		// ADJ_SETOFFSET wants the nanoseconds non-negative
+		int64 secs  = delta.secs();
+		int32 nanos = delta.nanos();
+		if(nanos < 0) {
+			secs  -= 1;
+			nanos += Time::nanos_per_second;
+		}
+
+		timex tx;
+		std::memset(&tx, 0, sizeof(tx));
+		tx.modes        = ADJ_SETOFFSET | ADJ_NANO;
+		tx.time.tv_sec  = secs;
+		tx.time.tv_usec = nanos;
+
+		if(clock_adjtime(clock_id_, &tx) < 0) {
+			PRINT("Linux Port: can't step the clock (%s).\n", std::strerror(errno));
+		}
+	}
+
+	void SystemPort::discipline(int32 ppb)
+	{
+		// the kernel takes ppm with a 16 bit fraction and at most 500 ppm
+		const int64 max_ppb = 500000;
+		const int64 clamped = std::max(-max_ppb, std::min(max_ppb, static_cast<int64>(ppb)));
+
+		timex tx;
+		std::memset(&tx, 0, sizeof(tx));
+		tx.modes = ADJ_FREQUENCY;
+		tx.freq  = static_cast<long>(clamped * 65536 / 1000);
+
+		if(clock_adjtime(clock_id_, &tx) < 0) {
+			PRINT("Linux Port: can't discipline the clock (%s).\n", std::strerror(errno));
+		}
+	}
+
+	// Used by Socket and Timer
+	PacketHandle SystemPort::acquire_packet()
+	{
+		return PacketHandle(packet_pool_.make());
+	}
+
+	int SystemPort::interface_index() const
+	{
+		return interface_index_;
+	}
+
+	bool SystemPort::hardware_timestamps() const
+	{
+		return timestamping_ == Timestamping::Hardware;
+	}
+
+	void SystemPort::transmitted(Socket& socket, uint32 id, Time time)
+	{
+		if(!socket.on_transmit_completed) {
+			return;
+		}
+
+		if(num_completions_ == completions_.size()) {
+			TRACE("Linux Port: transmit completion dropped.\n");
+			return;
+		}
+
+		completions_[num_completions_++] = Completion{ &socket, id, time };
+	}
+
+	void SystemPort::record_receive_latency(Time stamp)
+	{
+		// both on CLOCK_REALTIME, a PHC stamp would compare against another clock
+		if(hardware_timestamps() || !stamp.to_nanos()) {
+			return;
+		}
+
+		timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+		receive_latency_.record((from_timespec(now) - stamp).to_nanos());
+	}
+
+	void SystemPort::link(Socket* socket)
+	{
+		// 0 never names a socket
+		socket->generation = ++next_generation_ ? next_generation_ : ++next_generation_;
+
+		{
+			std::lock_guard<std::mutex> lock(receive_mutex_);
+			socket->next = sockets_;
+			sockets_ = socket;
+			++receive_sockets_version_;
+		}
+		sockets_changed();
+
+		if(uring_ && !(arm(UringOp::Receive, socket->fd(), socket->generation)
+			&& arm(UringOp::ErrorQueue, socket->fd(), socket->generation)))
+		{
+			PRINT("Linux Port: io_uring is full, a socket goes unread.\n");
+		}
+
+		if(loop_fd_ >= 0 && uring_) {
+			uring_.submit();
+		} else if(loop_fd_ >= 0 && !receive_.thread) {
+			watch(socket->fd(), true);
+		}
+	}
+
+	void SystemPort::unlink(Socket* socket)
+	{
+		{
+			std::unique_lock<std::mutex> lock(receive_mutex_);
+			for(Socket** it = &sockets_; *it; it = &(*it)->next) {
+				if(*it == socket) {
+					*it = socket->next;
+					break;
+				}
+			}
+			const uint64 version = ++receive_sockets_version_;
+			sockets_changed();
+
+			// the socket closes its fd next, which the receive thread
+			// mustn't read any more, nor a socket that gets the fd again
+			receive_sockets_taken_.wait(lock, [this, version] {
+				return !receiving_ || receive_sockets_seen_ >= version;
+			});
+		}
+
+		if(uring_) {
+			disarm(*socket);
+		}
+
+		if(loop_fd_ >= 0 && !uring_ && !receive_.thread) {
+			watch(socket->fd(), false);
+		}
+
+		auto end = std::remove_if(completions_.begin(), completions_.begin() + num_completions_,
+			[socket](const Completion& completion) { return completion.socket == socket; });
+		num_completions_ = end - completions_.begin();
+	}
+
+	void SystemPort::link(Timer* timer)
+	{
+		timer->next = timers_;
+		timers_ = timer;
+	}
+
+	void SystemPort::unlink(Timer* timer)
+	{
+		for(Timer** it = &timers_; *it; it = &(*it)->next) {
+			if(*it == timer) {
+				*it = timer->next;
+				break;
+			}
+		}
+	}
+
+	int64 SystemPort::monotonic_nanos()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<int64>(ts.tv_sec) * 1000000000ll + ts.tv_nsec;
+	}
+
+	int SystemPort::next_timeout() const
+	{
+		const Timer* earliest = nullptr;
+		for(const Timer* timer = timers_; timer; timer = timer->next) {
+			if(timer->armed && (!earliest || timer->deadline < earliest->deadline)) {
+				earliest = timer;
+			}
+		}
+
+		if(!earliest) {
+			return -1;
+		}
+
+		// round up, waking early would only mean another round
+		const int64 remaining = earliest->deadline - monotonic_nanos();
+		return remaining <= 0 ? 0 : static_cast<int>((remaining + 999999) / 1000000);
+	}
+
+	void SystemPort::run_timers()
+	{
+		// Callbacks may start, stop or destroy any timer, so look again after each
+		// one. Timers started from a callback are due after now and wait for the next round.
+		const int64 now = monotonic_nanos();
+
+		for(;;) {
+			Timer* due = nullptr;
+			for(Timer* timer = timers_; timer; timer = timer->next) {
+				if(timer->armed && timer->deadline <= now) {
+					due = timer;
+					break;
+				}
+			}
+
+			if(!due) {
+				break;
+			}
+
+			due->armed = false;
+			if(due->callback) {
+				due->callback();
+			}
+		}
+	}
+
+	void SystemPort::deliver_completions()
+	{
+		// completions queued by the callbacks go out next round
+		std::array<Completion, max_completions> pending;
+		const size_t count = num_completions_;
+		std::copy_n(completions_.begin(), count, pending.begin());
+		num_completions_ = 0;
+
+		for(size_t i = 0; i < count; ++i) {
+			Socket* socket = pending[i].socket;
+			if(is_linked(socket) && socket->on_transmit_completed) {
+				socket->on_transmit_completed(pending[i].id, pending[i].time);
+			}
+		}
+	}
+
+	void SystemPort::drain_mailbox()
+	{
+		// reset the eventfd first, a post() racing with the drain wakes the next poll()
+		reset_eventfd(wakeup_fd_);
+
+		// posts from the callbacks wait for the next round, like completions do
+		for(size_t n = Mailbox::depth; n && running_; --n) {
+			ulib::function<void()> func;
+			if(!mailbox_.pop(func)) {
+				break;
+			}
+
+			if(func) {
+				func();
+			}
+		}
+	}
+
+	void SystemPort::poll_sockets(int timeout_msecs)
+	{
+		std::array<pollfd, max_sockets + 1> fds;
+		size_t count = 0;
+		// the receive thread, if there is one, has the sockets to itself
+		for(Socket* socket = receive_.thread ? nullptr : sockets_; socket && count < max_sockets; socket = socket->next) {
+			fds[count].fd      = socket->fd();
+			fds[count].events  = POLLIN;
+			fds[count].revents = 0;
+			++count;
+		}
+
+		// last, so the loop below skips it
+		fds[count].fd      = wakeup_fd_;
+		fds[count].events  = POLLIN;
+		fds[count].revents = 0;
+
+		const int ready = poll(fds.data(), count + 1, timeout_msecs);
+		if(ready <= 0) {
+			if(ready < 0 && errno != EINTR) {
+				PRINT("Linux Port: poll failed (%s).\n", std::strerror(errno));
+			}
+			return;
+		}
+
+		// the socket may have gone away in an earlier callback, so look it up each time
+		for(size_t i = 0; i < count; ++i) {
+			if(fds[i].revents & POLLERR) {
+				for(size_t n = 0; n < max_receive_burst; ++n) {
+					Socket* socket = find_socket(fds[i].fd);
+					if(!socket || !socket->receive_timestamp()) {
+						break;
+					}
+				}
+			}
+
+			if(!(fds[i].revents & POLLIN)) {
+				continue;
+			}
+
+			for(size_t n = 0; n < max_receive_burst; ) {
+				Socket* socket = find_socket(fds[i].fd);
+				if(!socket) {
+					break;
+				}
+
+				if(socket->on_received_batch) {
+					if(!socket->receive_batch()) {
+						break;
+					}
+					n += Socket::max_batch;
+				} else {
+					if(!socket->receive()) {
+						break;
+					}
+					++n;
+				}
+			}
+		}
+	}
+
+	Socket* SystemPort::find_socket(int fd) const
+	{
+		for(Socket* socket = sockets_; socket; socket = socket->next) {
+			if(socket->fd() == fd) {
+				return socket;
+			}
+		}
+		return nullptr;
+	}
+
+	Socket* SystemPort::find_generation(uint32 generation) const
+	{
+		for(Socket* socket = sockets_; socket; socket = socket->next) {
+			if(socket->generation == generation) {
+				return socket;
+			}
+		}
+		return nullptr;
+	}
+
+	bool SystemPort::is_linked(const Socket* socket) const
+	{
+		for(const Socket* it = sockets_; it; it = it->next) {
+			if(it == socket) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void SystemPort::sockets_changed()
+	{
+		if(receiving_) {
+			receive_sockets_changed_ = true;
+			signal_eventfd(receive_wakeup_fd_);
+		}
+	}
+
+	//
+	// Receive thread: reads, stamps and queues, nothing else
+	//
+	void SystemPort::receive_thread()
+	{
+		configure_receive_thread();
+
+		const int64 spin_nanos   = static_cast<int64>(receive_.spin_usecs) * 1000;
+		const int64 yield_nanos  = static_cast<int64>(receive_.yield_usecs) * 1000;
+		const int64 window_nanos = 100000000;
+		const int64 budget_nanos = window_nanos / 100 * std::max(0, std::min(100, receive_.cpu_budget_percent));
+
+		ReceiveFds fds;
+		ReceiveGenerations generations;
+		size_t count = 0;
+
+		int64 idle_since   = monotonic_nanos();	// last time anything came in
+		int64 window_start = idle_since;
+		int64 spun         = 0;					// spinning in this window
+		int64 last         = idle_since;
+
+		while(receiving_) {
+			if(receive_sockets_changed_.exchange(false)) {
+				{
+					std::lock_guard<std::mutex> lock(receive_mutex_);
+					count = 0;
+					for(Socket* socket = sockets_; socket && count < max_sockets; socket = socket->next) {
+						fds[count].fd      = socket->fd();
+						fds[count].events  = POLLIN;
+						generations[count] = socket->generation;
+						++count;
+					}
+					receive_sockets_seen_ = receive_sockets_version_;
+				}
+				receive_sockets_taken_.notify_all();
+			}
+
+			if(!receive_.busy_poll) {
+				if(wait_and_read(fds, generations, count, -1)) {
+					signal_eventfd(wakeup_fd_);
+				}
+				continue;
+			}
+
+			const size_t queued = try_read(fds, generations, count);
+			const int64 now = monotonic_nanos();
+			spun += now - last;
+			last = now;
+
+			if(queued) {
+				signal_eventfd(wakeup_fd_);
+				idle_since = now;
+				continue;
+			}
+
+			if(now - window_start >= window_nanos) {
+				window_start = now;
+				spun = 0;
+			}
+
+			const int64 idle = now - idle_since;
+			if(spun >= budget_nanos) {
+				// out of budget, sleep until data or the next window
+				const int timeout = static_cast<int>((window_start + window_nanos - now + 999999) / 1000000);
+				if(wait_and_read(fds, generations, count, timeout)) {
+					signal_eventfd(wakeup_fd_);
+					idle_since = monotonic_nanos();
+				}
+				last = monotonic_nanos();
+			} else if(idle < spin_nanos) {
+				// spin
+			} else if(receive_.yield_usecs < 0 || idle < spin_nanos + yield_nanos) {
+				sched_yield();
+			} else {
+				if(wait_and_read(fds, generations, count, -1)) {
+					signal_eventfd(wakeup_fd_);
+				}
+				idle_since = last = monotonic_nanos();
+			}
+		}
+	}
+
+	size_t SystemPort::wait_and_read(ReceiveFds& fds, const ReceiveGenerations& generations, size_t count, int timeout_msecs)
+	{
+		fds[count].fd     = receive_wakeup_fd_;
+		fds[count].events = POLLIN;
+		for(size_t i = 0; i <= count; ++i) {
+			fds[i].revents = 0;
+		}
+
+		const int ready = poll(fds.data(), count + 1, timeout_msecs);
+		if(ready <= 0) {
+			if(ready < 0 && errno != EINTR) {
+				PRINT("Linux Port: poll failed (%s).\n", std::strerror(errno));
+			}
+			return 0;
+		}
+
+		if(fds[count].revents & POLLIN) {
+			reset_eventfd(receive_wakeup_fd_);
+		}
+
+		size_t queued = 0;
+		for(size_t i = 0; i < count; ++i) {
+			if(fds[i].revents & POLLERR) {
+				queued += read_transmit_stamps(fds[i].fd, generations[i]);
+			}
+			if(fds[i].revents & POLLIN) {
+				queued += read_datagrams(fds[i].fd, generations[i]);
+			}
+		}
+		return queued;
+	}
+
+	size_t SystemPort::try_read(const ReceiveFds& fds, const ReceiveGenerations& generations, size_t count)
+	{
+		// non-blocking reads, with SO_BUSY_POLL each one polls the device queue too
+		size_t queued = 0;
+		for(size_t i = 0; i < count; ++i) {
+			queued += read_datagrams(fds[i].fd, generations[i]);
+			queued += read_transmit_stamps(fds[i].fd, generations[i]);
+		}
+		return queued;
+	}
+
+	void SystemPort::configure_receive_thread()
+	{
+		if(receive_.cpu >= 0) {
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			CPU_SET(receive_.cpu, &cpus);
+			const int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+			if(error) {
+				PRINT("Linux Port: can't pin the receive thread to cpu %d (%s).\n", receive_.cpu, std::strerror(error));
+			}
+		}
+
+		if(receive_.priority > 0) {
+			sched_param param;
+			std::memset(&param, 0, sizeof(param));
+			param.sched_priority = receive_.priority;
+			const int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+			if(error) {
+				PRINT("Linux Port: can't make the receive thread realtime (%s).\n", std::strerror(error));
+			}
+		}
+	}
+
+	size_t SystemPort::read_datagrams(int fd, uint32 generation)
+	{
+		std::array<ReceiveSlot, Socket::max_batch> slots;
+		std::array<mmsghdr, Socket::max_batch> msgs;
+
+		size_t queued = 0;
+		while(queued < max_receive_burst) {
+			const size_t writable = receive_ring_.writable();
+			const size_t count = writable < Socket::max_batch ? writable : Socket::max_batch;
+			if(!count) {
+				// the protocol thread is behind, keep the socket short anyway
+				uint8 scratch[PacketBuffer::max_size];
+				if(recv(fd, scratch, sizeof(scratch), 0) < 0) {
+					would_block(errno);
+					break;
+				}
+				TRACE("Linux Port: receive ring full, dropped a message.\n");
+				continue;
+			}
+
+			for(size_t i = 0; i < count; ++i) {
+				auto& entry = receive_ring_.slot(i);
+				slots[i].prepare(msgs[i].msg_hdr, entry.data.data(), entry.data.size());
+			}
+
+			const int received = recvmmsg(fd, msgs.data(), count, 0, nullptr);
+			if(received <= 0) {
+				if(received < 0) {
+					would_block(errno);
+				}
+				break;
+			}
+
+			for(int i = 0; i < received; ++i) {
+				auto& entry = receive_ring_.slot(i);
+				entry.kind = Received::Kind::Datagram;
+				entry.socket = generation;
+				entry.size = msgs[i].msg_len;
+				slots[i].complete(msgs[i].msg_hdr, hardware_timestamps(), entry.time, entry.source_address);
+				record_receive_latency(entry.time);
+			}
+
+			receive_ring_.commit(received);
+			queued += received;
+
+			// a short batch means the queue is empty
+			if(static_cast<size_t>(received) < count) {
+				break;
+			}
+		}
+
+		return queued;
+	}
+
+	size_t SystemPort::read_transmit_stamps(int fd, uint32 generation)
+	{
+		size_t queued = 0;
+		for(size_t n = 0; n < max_receive_burst; ++n) {
+			bool stamped = false;
+			uint32 key = 0;
+			Time time;
+			if(!read_transmit_stamp(fd, hardware_timestamps(), stamped, key, time)) {
+				break;
+			}
+
+			if(!stamped) {
+				continue;
+			}
+
+			if(!receive_ring_.writable()) {
+				TRACE("Linux Port: receive ring full, dropped a transmit timestamp.\n");
+				continue;
+			}
+
+			auto& entry = receive_ring_.slot(0);
+			entry.kind = Received::Kind::TransmitStamp;
+			entry.socket = generation;
+			entry.key  = key;
+			entry.time = time;
+			receive_ring_.commit(1);
+			++queued;
+		}
+
+		return queued;
+	}
+
+	void SystemPort::drain_receive_ring()
+	{
+		// Sockets are looked up for every entry, a callback may have closed one
+		ReceiveBatch batch;
+
+		// what was queued up to now, so timers aren't held up
+		for(size_t n = receive_ring_.readable(); n; --n) {
+			auto& entry = receive_ring_.front();
+			Socket* socket = find_generation(entry.socket);
+
+			if(socket && entry.kind == Received::Kind::TransmitStamp) {
+				socket->transmit_stamped(entry.key, entry.time);
+			} else if(socket) {
+				auto packet = acquire_packet();
+				if(packet) {
+					std::copy_n(entry.data.begin(), entry.size, static_cast<uint8*>(packet->get_data()));
+					packet->set_received(entry.size, entry.time, entry.source_address);
+					deliver(batch, socket, std::move(packet));
+				} else {
+					TRACE("Linux Port: out of packets, dropped a message.\n");
+				}
+			}
+
+			receive_ring_.pop();
+		}
+
+		flush(batch);
+	}
+
+	void SystemPort::deliver(ReceiveBatch& batch, Socket* socket, PacketHandle packet)
+	{
+		if(socket != batch.socket || batch.count == batch.packets.size()) {
+			flush(batch);
+			batch.socket = socket;
+		}
+
+		if(socket->on_received_batch) {
+			batch.packets[batch.count++] = std::move(packet);
+		} else if(socket->on_received) {
+			socket->on_received(std::move(packet));
+		}
+	}
+
+	void SystemPort::flush(ReceiveBatch& batch)
+	{
+		if(batch.count && is_linked(batch.socket) && batch.socket->on_received_batch) {
+			batch.socket->on_received_batch(batch.packets.data(), batch.count);
+		}
+
+		for(size_t i = 0; i < batch.count; ++i) {
+			batch.packets[i] = PacketHandle();
+		}
+		batch.count = 0;
+	}
+
+	//
+	// io_uring backend
+	//
+	bool SystemPort::start_uring()
+	{
+		static_assert(uring_name_size >= sizeof(sockaddr_in6) && uring_name_size >= sizeof(sockaddr_ll) && uring_name_size % 8 == 0, "");
+		static_assert(uring_control_size >= CMSG_SPACE(sizeof(scm_timestamping)), "");
+
+		std::memset(&uring_layout_, 0, sizeof(uring_layout_));
+		uring_layout_.msg_namelen    = uring_name_size;
+		uring_layout_.msg_controllen = uring_control_size;
+
+		if(!uring_.open(uring_entries)) {
+			return false;
+		}
+		uring_unsupported_ = false;
+
+		replenish_uring();
+		if(!arm(UringOp::Wakeup, wakeup_fd_, 0)) {
+			stop_uring();
+			return false;
+		}
+
+		for(Socket* socket = sockets_; socket; socket = socket->next) {
+			arm(UringOp::Receive, socket->fd(), socket->generation);
+			arm(UringOp::ErrorQueue, socket->fd(), socket->generation);
+		}
+
+		// an attached loop waits for completions before anything else submits
+		uring_.submit();
+		return true;
+	}
+
+	void SystemPort::stop_uring()
+	{
+		uring_.close();
+
+		for(auto& packet : uring_receive_) {
+			packet = PacketHandle();
+		}
+
+		for(auto& send : uring_sends_) {
+			send.packet = PacketHandle();
+			send.used = false;
+		}
+		uring_rearm_count_ = 0;
+	}
+
+	bool SystemPort::arm(UringOp op, int fd, uint32 generation)
+	{
+		io_uring_sqe* sqe = uring_.get_sqe();
+		if(!sqe) {
+			return false;
+		}
+
+		// completions name the socket by generation, its fd may be closed and reused by then
+		sqe->fd = fd;
+		sqe->user_data = (static_cast<uint64>(op) << 32) | generation;
+
+		if(op == UringOp::Receive) {
+			// kernel 6.0: the kernel fills an io_uring_recvmsg_out, the name,
+			// the control messages and the payload into a provided buffer
+			sqe->opcode    = IORING_OP_RECVMSG;
+			sqe->addr      = reinterpret_cast<uint64>(&uring_layout_);
+			sqe->len       = 1;
+			sqe->ioprio    = IORING_RECV_MULTISHOT;
+			sqe->flags     = IOSQE_BUFFER_SELECT;
+			sqe->buf_group = uring_buffer_group;
+		} else {
+			// the mailbox's eventfd, or a socket's error queue
+			sqe->opcode       = IORING_OP_POLL_ADD;
+			sqe->len          = IORING_POLL_ADD_MULTI;
+			sqe->poll32_events = op == UringOp::Wakeup ? POLLIN : POLLERR;
+		}
+		return true;
+	}
+
+	void SystemPort::disarm(const Socket& socket)
+	{
+		// before the socket closes its fd
+		io_uring_sqe* sqe = uring_.get_sqe();
+		if(sqe) {
+			sqe->opcode       = IORING_OP_ASYNC_CANCEL;
+			sqe->fd           = socket.fd();
+			sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+			sqe->user_data    = static_cast<uint64>(UringOp::Cancel) << 32;
+			uring_.submit();
+		}
+
+		for(size_t i = 0; i < uring_rearm_count_; ++i) {
+			if(uring_rearm_[i] == socket.generation) {
+				uring_rearm_[i] = uring_rearm_[--uring_rearm_count_];
+				break;
+			}
+		}
+	}
+
+	void SystemPort::replenish_uring()
+	{
+		// lend the kernel a fresh pool packet for every one it handed out
+		size_t lent = 0;
+		for(size_t id = 0; id < uring_receive_.size(); ++id) {
+			if(!uring_receive_[id]) {
+				PacketHandle packet(uring_packet_pool_.make());
+				if(!packet || !uring_.provide_buffer(uring_buffer_group, packet->get_data(), static_cast<uint32>(packet->capacity()),
+					static_cast<uint16>(id), static_cast<uint64>(UringOp::Provide) << 32))
+				{
+					continue;
+				}
+				uring_receive_[id] = std::move(packet);
+			}
+			++lent;
+		}
+
+		// receives that stopped start again, unless they'd run out of buffers right away
+		while(lent && uring_rearm_count_) {
+			const uint32 generation = uring_rearm_[uring_rearm_count_ - 1];
+			Socket* socket = find_generation(generation);
+			if(socket && !arm(UringOp::Receive, socket->fd(), generation)) {
+				break;
+			}
+			--uring_rearm_count_;
+		}
+	}
+
+	void SystemPort::wait_uring(int timeout_msecs)
+	{
+		replenish_uring();
+		if(uring_.submit(timeout_msecs) < 0) {
+			PRINT("Linux Port: io_uring_enter failed (%s).\n", std::strerror(errno));
+		}
+
+		ReceiveBatch batch;
+		uring_.for_each_completion([&](const io_uring_cqe& cqe) {
+			uring_completion(cqe, batch);
+		});
+		flush(batch);
+
+		// not before, closing the ring unmaps the completions being walked
+		if(uring_unsupported_) {
+			PRINT("Linux Port: no multishot receive in this kernel, using poll().\n");
+			stop_uring();
+			watch_sockets();
+		}
+	}
+
+	void SystemPort::uring_completion(const io_uring_cqe& cqe, ReceiveBatch& batch)
+	{
+		if(uring_unsupported_) {
+			return;		// falls back once the completions are consumed
+		}
+
+		const auto op = static_cast<UringOp>(cqe.user_data >> 32);
+		const uint32 tag = static_cast<uint32>(cqe.user_data);	// generation, send slot, or 0
+		const bool more = cqe.flags & IORING_CQE_F_MORE;
+
+		switch(op) {
+		case UringOp::Receive:
+			uring_received(cqe, batch);
+			break;
+
+		case UringOp::ErrorQueue:
+			if(cqe.res >= 0) {
+				for(size_t n = 0; n < max_receive_burst; ++n) {
+					Socket* socket = find_generation(tag);
+					if(!socket || !socket->receive_timestamp()) {
+						break;
+					}
+				}
+			}
+			if(!more) {
+				Socket* socket = find_generation(tag);
+				if(socket) {
+					arm(op, socket->fd(), tag);
+				}
+			}
+			break;
+
+		case UringOp::Wakeup:
+			// drain_mailbox() reads the eventfd
+			if(!more) {
+				arm(op, wakeup_fd_, 0);
+			}
+			break;
+
+		case UringOp::Provide:
+			if(cqe.res < 0) {
+				TRACE("Linux Port: providing a receive buffer failed (%s).\n", std::strerror(-cqe.res));
+			}
+			break;
+
+		case UringOp::Send: {
+			auto& send = uring_sends_[tag];
+			if(cqe.res < 0) {
+				TRACE("Linux Port: send failed (%s).\n", std::strerror(-cqe.res));
+				Socket* socket = find_generation(send.socket);
+				if(socket) {
+					socket->send_failed(send.key);
+				}
+			}
+			send.packet = PacketHandle();
+			send.used = false;
+			break;
+		}
+
+		default:
+			break;
+		}
+	}
+
+	void SystemPort::uring_received(const io_uring_cqe& cqe, ReceiveBatch& batch)
+	{
+		const uint32 generation = static_cast<uint32>(cqe.user_data);
+		Socket* socket = find_generation(generation);
+
+		PacketHandle packet;
+		const size_t id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+		if(cqe.res >= 0 && (cqe.flags & IORING_CQE_F_BUFFER) && id < uring_receive_.size()) {
+			packet = std::move(uring_receive_[id]);
+		}
+
+		if(!(cqe.flags & IORING_CQE_F_MORE) && socket) {
+			// out of buffers, or the kernel gave up on it
+			if(cqe.res == -EINVAL) {
+				uring_unsupported_ = true;
+				return;
+			}
+
+			if(uring_rearm_count_ < uring_rearm_.size()) {
+				uring_rearm_[uring_rearm_count_++] = generation;
+			}
+		}
+
+		if(cqe.res < 0 || !packet || !socket) {
+			if(cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+				TRACE("Linux Port: receive failed (%s).\n", std::strerror(-cqe.res));
+			}
+			return;
+		}
+
+		auto* out = static_cast<io_uring_recvmsg_out*>(packet->get_data());
+		auto* name = reinterpret_cast<uint8*>(out + 1);
+
+		msghdr msg;
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_control    = name + uring_name_size;
+		msg.msg_controllen = out->controllen;
+
+		sockaddr_storage source;
+		std::memset(&source, 0, sizeof(source));
+		std::memcpy(&source, name, out->namelen < uring_name_size ? out->namelen : uring_name_size);
+
+		ReceiveSlot slot;
+		slot.source = source;
+
+		Time time;
+		NetAddress source_address;
+		slot.complete(msg, hardware_timestamps(), time, source_address);
+
+		const size_t size = out->payloadlen;
+		packet->set_offset(sizeof(io_uring_recvmsg_out) + uring_name_size + uring_control_size);
+		packet->set_received(size, time, source_address);
+		record_receive_latency(time);
+
+		deliver(batch, socket, std::move(packet));
+	}
+
+	bool SystemPort::uses_uring() const
+	{
+		return static_cast<bool>(uring_);
+	}
+
+	uint32 SystemPort::dropped_sends() const
+	{
+		return uring_dropped_sends_;
+	}
+
+	bool SystemPort::submit_send(Socket& socket, PacketHandle& packet, const sockaddr_storage& address, socklen_t length, uint32 key)
+	{
+		size_t index = 0;
+		while(index < uring_sends_.size() && uring_sends_[index].used) {
+			++index;
+		}
+
+		io_uring_sqe* sqe = index < uring_sends_.size() ? uring_.get_sqe() : nullptr;
+		if(!sqe) {
+			// like a full socket buffer, the message is lost
+			TRACE("Linux Port: io_uring is full, send dropped.\n");
+			++uring_dropped_sends_;
+			return false;
+		}
+
+		// stays put until the completion, so do the packet and the address
+		auto& send = uring_sends_[index];
+		send.packet  = std::move(packet);
+		send.address = address;
+		send.socket  = socket.generation;
+		send.key     = key;
+		send.used    = true;
+
+		send.iov.iov_base = send.packet->get_data();
+		send.iov.iov_len  = send.packet->size();
+
+		std::memset(&send.msg, 0, sizeof(send.msg));
+		send.msg.msg_name    = &send.address;
+		send.msg.msg_namelen = length;
+		send.msg.msg_iov     = &send.iov;
+		send.msg.msg_iovlen  = 1;
+
+		sqe->opcode    = IORING_OP_SENDMSG;
+		sqe->fd        = socket.fd();
+		sqe->addr      = reinterpret_cast<uint64>(&send.msg);
+		sqe->len       = 1;
+		sqe->user_data = (static_cast<uint64>(UringOp::Send) << 32) | index;
+		return true;
+	}
+
+}
+
+#endif
@@ -0,0 +1,342 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_PORTS_LINUX_PORT_HPP__
+#define MICROPTP_PORTS_LINUX_PORT_HPP__
+
+#include <microptp_config.hpp>
+#ifdef MICROPTP_PORT_LINUX
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <microptp/ptpdatatypes.hpp>
+#include <microptp/ptpclock.hpp>
+#include <microptp/ports/linux/port_types.hpp>
+#include <microptp/ports/linux/uring.hpp>
+#include <microptp/uptp.hpp>
+#include <microptp/util/mpsc_queue.hpp>
+#include <microptp/util/spsc_ring.hpp>
+#include <microptp/util/latency_histogram.hpp>
+#include <microlib/pool.hpp>
+#include <microlib/functional.hpp>
+
+namespace uptp {
+
+	//
+	// System port for Linux hosts. Everything runs on the thread calling
+	// run(): a poll() loop over the sockets with the earliest timer as the
+	// timeout. Sockets with an on_received_batch handler are drained with
+	// recvmmsg, one batch per call.
+	//
+	// Timestamps come from the kernel through SO_TIMESTAMPING: receive stamps
+	// as control messages, transmit stamps from the socket error queue, matched
+	// to their send by the SOF_TIMESTAMPING_OPT_ID key. Software stamps work
+	// on any interface including loopback and go with CLOCK_REALTIME. Hardware
+	// stamps switch the NIC to PTP timestamping and the clock to its PHC
+	// (/dev/ptpN); without either, the port falls back to software stamps.
+	// The clock is disciplined through clock_adjtime.
+	//
+	// Other threads hand work to the port thread with post(), it wakes the
+	// poll() through an eventfd.
+	//
+	// With a receive thread, a second thread (optionally pinned to a core and
+	// SCHED_FIFO) does nothing but read datagrams and transmit timestamps off
+	// the sockets into an SPSC ring, and the thread calling run() takes them
+	// from there. Slow work on the protocol side then doesn't hold up
+	// draining the sockets.
+	//
+	// Busy polling has the receive thread try the non-blocking sockets over
+	// and over instead of sleeping in poll(), which takes the wakeup out of
+	// the time between the kernel's receive stamp and the read. While nothing
+	// arrives it spins, then yields, then sleeps in poll() until the next
+	// datagram, and it spins for no more than its CPU budget of every 100 ms.
+	// The port records that latency with software timestamps in either mode,
+	// see receive_latency().
+	//
+	// The io_uring backend replaces poll() and the reads and sends of the port
+	// thread: multishot receives into pool packets lent to the kernel as
+	// provided buffers, which go to the sockets without a copy, and sends collected as
+	// submissions for one io_uring_enter per loop round. Transmit timestamps
+	// are still read from the error queue once a multishot poll reports them.
+	// Kernels before 6.0 don't have all of it, the port falls back to poll()
+	// then. It doesn't go with the receive thread.
+	//
+	// Instead of run(), the application's own epoll or asio loop can drive
+	// the port: attach() hands out an epoll fd that turns readable whenever
+	// process_ready() has something to do, and process_timers() is due at
+	// next_deadline(). The thread doing so is the port thread then, and no
+	// other is needed unless it asks for a receive thread.
+	//
+	class SystemPort
+	{
+	public:
+		enum class Timestamping {
+			Software,
+			Hardware
+		};
+
+		enum class Backend {
+			Poll,
+			Uring
+		};
+
+		struct ReceiveOptions {
+			bool thread = false;	// read the sockets on a thread of their own
+			int cpu = -1;			// pin the receive thread to this core, -1: don't
+			int priority = 0;		// SCHED_FIFO priority of the receive thread, 0: default policy
+
+			bool busy_poll = false;			// spin on the sockets, implies the receive thread
+			int spin_usecs = 200;			// idle time spent spinning, then yielding between tries
+			int yield_usecs = 2000;			// idle time spent yielding, then sleeping in poll(), -1: never sleep
+			int cpu_budget_percent = 100;	// share of every 100 ms the receive thread may spin
+			int so_busy_poll_usecs = 0;		// SO_BUSY_POLL on the sockets, 0: leave it to the system
+
+			Backend backend = Backend::Poll;	// I/O of the port thread, sends included
+		};
+
+		SystemPort(const Config& cfg, const char* interface_name, Timestamping timestamping = Timestamping::Software);
+		SystemPort(const Config& cfg, const char* interface_name, Timestamping timestamping, const ReceiveOptions& receive);
+		~SystemPort();
+
+		// Looks up the interface and hands its addresses to the clock,
+		// which opens its sockets. False if the interface isn't usable.
+		bool start();
+
+		void enable();
+		void disable();
+
+		// Dispatches socket and timer events until stop() is called,
+		// starts and joins the receive thread if there is one
+		void run();
+		void stop();
+
+		// The application's loop instead of run(): waits for fd() to turn readable
+		// to call process_ready(), and until next_deadline() to call process_timers().
+		// attach() returns fd(), -1 if it can't be set up. On io_uring, sends from
+		// outside the port's callbacks go to the kernel with the next process call.
+		int attach();
+		void detach();
+		int fd() const;
+		int64 next_deadline() const;	// CLOCK_MONOTONIC nanoseconds, -1 while nothing is due
+		void process_ready();			// reads the sockets and runs posted work
+		void process_timers();			// runs due timers and transmit completions
+
+		using Mailbox = MpscQueue<ulib::function<void()>, Config::port_mailbox_depth>;
+
+		// Any thread: runs [func] on the port thread. False if the mailbox is full.
+		bool post(ulib::function<void()> func);
+		Mailbox::Stats mailbox_stats() const;
+
+		// Sends lost to a full io_uring
+		uint32 dropped_sends() const;
+
+		// Time from the kernel's receive stamp to the read, software timestamps only
+		LatencyHistogram& receive_latency();
+		void report_receive_latency() const;
+
+		PtpClock& clock();
+
+		// Port interface
+	public:
+		using packet_handle_type = PacketHandle;
+
+		TimerHandle make_timer();
+		TimerHandle make_timer(ulib::function<void()> func);
+
+		NetHandle make_udp(NetAddress::Family family, uint16 port);
+		NetHandle make_ethernet();
+
+		void join_multicast(const NetAddress& group);
+		void join_multicast(const std::array<uint8, 6>& multicast_mac);
+		void leave_multicast();
+
+		Time get_time();
+		void set_time(Time absolute);
+		void adjust_time(Time delta);
+		void discipline(int32 ppb);
+
+		// Used by Socket and Timer
+	public:
+		PacketHandle acquire_packet();
+		int interface_index() const;
+		bool hardware_timestamps() const;
+		void transmitted(Socket& socket, uint32 id, Time time);
+		void record_receive_latency(Time stamp);
+
+		// With io_uring every send goes through it, a direct one would overtake the
+		// queued ones and take their OPT_ID keys. submit_send() queues the send and
+		// keeps [packet], false if it is dropped since the queue is full.
+		bool uses_uring() const;
+		bool submit_send(Socket& socket, PacketHandle& packet, const sockaddr_storage& address, socklen_t length, uint32 key);
+
+		void link(Socket* socket);
+		void unlink(Socket* socket);
+		void link(Timer* timer);
+		void unlink(Timer* timer);
+
+		static int64 monotonic_nanos();
+
+	private:
+		static const size_t max_sockets = 4;
+		static const size_t max_completions = 16;
+		static const size_t max_receive_burst = 64;	// datagrams per socket and wakeup, so timers aren't held up
+		static const size_t receive_ring_depth = 64;
+
+		// What the receive thread read, in place in the ring
+		struct Received {
+			enum class Kind : uint8 {
+				Datagram,
+				TransmitStamp
+			};
+
+			Kind kind;
+			uint32 socket;		// generation of the socket it came in on
+			uint32 key;			// SOF_TIMESTAMPING_OPT_ID key of a transmit stamp
+			size_t size;
+			Time time;
+			NetAddress source_address;
+			std::array<uint8, PacketBuffer::max_size> data;
+		};
+
+		struct Completion {
+			Socket* socket;
+			uint32 id;
+			Time time;
+		};
+
+		// consecutive datagrams of a socket with on_received_batch, delivered together
+		struct ReceiveBatch {
+			std::array<PacketHandle, Socket::max_batch> packets;
+			size_t count = 0;
+			Socket* socket = nullptr;
+		};
+
+		// io_uring: receive buffers lent to the kernel and sends in flight
+		static const size_t uring_entries = 64;
+		static const size_t uring_buffers = 16;
+		static const uint16 uring_buffer_group = 0;
+		static const size_t uring_name_size = 32;		// sockaddr_in6 and sockaddr_ll, keeps the control messages aligned
+		static const size_t uring_control_size = 64;	// CMSG_SPACE(sizeof(scm_timestamping))
+
+		enum class UringOp : uint8 {
+			Wakeup,
+			Receive,
+			ErrorQueue,
+			Send,
+			Cancel,
+			Provide
+		};
+
+		struct UringSend {
+			PacketHandle packet;
+			msghdr msg;
+			iovec iov;
+			sockaddr_storage address;
+			uint32 socket;		// generation
+			uint32 key;
+			bool used;
+		};
+
+		bool enable_hardware_timestamps(int fd, const char* name);
+		bool enable_timestamping(int fd);
+		void enable_busy_poll(int fd);
+		Socket* find_socket(int fd) const;
+		Socket* find_generation(uint32 generation) const;
+
+		void start_io();
+		void stop_io();
+		void watch(int fd, bool add);
+		void watch_sockets();
+
+		int next_timeout() const;
+		void run_timers();
+		void deliver_completions();
+		void drain_mailbox();
+		void poll_sockets(int timeout_msecs);
+
+		void receive_thread();
+		void configure_receive_thread();
+		using ReceiveFds = std::array<pollfd, max_sockets + 1>;
+		using ReceiveGenerations = std::array<uint32, max_sockets>;
+		size_t wait_and_read(ReceiveFds& fds, const ReceiveGenerations& generations, size_t count, int timeout_msecs);
+		size_t try_read(const ReceiveFds& fds, const ReceiveGenerations& generations, size_t count);
+		size_t read_datagrams(int fd, uint32 generation);
+		size_t read_transmit_stamps(int fd, uint32 generation);
+		void drain_receive_ring();
+		void sockets_changed();
+
+		void deliver(ReceiveBatch& batch, Socket* socket, PacketHandle packet);
+		void flush(ReceiveBatch& batch);
+
+		bool start_uring();
+		void stop_uring();
+		bool arm(UringOp op, int fd, uint32 generation);
+		void disarm(const Socket& socket);
+		void replenish_uring();
+		void wait_uring(int timeout_msecs);
+		void uring_completion(const io_uring_cqe& cqe, ReceiveBatch& batch);
+		void uring_received(const io_uring_cqe& cqe, ReceiveBatch& batch);
+		bool is_linked(const Socket* socket) const;
+
+		std::array<char, 16> interface_name_;	// IFNAMSIZ
+		int interface_index_;
+		uint32 interface_address_;
+		Timestamping timestamping_;
+		int clock_fd_;				// PHC device with hardware timestamps, -1 otherwise
+		clockid_t clock_id_;
+		bool running_;
+		int wakeup_fd_;				// eventfd, signalled by post()
+		int loop_fd_;				// epoll fd of attach(), -1 with run()
+
+		Socket* sockets_;
+		Timer* timers_;
+
+		std::array<Completion, max_completions> completions_;
+		size_t num_completions_;
+
+		Mailbox mailbox_;
+
+		// receive thread, its socket list is rebuilt under receive_mutex_ once flagged.
+		// unlink() waits until it has taken the version without the socket.
+		ReceiveOptions receive_;
+		std::thread receive_thread_;
+		std::atomic<bool> receiving_;
+		std::atomic<bool> receive_sockets_changed_;
+		std::mutex receive_mutex_;
+		std::condition_variable receive_sockets_taken_;
+		uint64 receive_sockets_version_;
+		uint64 receive_sockets_seen_;
+		uint32 next_generation_;
+		int receive_wakeup_fd_;		// eventfd, signalled on socket changes and shutdown
+		SpscRing<Received, receive_ring_depth> receive_ring_;
+		LatencyHistogram receive_latency_;
+
+		Uring uring_;
+		msghdr uring_layout_;		// name and control sizes of the multishot receives
+		std::array<PacketHandle, uring_buffers> uring_receive_;	// by buffer id, empty while the kernel has none there
+		std::array<UringSend, 2 * Socket::max_batch> uring_sends_;	// a full Delay_Resp batch and the event messages
+		std::array<uint32, max_sockets> uring_rearm_;			// generations of receives to start again once there are buffers
+		size_t uring_rearm_count_;
+		bool uring_unsupported_;		// set by a completion, acted on once they're all consumed
+		uint32 uring_dropped_sends_;
+		ulib::pool<PacketBuffer, uring_buffers * 2> uring_packet_pool_;
+
+		ulib::pool<PacketBuffer, 64> packet_pool_;	// receive bursts and sends in flight
+		ulib::pool<Socket, max_sockets> socket_pool_;
+		ulib::pool<Timer, 24> timer_pool_;	// watchdogs per foreign master, the state, servo and negotiation timers
+
+		PtpClock clock_;
+	};
+
+}
+
+#endif
+#endif
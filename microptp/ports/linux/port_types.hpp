@@ -0,0 +1,202 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_PORTS_LINUX_PORT_TYPES_HPP__
+#define MICROPTP_PORTS_LINUX_PORT_TYPES_HPP__
+
+#include <microptp_config.hpp>
+#ifdef MICROPTP_PORT_LINUX
+
+#include <array>
+#include <sys/socket.h>
+#include <microlib/pool.hpp>
+#include <microlib/functional.hpp>
+#include <microptp/ptpdatatypes.hpp>
+#include <microptp/net_address.hpp>
+
+namespace uptp {
+
+	class SystemPort;
+
+	// Storage behind a PacketHandle, from the system port's packet pool. The
+	// payload starts at offset, io_uring receives put their headers in front.
+	struct PacketBuffer {
+		static const size_t max_size = 1500;
+
+		PacketBuffer();
+
+		alignas(8) std::array<uint8, max_size> data;
+		size_t offset;
+		size_t size;
+		Time time;
+		NetAddress source_address;
+	};
+
+	class PacketHandle {
+	public:
+		PacketHandle();
+		PacketHandle(PacketHandle&&);
+		PacketHandle& operator=(PacketHandle&&);
+
+		PacketHandle(const PacketHandle&) = delete;
+		PacketHandle& operator=(const PacketHandle&) = delete;
+
+		~PacketHandle();
+
+	public:
+		// Handle Simulation
+		PacketHandle* operator->();
+		const PacketHandle* operator->() const;
+
+		PacketHandle& operator*();
+		const PacketHandle& operator*() const;
+
+		explicit operator bool() const;
+
+	public:
+		// [PacketRep]
+		void* get_data();
+		const void* get_data() const;
+
+		size_t capacity() const;
+		void set_size(size_t size);
+		size_t size() const;
+
+		Time time() const;
+		NetAddress source_address() const;
+
+		// Used by System Port only
+	public:
+		PacketHandle(ulib::pool_ptr<PacketBuffer> buffer);
+		void set_received(size_t size, Time time, const NetAddress& source_address);
+		void set_offset(size_t offset);
+
+	private:
+		ulib::pool_ptr<PacketBuffer> buffer_;
+	};
+
+	//
+	// [NetRep] on a non-blocking socket: UDP over IPv4 or IPv6 bound to a PTP
+	// port number, or a packet socket for ethertype 0x88F7 on the system port's interface.
+	//
+	class Socket {
+	public:
+		enum class Kind {
+			Udp,
+			Ethernet
+		};
+
+		Socket(SystemPort* sysport, Kind kind, NetAddress::Family family, int fd);
+		~Socket();
+
+		Socket(const Socket&) = delete;
+		Socket& operator=(const Socket&) = delete;
+
+	public:
+		// [NetRep]
+		void send( const NetAddress& to, uint16 port, PacketHandle handle, uint32 id );
+		void send_batch( const NetAddress* to, uint16 port, PacketHandle* handles, size_t count, uint32 id );
+
+		ulib::function<void(uint32 id, Time timestamp)> on_transmit_completed;
+		ulib::function<void(PacketHandle)> on_received;
+		ulib::function<void(PacketHandle*, size_t)> on_received_batch;
+
+		PacketHandle acquire_transmit_handle();
+
+		explicit operator bool() const;
+
+		// Used by System Port only
+	public:
+		int fd() const;
+		Kind kind() const;
+		NetAddress::Family family() const;
+
+		// Reads one datagram and hands it to on_received,
+		// false once the socket would block
+		bool receive();
+
+		// Reads up to max_batch datagrams with one recvmmsg and hands them
+		// to on_received_batch, false once the socket would block
+		static const size_t max_batch = 16;
+		bool receive_batch();
+
+		// Reads one transmit timestamp from the error queue and reports it
+		// with the id of its send, false once the queue is empty
+		bool receive_timestamp();
+
+		// Reports the send with the SOF_TIMESTAMPING_OPT_ID [key] as transmitted
+		void transmit_stamped(uint32 key, Time time);
+
+		// An asynchronous send with [key] failed, the kernel didn't count it
+		void send_failed(uint32 key);
+
+		Socket* next;
+		uint32 generation;		// unique per link(), fds are reused once closed
+
+	private:
+		// false if [to] can't be reached from this socket
+		bool make_address( const NetAddress& to, uint16 port, sockaddr_storage& addr, socklen_t& length ) const;
+
+		// Takes the OPT_ID key of a send the kernel accepted
+		void sent(uint32 id);
+
+		SystemPort* sysport_;
+		Kind kind_;
+		NetAddress::Family family_;
+		int fd_;
+
+		// sends waiting for their timestamp, by SOF_TIMESTAMPING_OPT_ID key
+		struct PendingTransmit {
+			uint32 key;
+			uint32 id;
+			bool used;
+		};
+
+		uint32 next_key_;
+		std::array<PendingTransmit, 16> pending_;
+	};
+
+	using NetHandle = ulib::pool_ptr<Socket>;
+
+	//
+	// [TimerRep], one-shot with millisecond resolution on CLOCK_MONOTONIC,
+	// run from the system port's loop
+	//
+	class Timer {
+	public:
+		Timer(SystemPort* sysport);
+		Timer(SystemPort* sysport, ulib::function<void()> func);
+		~Timer();
+
+		Timer(const Timer&) = delete;
+		Timer& operator=(const Timer&) = delete;
+
+	public:
+		// [TimerRep]
+		void start(uint32 msecs);
+		void reset(uint32 msecs);
+		void advance(uint32 msecs);
+		void stop();
+
+		ulib::function<void()> callback;
+
+		// Used by System Port only
+	public:
+		bool armed;
+		int64 deadline;		// monotonic nanoseconds
+		Timer* next;
+
+	private:
+		SystemPort* sysport_;
+	};
+
+	using TimerHandle = ulib::pool_ptr<Timer>;
+
+	using ip_address = uint32;
+
+}
+
+#endif
+#endif
@@ -0,0 +1,212 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "microptp_config.hpp"
+#ifdef MICROPTP_PORT_LINUX
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <microptp/ports/linux/uring.hpp>
+
+namespace uptp {
+
+	namespace {
+
+		int uring_setup(unsigned entries, io_uring_params* params)
+		{
+			return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+		}
+
+		int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, const void* arg, size_t arg_size)
+		{
+			return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size));
+		}
+
+		template< typename T >
+		T* at(void* base, size_t offset)
+		{
+			return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+		}
+
+	}
+
+	Uring::Uring()
+		: fd_(-1),
+		  sq_ring_(MAP_FAILED), sq_ring_size_(0), cq_ring_(MAP_FAILED), cq_ring_size_(0), sqes_(nullptr), sqes_size_(0),
+		  sq_head_(nullptr), sq_tail_(nullptr), sq_mask_(0), sq_entries_(0), sqe_tail_(0),
+		  cq_head_(nullptr), cq_tail_(nullptr), cq_mask_(0), cqes_(nullptr)
+	{
+	}
+
+	Uring::~Uring()
+	{
+		close();
+	}
+
+	bool Uring::open(unsigned entries)
+	{
+		close();
+
+		io_uring_params params;
+		std::memset(&params, 0, sizeof(params));
+		fd_ = uring_setup(entries, &params);
+		if(fd_ < 0) {
+			return false;
+		}
+
+		// the timeout of submit() goes in IORING_ENTER_EXT_ARG (5.11)
+		if(!(params.features & IORING_FEAT_EXT_ARG)) {
+			close();
+			errno = ENOSYS;
+			return false;
+		}
+
+		sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		sqes_size_    = params.sq_entries * sizeof(io_uring_sqe);
+
+		sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+		cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+		void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+		if(sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes == MAP_FAILED) {
+			if(sqes != MAP_FAILED) {
+				munmap(sqes, sqes_size_);
+			}
+			close();
+			return false;
+		}
+		sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+		sq_head_    = at<unsigned>(sq_ring_, params.sq_off.head);
+		sq_tail_    = at<unsigned>(sq_ring_, params.sq_off.tail);
+		sq_mask_    = *at<unsigned>(sq_ring_, params.sq_off.ring_mask);
+		sq_entries_ = *at<unsigned>(sq_ring_, params.sq_off.ring_entries);
+		sqe_tail_   = *sq_tail_;
+
+		// entry i of the queue is always sqes_[i]
+		unsigned* array = at<unsigned>(sq_ring_, params.sq_off.array);
+		for(unsigned i = 0; i < sq_entries_; ++i) {
+			array[i] = i;
+		}
+
+		cq_head_ = at<unsigned>(cq_ring_, params.cq_off.head);
+		cq_tail_ = at<unsigned>(cq_ring_, params.cq_off.tail);
+		cq_mask_ = *at<unsigned>(cq_ring_, params.cq_off.ring_mask);
+		cqes_    = at<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+
+		return true;
+	}
+
+	void Uring::close()
+	{
+		// closing the ring cancels whatever is still in flight
+		if(fd_ >= 0) {
+			::close(fd_);
+			fd_ = -1;
+		}
+		unmap();
+	}
+
+	void Uring::unmap()
+	{
+		if(sqes_) {
+			munmap(sqes_, sqes_size_);
+			sqes_ = nullptr;
+		}
+		if(cq_ring_ != MAP_FAILED) {
+			munmap(cq_ring_, cq_ring_size_);
+			cq_ring_ = MAP_FAILED;
+		}
+		if(sq_ring_ != MAP_FAILED) {
+			munmap(sq_ring_, sq_ring_size_);
+			sq_ring_ = MAP_FAILED;
+		}
+	}
+
+	Uring::operator bool() const
+	{
+		return fd_ >= 0;
+	}
+
+	int Uring::fd() const
+	{
+		return fd_;
+	}
+
+	io_uring_sqe* Uring::get_sqe()
+	{
+		if(sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+			submit();
+			if(sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+				return nullptr;
+			}
+		}
+
+		io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+		std::memset(sqe, 0, sizeof(*sqe));
+		++sqe_tail_;
+		return sqe;
+	}
+
+	int Uring::submit(int timeout_msecs)
+	{
+		const unsigned to_submit = sqe_tail_ - *sq_tail_;
+		__atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+
+		const bool wait = timeout_msecs != 0 && !has_completions();
+		if(!to_submit && !wait) {
+			return 0;
+		}
+
+		__kernel_timespec ts;
+		ts.tv_sec  = timeout_msecs / 1000;
+		ts.tv_nsec = (timeout_msecs % 1000) * 1000000ll;
+
+		io_uring_getevents_arg arg;
+		std::memset(&arg, 0, sizeof(arg));
+		arg.sigmask_sz = _NSIG / 8;
+		arg.ts = timeout_msecs > 0 ? reinterpret_cast<uint64>(&ts) : 0;
+
+		unsigned flags = IORING_ENTER_EXT_ARG;
+		if(wait) {
+			flags |= IORING_ENTER_GETEVENTS;
+		}
+
+		const int result = uring_enter(fd_, to_submit, wait ? 1 : 0, flags, &arg, sizeof(arg));
+		if(result < 0 && (errno == ETIME || errno == EINTR)) {
+			return 0;
+		}
+		return result;
+	}
+
+	bool Uring::has_completions() const
+	{
+		return *cq_head_ != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+	}
+
+	bool Uring::provide_buffer(uint16 group, void* data, uint32 size, uint16 id, uint64 user_data)
+	{
+		io_uring_sqe* sqe = get_sqe();
+		if(!sqe) {
+			return false;
+		}
+
+		sqe->opcode    = IORING_OP_PROVIDE_BUFFERS;
+		sqe->fd        = 1;		// number of buffers
+		sqe->addr      = reinterpret_cast<uint64>(data);
+		sqe->len       = size;
+		sqe->off       = id;
+		sqe->buf_group = group;
+		sqe->user_data = user_data;
+		return true;
+	}
+
+}
+
+#endif
@@ -0,0 +1,97 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_PORTS_LINUX_URING_HPP__
+#define MICROPTP_PORTS_LINUX_URING_HPP__
+
+#include <microptp_config.hpp>
+#ifdef MICROPTP_PORT_LINUX
+
+#include <cstddef>
+#include <linux/io_uring.h>
+#include <microptp/types.hpp>
+
+namespace uptp {
+
+	//
+	// The little of io_uring the system port needs, straight on the kernel
+	// interface: one submission and one completion queue, and provided
+	// buffers that multishot receives pick their buffer from. Submissions
+	// are collected and go to the kernel with the next submit().
+	// Not thread-safe, it belongs to the port thread.
+	//
+	class Uring {
+	public:
+		Uring();
+		~Uring();
+
+		Uring(const Uring&) = delete;
+		Uring& operator=(const Uring&) = delete;
+
+		// False if the kernel has no io_uring, or it is not permitted
+		bool open(unsigned entries);
+		void close();
+
+		explicit operator bool() const;
+		int fd() const;
+
+		// A zeroed entry to fill, nullptr if the queue is full even after submitting
+		io_uring_sqe* get_sqe();
+
+		// Hands the collected entries to the kernel and waits up to [timeout_msecs]
+		// for a completion, -1 waits until there is one, 0 doesn't wait
+		int submit(int timeout_msecs = 0);
+
+		// Calls [func] with every completion there is and consumes them
+		template< typename Func >
+		size_t for_each_completion(Func&& func)
+		{
+			unsigned head = *cq_head_;
+			const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+			size_t count = 0;
+			for(; head != tail; ++head, ++count) {
+				// copied, the callback may submit and complete more
+				const io_uring_cqe cqe = cqes_[head & cq_mask_];
+				__atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+				func(cqe);
+			}
+			return count;
+		}
+
+		bool has_completions() const;
+
+		// Queues buffer [id] for group [group], completing with [user_data].
+		// IORING_OP_PROVIDE_BUFFERS (5.7) rather than a registered buffer ring,
+		// which takes an entry per buffer but works wherever multishot does.
+		bool provide_buffer(uint16 group, void* data, uint32 size, uint16 id, uint64 user_data);
+
+	private:
+		void unmap();
+
+		int fd_;
+
+		void* sq_ring_;
+		size_t sq_ring_size_;
+		void* cq_ring_;
+		size_t cq_ring_size_;
+		io_uring_sqe* sqes_;
+		size_t sqes_size_;
+
+		unsigned* sq_head_;
+		unsigned* sq_tail_;
+		unsigned sq_mask_;
+		unsigned sq_entries_;
+		unsigned sqe_tail_;		// entries handed out, ahead of *sq_tail_ until submit()
+
+		unsigned* cq_head_;
+		unsigned* cq_tail_;
+		unsigned cq_mask_;
+		io_uring_cqe* cqes_;
+	};
+
+}
+
+#endif
+#endif
@@ -11,6 +11,10 @@
 #include <microptp/ports/cortex_m4_onethread/port.hpp>
 #endif
 
+#ifdef MICROPTP_PORT_LINUX
+#include <microptp/ports/linux/port.hpp>
+#endif
+
 #include <microptp/ports/systemportapi.hpp>
 #include <microptp/ports/systemport_defaults.hpp>
 
@@ -41,22 +45,42 @@
 			
 		// Called by the system port once a packet has been transmitted, arguments are
 		// the packet id provided by the ptp clock instance during the send command
-		// and the timestamp of the transmission.
+		// and the timestamp of the transmission. Called from the port's own thread,
+		// in any order across ids.
 		ulib::function<void(uint32 id, Time timestamp)> on_transmit_completed;
 
 		// Called by the system port when a packet has been received on the
 		// udp port represented by this NetHandle.
 		ulib::function<void(PacketHandle)> on_received;
 
+		// Optional, for ports that read several packets per wakeup: called
+		// with all of them instead of on_received per packet, if set. The
+		// receiver moves the packets out of the array.
+		ulib::function<void(PacketHandle* packets, size_t count)> on_received_batch;
+
 		// Indicating if this NetHandle is initialized and functional
 		explicit operator bool()
 
 		// Acquire a packet handle for sending
 		PacketHandle acquire_transmit_handle();
 
-		// Transmit a data packet [handle] to [ip]:[port]
-		// the id is used in the subsequent on_transmit_completed callback
-		void send( uint32 ip, uint16 port, PacketHandle handle, uint32 id );
+		// Transmit a data packet [handle] to [to]:[port]
+		// the id is used in the subsequent on_transmit_completed callback.
+		// Asynchronous: send must neither block on the network stack nor call
+		// back from within. It takes the buffer, the port releases it once the
+		// packet is out and then reports the transmit timestamp with [id].
+		// Several sends may be in flight, a port that can't take another one
+		// drops it like the network would.
+		// UDP NetReps only get addresses of the family they were made for.
+		// Ethernet NetReps send to the MAC group of [to], which is
+		// ptp_multicast_group or ptp_peer_multicast_group, and ignore [port].
+		void send( const NetAddress& to, uint16 port, PacketHandle handle, uint32 id );
+
+		// Optional, for ports that can hand several packets to the network at
+		// once: as send for each of the [count] packets, [handles][i] to [to][i],
+		// all with the same [id]. The port moves the packets out of the array.
+		// Without it, system::send_batch falls back to one send per packet.
+		void send_batch( const NetAddress* to, uint16 port, PacketHandle* handles, size_t count, uint32 id );
 
 	- [PacketRep]
 
@@ -76,10 +100,18 @@
 		// [NetHandle]::acquire_transmit_handle
 		void set_size(size_t size);
 
+		// return the number of valid bytes in the data buffer,
+		// for received packets the size of the udp payload
+		size_t size() const;
+
 		// Return the timestamp of receival for packets
 		// pushed by [NetRep]::on_received
 		Time time() const;
 
+		// Return the address the packet pushed by [NetRep]::on_received
+		// was sent from, empty if the port can't tell
+		NetAddress source_address() const;
+
 	- [TimerRep]
 
 		// start the timer with [msecs] milliseconds timeout
@@ -88,6 +120,11 @@
 		// reset the timer with [msecs] milliseconds timout
 		void reset(uint32 msecs);
 
+		// restart the timer [msecs] milliseconds after its previous deadline
+		// rather than after now, so periodic timers don't drift by the latency
+		// of their callbacks; if that deadline has long passed, after now
+		void advance(uint32 msecs);
+
 		// stop the timer
 		void stop();
 
@@ -103,12 +140,21 @@
 		// and return a TimerHandle to it
 		TimerHandle make_timer(ulib::function<void()> func);
 
-		// Create a [NetRep] bound to port [port] and return
-		// a NetHandle to it
-		NetHandle make_udp(uint16 port);
+		// Create a [NetRep] of the given address family bound to port [port]
+		// and return a NetHandle to it. Ports without the family return an
+		// empty handle.
+		NetHandle make_udp(NetAddress::Family family, uint16 port);
 
-		// Called to join a given multicast network on the network interface
-		void join_multicast(uint32 multicast_addr);
+		// Create a [NetRep] for PTP over Ethernet (ethertype 0x88F7), carrying
+		// event and general messages alike. Ports without raw Ethernet access
+		// return an empty handle.
+		NetHandle make_ethernet();
+
+		// Called to join a given IPv4 or IPv6 multicast group on the network interface
+		void join_multicast(const NetAddress& group);
+
+		// Called to join a given Ethernet multicast group on the network interface
+		void join_multicast(const std::array<uint8, 6>& multicast_mac);
 
 		// Called to leave the multicast network
 		void leave_multicast();
@@ -125,4 +171,20 @@
 		// Discipline the clock in parts per billion
 		void discipline(int32 ppb);
 
+	- Driving the PtpClock
+
+		// Ordinary clock (Config::num_ports == 1): the system port opens the
+		// sockets through make_udp/join_multicast when calling
+		PtpClock::on_network_changed(ip_address, macaddr);
+
+		// Boundary clock: one event/general NetHandle pair per interface,
+		// ports are numbered from 0 to Config::num_ports - 1
+		PtpClock::set_identity(macaddr);
+		PtpClock::port(i).attach(event_handle, general_handle);
+
+		// Several domains (Config::num_domains > 1): the same calls on a
+		// MultiDomainClock, which shares the sockets between the domains.
+		// get_time/set_time/adjust_time/discipline then only see the free
+		// running timebase, domain time is kept by the VirtualClocks.
+
 */
\ No newline at end of file
@@ -1,16 +1,81 @@
 #ifndef MICROPTP_PORTS_SYSTEMPORT_DEFAULTS_HPP__
 #define MICROPTP_PORTS_SYSTEMPORT_DEFAULTS_HPP__
 
+#include <cstring>
+#include <utility>
 #include <microptp/types.hpp>
+#include <microptp/net_address.hpp>
 #include <microptp/ports/systemportapi.hpp>
 
+#ifndef UPTP_HOST_BIG_ENDIAN
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define UPTP_HOST_BIG_ENDIAN 1
+#else
+#define UPTP_HOST_BIG_ENDIAN 0
+#endif
+#endif
+
 namespace uptp {
 
 	namespace system {
 
 		// If you replace the standard implementations with system
-		// specific ops, define UPTP_NO_DEFAULT_BYTEORDER
+		// specific ops, define UPTP_NO_DEFAULT_BYTEORDER and provide
+		// the to_host_byteorder / to_net_byteorder overloads below,
+		// preferably inline from your port_types.hpp.
+
+#ifndef UPTP_NO_DEFAULT_BYTEORDER
+		namespace detail {
+
+#if defined(__GNUC__) || defined(__clang__)
+			constexpr uint16 byteswap(uint16 val) { return __builtin_bswap16(val); }
+			constexpr uint32 byteswap(uint32 val) { return __builtin_bswap32(val); }
+			constexpr uint64 byteswap(uint64 val) { return __builtin_bswap64(val); }
+#else
+			constexpr uint16 byteswap(uint16 val)
+			{
+				return static_cast<uint16>((val >> 8) | (val << 8));
+			}
+
+			constexpr uint32 byteswap(uint32 val)
+			{
+				return (static_cast<uint32>(byteswap(static_cast<uint16>(val))) << 16) | byteswap(static_cast<uint16>(val >> 16));
+			}
+
+			constexpr uint64 byteswap(uint64 val)
+			{
+				return (static_cast<uint64>(byteswap(static_cast<uint32>(val))) << 32) | byteswap(static_cast<uint32>(val >> 32));
+			}
+#endif
+
+			template< typename T >
+			constexpr T to_big_endian(T val)
+			{
+				return UPTP_HOST_BIG_ENDIAN ? val : byteswap(val);
+			}
+
+		}
+
+		constexpr uint8  to_host_byteorder(uint8 val)  { return val; }
+		constexpr uint16 to_host_byteorder(uint16 val) { return detail::to_big_endian(val); }
+		constexpr uint32 to_host_byteorder(uint32 val) { return detail::to_big_endian(val); }
+		constexpr uint64 to_host_byteorder(uint64 val) { return detail::to_big_endian(val); }
+
+		constexpr int8  to_host_byteorder(int8 val)  { return val; }
+		constexpr int16 to_host_byteorder(int16 val) { return static_cast<int16>(detail::to_big_endian(static_cast<uint16>(val))); }
+		constexpr int32 to_host_byteorder(int32 val) { return static_cast<int32>(detail::to_big_endian(static_cast<uint32>(val))); }
+		constexpr int64 to_host_byteorder(int64 val) { return static_cast<int64>(detail::to_big_endian(static_cast<uint64>(val))); }
 
+		constexpr uint8  to_net_byteorder(uint8 val)  { return to_host_byteorder(val); }
+		constexpr uint16 to_net_byteorder(uint16 val) { return to_host_byteorder(val); }
+		constexpr uint32 to_net_byteorder(uint32 val) { return to_host_byteorder(val); }
+		constexpr uint64 to_net_byteorder(uint64 val) { return to_host_byteorder(val); }
+
+		constexpr int8  to_net_byteorder(int8 val)  { return to_host_byteorder(val); }
+		constexpr int16 to_net_byteorder(int16 val) { return to_host_byteorder(val); }
+		constexpr int32 to_net_byteorder(int32 val) { return to_host_byteorder(val); }
+		constexpr int64 to_net_byteorder(int64 val) { return to_host_byteorder(val); }
+#else
 		uint8 to_host_byteorder(uint8);
 		uint16 to_host_byteorder(uint16);
 		uint32 to_host_byteorder(uint32);
@@ -30,6 +95,63 @@ namespace uptp {
 		int16 to_net_byteorder(int16);
 		int32 to_net_byteorder(int32);
 		int64 to_net_byteorder(int64);
+#endif
+
+		// Unaligned access to packet buffers. The fixed size memcpy is turned
+		// into a single load/store by the compiler on targets that allow
+		// unaligned access (Cortex-M3/M4, x86) and into byte accesses elsewhere.
+		template< typename T >
+		inline T load_unaligned(const void* ptr)
+		{
+			T result;
+			std::memcpy(&result, ptr, sizeof(T));
+			return result;
+		}
+
+		template< typename T >
+		inline void store_unaligned(void* ptr, T value)
+		{
+			std::memcpy(ptr, &value, sizeof(T));
+		}
+
+		// network byte order load/store at arbitrary addresses
+		template< typename T >
+		inline T load_net(const void* ptr)
+		{
+			return to_host_byteorder(load_unaligned<T>(ptr));
+		}
+
+		template< typename T >
+		inline void store_net(void* ptr, T value)
+		{
+			store_unaligned<T>(ptr, to_net_byteorder(value));
+		}
+
+		// [NetRep]::send_batch where the port has it, one send per packet otherwise
+		namespace detail {
+
+			template< typename Net, typename Handle >
+			inline auto send_batch(Net& net, const NetAddress* to, uint16 port, Handle* handles, size_t count, uint32 id, int)
+				-> decltype(net.send_batch(to, port, handles, count, id))
+			{
+				return net.send_batch(to, port, handles, count, id);
+			}
+
+			template< typename Net, typename Handle >
+			inline void send_batch(Net& net, const NetAddress* to, uint16 port, Handle* handles, size_t count, uint32 id, long)
+			{
+				for(size_t i = 0; i < count; ++i) {
+					net.send(to[i], port, std::move(handles[i]), id);
+				}
+			}
+
+		}
+
+		template< typename Net, typename Handle >
+		inline void send_batch(Net& net, const NetAddress* to, uint16 port, Handle* handles, size_t count, uint32 id)
+		{
+			detail::send_batch(net, to, port, handles, count, id, 0);
+		}
 
 	}
 
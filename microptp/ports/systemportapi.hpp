@@ -17,6 +17,10 @@
 #include <microptp/ports/cortex_m4_onethread/port_types.hpp>
 #endif
 
+#ifdef MICROPTP_PORT_LINUX
+#include <microptp/ports/linux/port_types.hpp>
+#endif
+
 #endif
 
 
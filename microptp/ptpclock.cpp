@@ -10,9 +10,16 @@
 namespace uptp {
 
 	PtpClock::PtpClock(SystemPort& system_port, const Config& config)
-		: system_port_(system_port), config_(config), master_tracker_(config)
+		: PtpClock(system_port, config, std::make_index_sequence<num_ports>())
+	{
+	}
+
+	template< size_t... Indices >
+	PtpClock::PtpClock(SystemPort& system_port, const Config& config, std::index_sequence<Indices...>)
+		: system_port_(system_port), config_(config), locked_(false), domain_clock_(system_port), servo_(*this),
+		  deciding_(false), decide_again_(false), has_parent_(false),
+		  ports_{{ { *this, static_cast<uint16>(Indices + 1) }... }}
 	{
-		statemachine_.to_state<states::Initializing>(*this);
 	}
 
 	SystemPort& PtpClock::get_system_port()
@@ -25,87 +32,256 @@ namespace uptp {
 		return config_;
 	}
 
-	MasterTracker& PtpClock::master_tracker()
+	const Config& PtpClock::get_config() const
+	{
+		return config_;
+	}
+
+	ClockServo& PtpClock::servo()
+	{
+		return servo_;
+	}
+
+	VirtualClock& PtpClock::domain_clock()
+	{
+		return domain_clock_;
+	}
+
+	const VirtualClock& PtpClock::domain_clock() const
+	{
+		return domain_clock_;
+	}
+
+	const ClockIdentity& PtpClock::get_identity() const
+	{
+		return identity_;
+	}
+
+	PtpPort& PtpClock::port(size_t index)
 	{
-		return master_tracker_;
+		return ports_[index];
 	}
 
 	void PtpClock::enable()
 	{
-		if(is<states::Disabled>()) {
-			to_state<states::Listening>();
+		for(auto& port : ports_) {
+			port.enable();
 		}
+		state_decision();
 	}
 
 	void PtpClock::disable()
 	{
-		if(!is<states::Disabled>()) {
-			to_state<states::Disabled>();
+		for(auto& port : ports_) {
+			port.disable();
 		}
 	}
 
-	void PtpClock::on_general_message(PacketHandle packet)
+	InterfaceSockets open_interface(SystemPort& sys)
 	{
-		msg::Header header;
-		msg::deserialize(packet->get_data(), header);
-		
-		if (header.is(MessageTypes::Announce)) {
-			msg::Announce announce;
-			msg::deserialize(packet->get_data(), announce);
-			master_tracker_.announce_master(header, announce);
-		} else {
-			auto* state = statemachine_.get_state_interface<states::PtpStateBase>();
-			if (state) {
-				state->on_message(header, std::move(packet));
+		PRINT("Network changed!\n");
+
+		InterfaceSockets sockets;
+		if( Config::transport == Config::Transport::Ethernet ) {
+			sockets.event = sys.make_ethernet();
+			if( sockets.event ) {
+				sys.join_multicast(ptp_multicast_mac);
+				if( Config::delay_mechanism == Config::DelayMechanism::P2P ) {
+					sys.join_multicast(ptp_peer_multicast_mac);
+				}
 			}
+			return sockets;
 		}
-	}
 
-	void PtpClock::on_event_message(PacketHandle packet)
-	{
-		msg::Header header;
-		msg::deserialize(packet->get_data(), header);
+		sockets.event   = sys.make_udp(ptp_address_family, event_port_number);
+		sockets.general = sys.make_udp(ptp_address_family, general_port_number);
 
-		auto* state = statemachine_.get_state_interface<states::PtpStateBase>();
-		if (state) {
-			state->on_message(header, std::move(packet));
+		if( sockets.event && sockets.general ) {
+			if( !Config::unicast ) {
+				sys.join_multicast(ptp_multicast_group);
+			}
+			if( Config::delay_mechanism == Config::DelayMechanism::P2P ) {
+				sys.join_multicast(ptp_peer_multicast_group);
+			}
 		}
 
+		return sockets;
 	}
 
 	void PtpClock::on_network_changed(ip_address ipaddr, const std::array<uint8, 6>& macaddr) {
 		(void) ipaddr;
 
-		port_identity_.clock.update(macaddr);
-		port_identity_.port = 1;
-		
-		PRINT("Network changed!\n");
-		auto& sys = get_system_port();
+		set_identity(macaddr);
 
-		event_port_   = sys.make_udp(319);
-		general_port_ = sys.make_udp(320);
+		auto sockets = open_interface(get_system_port());
+		if( Config::transport == Config::Transport::Ethernet ) {
+			ports_[0].attach(std::move(sockets.event));
+		} else {
+			ports_[0].attach(std::move(sockets.event), std::move(sockets.general));
+		}
+	}
 
-		if( event_port_ && general_port_ ) {
-			sys.join_multicast((224 << 0) | (0<<8) | (1<<16) | (129 << 24));
+	void PtpClock::set_identity(const std::array<uint8, 6>& macaddr)
+	{
+		identity_.update(macaddr);
+		for(auto& port : ports_) {
+			port.on_identity_changed();
+		}
+	}
+
+#if !UPTP_SLAVE_ONLY
+	msg::Announce PtpClock::make_default_announce() const
+	{
+		msg::Announce announce;
+		announce.origin_timestamp = Time();
+		announce.grandmaster_clock_quality = config_.clock_quality;
+		announce.grandmaster_identity = identity_;
+		announce.current_utc_offset = config_.current_utc_offset;
+		announce.steps_removed = 0;
+		announce.grandmaster_priority1 = config_.priority1;
+		announce.grandmaster_priority2 = config_.priority2;
+		announce.time_source = config_.time_source;
+		return announce;
+	}
 
-			event_port_->on_received   = ulib::function<void(PacketHandle)>(this, &PtpClock::on_event_message);
-			general_port_->on_received = ulib::function<void(PacketHandle)>(this, &PtpClock::on_general_message);
+	msg::Announce PtpClock::make_announce() const
+	{
+		auto announce = make_default_announce();
+
+		const PtpPort* parent_port;
+		const auto* parent = best_foreign(&parent_port);
+		if(parent && foreign_is_better(*parent)) {
+			// boundary clock: pass the grandmaster on, its steps removed already count us
+			announce.grandmaster_clock_quality = parent->grandmaster_clock_quality;
+			announce.grandmaster_identity = parent->grandmaster_clock;
+			announce.steps_removed = parent->stepsRemoved;
+			announce.grandmaster_priority1 = parent->grandmasterPriority1;
+			announce.grandmaster_priority2 = parent->grandmasterPriority2;
+			announce.time_source = parent->timeSource;
+		}
+
+		return announce;
+	}
+#endif
+
+	const MasterDescriptor* PtpClock::best_foreign(const PtpPort** best_port) const
+	{
+		const MasterDescriptor* best = nullptr;
+		*best_port = nullptr;
+
+		for(auto& port : ports_) {
+			if(port.is<states::Disabled>()) {
+				continue;
+			}
+
+			const auto* candidate = port.master_tracker().best_foreign();
+			if(candidate && (!best || bmc_compare(*candidate, *best, config_) < 0)) {
+				best = candidate;
+				*best_port = &port;
+			}
 		}
+
+		return best;
 	}
 
-	NetHandle& PtpClock::event_port()
+	bool PtpClock::foreign_is_better(const MasterDescriptor& foreign) const
 	{
-		return event_port_;
+#if UPTP_SLAVE_ONLY
+		(void) foreign;
+		return true;
+#else
+		// MasterDescriptor counts the hop to us into stepsRemoved, as it would for a foreign announce
+		const MasterDescriptor self(ports_[0].make_header(MessageTypes::Announce), make_default_announce());
+		return bmc_compare(foreign, self, config_) < 0;
+#endif
+	}
+
+	PortRole PtpClock::recommended_state(const PtpPort& port) const
+	{
+		const PtpPort* best_port;
+		const auto* best = best_foreign(&best_port);
+
+		if(!best || !foreign_is_better(*best)) {
+#if UPTP_SLAVE_ONLY
+			return PortRole::Listening;
+#else
+			// we are the grandmaster, ports without foreign masters wait for the announce receipt timeout
+			return port.master_tracker().best_foreign() ? PortRole::Master : PortRole::Listening;
+#endif
+		}
+
+		if(&port == best_port) {
+			return PortRole::Slave;
+		}
+
+#if UPTP_SLAVE_ONLY
+		return PortRole::Listening;
+#else
+		// 9.3.3: Master if the data set we'd announce here beats the port's best
+		// foreign master, Passive if it loses. With the same grandmaster on both
+		// stepsRemoved and the port identities decide, so of two boundary clocks
+		// on one segment exactly one serves it.
+		const auto* port_best = port.master_tracker().best_foreign();
+		if(port_best) {
+			const MasterDescriptor announced(port.make_header(MessageTypes::Announce), make_announce());
+			if(bmc_compare(announced, *port_best, config_) >= 0) {
+				return PortRole::Passive;
+			}
+		}
+
+		return PortRole::Master;
+#endif
+	}
+
+	void PtpClock::state_decision(PtpPort* changed)
+	{
+		// state changes may report master changes again, those are folded into this decision
+		if(deciding_) {
+			decide_again_ = true;
+			return;
+		}
+
+		deciding_ = true;
+		do {
+			decide_again_ = false;
+
+			const PtpPort* best_port;
+			const auto* best = best_foreign(&best_port);
+			const bool has_parent = best && foreign_is_better(*best);
+			const bool parent_changed = has_parent != has_parent_ || (has_parent && !(best->port_identity == parent_));
+
+			has_parent_ = has_parent;
+			if(has_parent) {
+				parent_ = best->port_identity;
+			}
+
+			for(auto& port : ports_) {
+				port.apply(recommended_state(port), &port == changed);
+			}
+			changed = nullptr;
+
+#if !UPTP_SLAVE_ONLY
+			if(parent_changed) {
+				// Master ports announce the new parent's grandmaster
+				for(auto& port : ports_) {
+					port.on_identity_changed();
+				}
+			}
+#else
+			(void) parent_changed;
+#endif
+		} while(decide_again_);
+		deciding_ = false;
 	}
 
-	NetHandle& PtpClock::general_port()
+	bool PtpClock::is_locked() const
 	{
-		return general_port_;
+		return locked_;
 	}
 
-	PortIdentity& PtpClock::get_identity()
+	void PtpClock::set_locked()
 	{
-		return port_identity_;
+		locked_ = true;
 	}
 
 }
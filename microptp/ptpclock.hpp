@@ -6,170 +6,110 @@
 #ifndef MICROPTP_PTPCLOCK_HPP__
 #define MICROPTP_PTPCLOCK_HPP__
 
-#include <microlib/statemachine.hpp>
+#include <array>
+#include <utility>
 #include <microlib/string.hpp>
-#include <microptp/ports/systemportapi.hpp>
-#include <microptp/messages.hpp>
-#include <microptp/clockservo.hpp>
-#include <microptp/ptpdatatypes.hpp>
-#include <microptp/mastertracker.hpp>
+#include <microptp/ptpport.hpp>
 #include <microptp/uptp.hpp>
-#include <microptp/state_slave.hpp>
-#include <microptp/state_disabled.hpp>
+#include <microptp/virtual_clock.hpp>
 
 namespace uptp {
 
-	class PtpClock;
 	class SystemPort;
 
-	namespace states {
-
-		class Initializing : public PtpStateBase
-		{
-		public:
-			Initializing(PtpClock& clock);
-			~Initializing();
-
-			void on_announce_timeout();
-			void on_best_master_changed();
-			void on_message(const msg::Header& header, PacketHandle) override;
-
-		private:
-			PtpClock& clock_;
-		};
-
-		class Faulty : public PtpStateBase
-		{
-		public:
-			Faulty(PtpClock& clock);
-		};
-		/*
-		class Disabled : public PtpStateBase
-		{
-		public:
-			Disabled(PtpClock& clock);
-		};
-*/
-
-		class Listening : public PtpStateBase
-		{
-		public:
-			Listening(PtpClock& clock);
-			~Listening();
-
-			void on_message(const msg::Header&, PacketHandle) override;
-			void on_best_master_changed();
-
-		private:
-			PtpClock& clock_;
-		};
-
-		/*
-		class PeerSlave : public PtpStateBase
-		{
-		public:
-			PeerSlave(PtpClock& clock);
-
-			void on_pdelay_req_timer();
-
-		private:
-			ClockServo servo_;
-
-		};
-*/
-
-		class Master : public PtpStateBase
-		{
-		public:
-
-			void on_announce_timer();
-			void on_delay_req();
-			
-		private:
-			ClockQuality quality;
-			uint8 priority1;
-			uint8 priority2;
-		};
-
-		class Passive : public PtpStateBase
-		{
-		public:
-			Passive(PtpClock&);
-		};
-
-		class Uncalibrated : public PtpStateBase
-		{
-		public:
-			Uncalibrated(PtpClock&);
-		};
-
-	}
+	//
+	// The sockets of one interface for Config::transport, with the PTP multicast
+	// groups joined. PTP over Ethernet has its single handle in [event].
+	// Opened on network changes by PtpClock and MultiDomainClock.
+	//
+	struct InterfaceSockets {
+		NetHandle event;
+		NetHandle general;
+	};
+
+	InterfaceSockets open_interface(SystemPort& sys);
 
+	//
+	// Ordinary clock with Config::num_ports == 1, boundary clock otherwise.
+	// All ports share the local clock and its servo. The state decision is
+	// made across the ports: the port receiving the best foreign master
+	// becomes Slave, ports whose foreign master beats what they would announce
+	// become Passive and the remaining ports serve time as Master.
+	//
 	class PtpClock
 	{
 	public:
+		static const size_t num_ports = Config::num_ports;
+
 		PtpClock(SystemPort& env, const Config& cfg);
 
+	private:
+		template< size_t... Indices >
+		PtpClock(SystemPort& env, const Config& cfg, std::index_sequence<Indices...>);
+
 	public:
 		void enable();
 		void disable();
 
 	public:
 		// Invoked by systemport
+		// Single interface: sets the clock identity and opens the sockets of port 1.
 		void on_network_changed(ip_address ipaddr, const std::array<uint8, 6>& macaddr);
-		void on_general_message(PacketHandle packet);
-		void on_event_message(PacketHandle packet);
+
+		// Boundary clocks: the system port opens the sockets per interface and
+		// attaches them to the ports after setting the identity.
+		void set_identity(const std::array<uint8, 6>& macaddr);
+		PtpPort& port(size_t index);
 
 	public:
 		SystemPort& get_system_port();
 		Config& get_config();
-		MasterTracker& master_tracker();
+		const Config& get_config() const;
+		ClockServo& servo();
 
-		NetHandle& event_port();
-		NetHandle& general_port();
+		// Time of this clock's domain, see VirtualClock
+		VirtualClock& domain_clock();
+		const VirtualClock& domain_clock() const;
 
-		PortIdentity& get_identity();
+		const ClockIdentity& get_identity() const;
 
-	public:
-		// State machine
-		template< typename State, typename... Args >
-		void to_state(Args&&... args)
-		{
-			statemachine_.template to_state<State>(*this, std::forward<Args>(args)...);
-		}
-
-		template< typename T >
-		bool is() const {
-			return statemachine_.template is_state<T>();
-		}
+#if !UPTP_SLAVE_ONLY
+		// Announce body with this clock's own data set (defaultDS)
+		msg::Announce make_default_announce() const;
 
-	public:
-		void send_delay_req(ulib::function<void(const Time&)> completion_func);
+		// Announce body for Master ports: the parent's grandmaster while a port
+		// is Slave, this clock's own data set otherwise
+		msg::Announce make_announce() const;
+#endif
+
+		// State decision across all ports, to be called when a port's best foreign
+		// master changes. A Slave port that stays Slave is restarted if it is [changed].
+		void state_decision(PtpPort* changed = nullptr);
+		PortRole recommended_state(const PtpPort& port) const;
+
+		// Set once the servo has completed its first correction, survives
+		// master changes so Config::never_step_after_lock can be honoured.
+		bool is_locked() const;
+		void set_locked();
 
 	private:
-		NetHandle event_port_;
-		NetHandle general_port_;
+		const MasterDescriptor* best_foreign(const PtpPort** port) const;
+		bool foreign_is_better(const MasterDescriptor& foreign) const;
 
 		SystemPort& system_port_;
 		Config config_;
-		PortIdentity port_identity_;
-		MasterTracker master_tracker_;
-		
-		void init_net();
-
-		ulib::state_machine<
-			states::Initializing,
-			//states::Faulty,
-			states::Disabled,
-			states::Listening,
-			states::Slave
-			//states::Master,
-			//states::Passive,
-			//states::Uncalibrated
-		> statemachine_;
+		ClockIdentity identity_;
+		bool locked_;
+		VirtualClock domain_clock_;
+		ClockServo servo_;
 
-	};
+		bool deciding_;
+		bool decide_again_;
+		bool has_parent_;
+		PortIdentity parent_;
 
+		std::array<PtpPort, num_ports> ports_;
+	};
 
 }
 
@@ -29,31 +29,227 @@ namespace uptp {
 		uint32 nanosecondsField;
 	};
 	
+	//
+	// Signed nanoseconds, the one canonical representation of a point in time
+	// or a difference of two. All operations are plain 64 bit integer ops, so
+	// keep them inline. Covers about +-292 years around the PTP epoch. Wire
+	// timestamps saturate at 2^62 nanoseconds (the year 2116), so sums of
+	// differences of them and corrections don't overflow either.
+	//
 	struct Time {
-		Time();
-		Time(uint32 msecs);
-		Time(uint64 logical);
-		Time(int64 secs, int32 nanos);
-		Time(const Time&);
-
-		void clear();
-		void normalize();
-		int64 to_nanos() const;
-
-		int64 secs_;
-		int32 nanos_;
+		static constexpr int64 nanos_per_second = 1000000000ll;
+
+		constexpr Time()
+			: ns_(0)
+		{}
+
+		// from milliseconds
+		explicit constexpr Time(uint32 msecs)
+			: ns_(static_cast<int64>(msecs) * 1000000ll)
+		{}
+
+		// from the port's logical time (seconds in the upper, nanoseconds in the lower 32 bits)
+		explicit constexpr Time(uint64 logical)
+			: ns_(static_cast<int64>(logical >> 32) * nanos_per_second + static_cast<int64>(logical & 0xFFFFFFFF))
+		{}
+
+		constexpr Time(int64 secs, int32 nanos)
+			: ns_(secs * nanos_per_second + nanos)
+		{}
+
+		static constexpr Time from_nanos(int64 nanos)
+		{
+			Time result;
+			result.ns_ = nanos;
+			return result;
+		}
+
+		// from the 48 bit seconds and 32 bit nanoseconds wire format, any packet
+		// may carry any value there
+		static constexpr uint64 max_wire_seconds = (1ull << 62) / nanos_per_second;
+
+		static constexpr Time from_wire(uint64 seconds, uint32 nanoseconds)
+		{
+			return seconds >= max_wire_seconds ? Time(static_cast<int64>(max_wire_seconds), 0)
+				: Time(static_cast<int64>(seconds), nanoseconds < nanos_per_second ? static_cast<int32>(nanoseconds) : static_cast<int32>(nanos_per_second - 1));
+		}
+
+		constexpr void clear()
+		{
+			ns_ = 0;
+		}
+
+		constexpr int64 to_nanos() const
+		{
+			return ns_;
+		}
+
+		// seconds and nanoseconds parts carry the sign of the whole value
+		constexpr int64 secs() const
+		{
+			return ns_ / nanos_per_second;
+		}
+
+		constexpr int32 nanos() const
+		{
+			return static_cast<int32>(ns_ % nanos_per_second);
+		}
+
+		// wire fields for non-negative times
+		constexpr uint64 wire_seconds() const
+		{
+			return static_cast<uint64>(secs()) & 0xFFFFFFFFFFFFull;
+		}
+
+		constexpr uint32 wire_nanoseconds() const
+		{
+			return static_cast<uint32>(nanos());
+		}
+
+		int64 ns_;
 	};
 
-	Time operator-(const Time&, const Time&);
-	Time operator/(const Time&, int32);
-	Time operator+(const Time&, const Time&);
-	Time operator-(const Time&);
+	constexpr Time operator-(const Time& a, const Time& b)
+	{
+		return Time::from_nanos(a.ns_ - b.ns_);
+	}
+
+	constexpr Time operator+(const Time& a, const Time& b)
+	{
+		return Time::from_nanos(a.ns_ + b.ns_);
+	}
+
+	constexpr Time operator/(const Time& nom, int32 den)
+	{
+		return Time::from_nanos(nom.ns_ / den);
+	}
+
+	constexpr Time operator-(const Time& time)
+	{
+		return Time::from_nanos(-time.ns_);
+	}
+
+	constexpr bool operator<(const Time& a, const Time& b)  { return a.ns_ <  b.ns_; }
+	constexpr bool operator>(const Time& a, const Time& b)  { return a.ns_ >  b.ns_; }
+	constexpr bool operator<=(const Time& a, const Time& b) { return a.ns_ <= b.ns_; }
+	constexpr bool operator>=(const Time& a, const Time& b) { return a.ns_ >= b.ns_; }
+	constexpr bool operator==(const Time& a, const Time& b) { return a.ns_ == b.ns_; }
+	constexpr bool operator!=(const Time& a, const Time& b) { return a.ns_ != b.ns_; }
+
+	//
+	// Signed time interval in units of 2^-16 nanoseconds, which is the
+	// encoding of the correctionField. Used for offsets and path delays,
+	// so the sub-nanosecond part of corrections is kept through the filters.
+	// Range is about +-39 hours, so don't feed it absolute times.
+	//
+	struct TimeInterval {
+		static constexpr int32 scale_bits = 16;
+
+		constexpr TimeInterval()
+			: scaled_nanos_(0)
+		{}
 
-	bool operator<(const Time&, const Time&);
-	bool operator>(const Time&, const Time&);
-	bool operator<=(const Time&, const Time&);
-	bool operator>=(const Time&, const Time&);
-	bool operator==(const Time&, const Time&);
+		explicit constexpr TimeInterval(int64 scaled_nanos)
+			: scaled_nanos_(scaled_nanos)
+		{}
+
+		explicit constexpr TimeInterval(const Time& difference)
+			: scaled_nanos_(difference.to_nanos() * (1ll << scale_bits))
+		{}
+
+		static constexpr TimeInterval from_nanos(int64 nanos)
+		{
+			return TimeInterval(nanos * (1ll << scale_bits));
+		}
+
+		// rounded to the nearest nanosecond
+		constexpr int64 to_nanos() const
+		{
+			return (scaled_nanos_ + (1ll << (scale_bits - 1))) >> scale_bits;
+		}
+
+		constexpr Time to_time() const
+		{
+			return Time::from_nanos(to_nanos());
+		}
+
+		int64 scaled_nanos_;
+	};
+
+	constexpr TimeInterval operator+(const TimeInterval& a, const TimeInterval& b)
+	{
+		return TimeInterval(a.scaled_nanos_ + b.scaled_nanos_);
+	}
+
+	constexpr TimeInterval operator-(const TimeInterval& a, const TimeInterval& b)
+	{
+		return TimeInterval(a.scaled_nanos_ - b.scaled_nanos_);
+	}
+
+	constexpr TimeInterval operator/(const TimeInterval& nom, int32 den)
+	{
+		return TimeInterval(nom.scaled_nanos_ / den);
+	}
+
+	constexpr TimeInterval operator-(const TimeInterval& interval)
+	{
+		return TimeInterval(-interval.scaled_nanos_);
+	}
+
+	constexpr bool operator<(const TimeInterval& a, const TimeInterval& b)  { return a.scaled_nanos_ <  b.scaled_nanos_; }
+	constexpr bool operator==(const TimeInterval& a, const TimeInterval& b) { return a.scaled_nanos_ == b.scaled_nanos_; }
+
+	//
+	// Frequency ratio minus one in units of 2^-41, the representation of the
+	// 802.1AS cumulativeScaledRateOffset. Products are taken in two halves, so
+	// offsets and chains of them stay exact up to far beyond any real clock
+	// (about 2^-3); from_intervals needs num - den below 2^22 ns.
+	//
+	struct RateOffset {
+		static constexpr int32 scale_bits = 41;
+
+		constexpr RateOffset()
+			: scaled_(0)
+		{}
+
+		explicit constexpr RateOffset(int64 scaled)
+			: scaled_(scaled)
+		{}
+
+		// (num / den) - 1 for two measured intervals of the same events
+		static constexpr RateOffset from_intervals(int64 num_nanos, int64 den_nanos)
+		{
+			return RateOffset(((num_nanos - den_nanos) * (1ll << scale_bits)) / den_nanos);
+		}
+
+		constexpr int32 to_ppb() const
+		{
+			return static_cast<int32>(scale(1000000000ll));
+		}
+
+		// (scaled_ * value) >> scale_bits without the 64 bit overflow of the plain
+		// product, for |value| up to 2^41 (no __int128 on 32 bit targets)
+		constexpr int64 scale(int64 value) const
+		{
+			const int64 high = scaled_ >> 21;
+			const int64 low  = scaled_ & ((1ll << 21) - 1);
+			return ((high * value) >> (scale_bits - 21)) + ((low * value) >> scale_bits);
+		}
+
+		// interval measured with the other clock's rate
+		constexpr TimeInterval apply(const TimeInterval& interval) const
+		{
+			return interval + TimeInterval((interval.to_nanos() * scaled_) >> (scale_bits - TimeInterval::scale_bits));
+		}
+
+		int64 scaled_;
+	};
+
+	// Ratio of chained rate ratios: (1 + a)(1 + b) - 1
+	constexpr RateOffset operator*(const RateOffset& a, const RateOffset& b)
+	{
+		return RateOffset(a.scaled_ + b.scaled_ + a.scale(b.scaled_));
+	}
 
 	struct ClockQuality {
 		uint16 offset_scaled_log_variance;
@@ -70,6 +266,7 @@ namespace uptp {
 	
 	struct ClockIdentity {
 		ClockIdentity()
+			: identity()
 		{
 		}
 
@@ -103,6 +300,7 @@ namespace uptp {
 
 	struct PortIdentity {
 		PortIdentity()
+			: port(0)
 		{}
 
 		PortIdentity(const std::array<uint8, 6>& mac_addr, uint16 port_)
@@ -0,0 +1,463 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <microptp/config.hpp>
+#include <microptp/ptpclock.hpp>
+#include <microptp/ports/systemport.hpp>
+
+namespace uptp {
+
+#if !UPTP_SLAVE_ONLY
+	namespace {
+
+		inline void init_follow_up_information(msg::FollowUp&)
+		{
+		}
+
+		// the cumulative rate offset is zero as grandmaster
+		inline void init_follow_up_information(msg::GptpFollowUp& follow_up)
+		{
+			follow_up.information = msg::make_follow_up_information(RateOffset());
+		}
+
+	}
+#endif
+
+	PtpPort::PtpPort(PtpClock& clock, uint16 number)
+		: event_port_(&own_event_), general_port_(&own_general_),
+		  clock_(clock), master_tracker_(clock.get_config()), peer_delay_(*this),
+		  unicast_client_(*this), signaling_sequence_id_(0)
+	{
+		port_identity_.port = number;
+		statemachine_.to_state<states::Initializing>(*this);
+	}
+
+	PtpClock& PtpPort::clock()
+	{
+		return clock_;
+	}
+
+	const PtpClock& PtpPort::clock() const
+	{
+		return clock_;
+	}
+
+	SystemPort& PtpPort::get_system_port()
+	{
+		return clock_.get_system_port();
+	}
+
+	Config& PtpPort::get_config()
+	{
+		return clock_.get_config();
+	}
+
+	const Config& PtpPort::get_config() const
+	{
+		return clock_.get_config();
+	}
+
+	MasterTracker& PtpPort::master_tracker()
+	{
+		return master_tracker_;
+	}
+
+	const MasterTracker& PtpPort::master_tracker() const
+	{
+		return master_tracker_;
+	}
+
+	ClockServo& PtpPort::servo()
+	{
+		return clock_.servo();
+	}
+
+	bool PtpPort::is_locked() const
+	{
+		return clock_.is_locked();
+	}
+
+	void PtpPort::set_locked()
+	{
+		clock_.set_locked();
+	}
+
+	void PtpPort::enable()
+	{
+		if(is<states::Disabled>()) {
+			if(Config::delay_mechanism == Config::DelayMechanism::P2P && *event_port_) {
+				peer_delay_.start();
+			}
+			to_state<states::Listening>();
+			if(Config::unicast) {
+				unicast_client_.start();
+			}
+		}
+	}
+
+	void PtpPort::disable()
+	{
+		if(!is<states::Disabled>()) {
+			peer_delay_.stop();
+			if(Config::unicast) {
+				unicast_client_.stop();
+			}
+			to_state<states::Disabled>();
+		}
+	}
+
+	void PtpPort::attach(NetHandle event, NetHandle general)
+	{
+		own_event_   = std::move(event);
+		own_general_ = std::move(general);
+
+		if( own_event_ && own_general_ ) {
+			own_event_->on_received   = ulib::function<void(PacketHandle)>(this, &PtpPort::on_event_message);
+			own_general_->on_received = ulib::function<void(PacketHandle)>(this, &PtpPort::on_general_message);
+			own_event_->on_received_batch   = ulib::function<void(PacketHandle*, size_t)>(this, &PtpPort::on_event_messages);
+			own_general_->on_received_batch = ulib::function<void(PacketHandle*, size_t)>(this, &PtpPort::on_general_messages);
+			own_event_->on_transmit_completed = ulib::function<void(uint32, Time)>(this, &PtpPort::on_event_transmitted);
+		}
+
+		share(own_event_, own_general_);
+	}
+
+	void PtpPort::attach(NetHandle net)
+	{
+		own_event_   = std::move(net);
+		own_general_ = NetHandle();
+
+		if( own_event_ ) {
+			// the general path handles Announces and passes everything else on
+			own_event_->on_received = ulib::function<void(PacketHandle)>(this, &PtpPort::on_general_message);
+			own_event_->on_received_batch = ulib::function<void(PacketHandle*, size_t)>(this, &PtpPort::on_general_messages);
+			own_event_->on_transmit_completed = ulib::function<void(uint32, Time)>(this, &PtpPort::on_event_transmitted);
+		}
+
+		share(own_event_, own_event_);
+	}
+
+	void PtpPort::share(NetHandle& event, NetHandle& general)
+	{
+		event_port_   = &event;
+		general_port_ = &general;
+
+		build_transmit_templates();
+
+		if( event && general && Config::delay_mechanism == Config::DelayMechanism::P2P && !is<states::Disabled>() ) {
+			peer_delay_.start();
+		}
+	}
+
+	void PtpPort::on_identity_changed()
+	{
+		port_identity_.clock = clock_.get_identity();
+		build_transmit_templates();
+	}
+
+	void PtpPort::apply(PortRole role, bool restart_slave)
+	{
+		if(is<states::Disabled>() || is<states::Initializing>()) {
+			return;
+		}
+
+		switch(role) {
+		case PortRole::Slave:
+			if(!is<states::Slave>() || restart_slave) {
+				to_state<states::Slave>();
+			}
+			break;
+
+		case PortRole::Passive:
+			if(!is<states::Passive>()) {
+				to_state<states::Passive>();
+			}
+			break;
+
+#if !UPTP_SLAVE_ONLY
+		case PortRole::Master:
+			if(!is<states::Master>()) {
+				to_state<states::Master>();
+			}
+			break;
+#endif
+
+		default:
+			// a Master without foreign masters stays Master, Listening keeps waiting
+			if(is<states::Slave>() || is<states::Passive>()) {
+				to_state<states::Listening>();
+			}
+			break;
+		}
+	}
+
+	void PtpPort::on_general_message(PacketHandle packet)
+	{
+		msg::Header header;
+		if (!read_header(packet, header)) {
+			return;
+		}
+
+		if (header.is(MessageTypes::Announce)) {
+			msg::Announce announce;
+			msg::deserialize(packet->get_data(), announce);
+			master_tracker_.announce_master(header, announce, packet->source_address());
+		} else {
+			dispatch(header, std::move(packet));
+		}
+	}
+
+	void PtpPort::on_event_message(PacketHandle packet)
+	{
+		msg::Header header;
+		if (!read_header(packet, header)) {
+			return;
+		}
+
+		dispatch(header, std::move(packet));
+	}
+
+	void PtpPort::on_general_messages(PacketHandle* packets, size_t count)
+	{
+		for(size_t i = 0; i < count; ++i) {
+			on_general_message(std::move(packets[i]));
+		}
+		end_batch();
+	}
+
+	void PtpPort::on_event_messages(PacketHandle* packets, size_t count)
+	{
+		for(size_t i = 0; i < count; ++i) {
+			on_event_message(std::move(packets[i]));
+		}
+		end_batch();
+	}
+
+	void PtpPort::end_batch()
+	{
+		auto* state = statemachine_.get_state_interface<states::PtpStateBase>();
+		if (state) {
+			state->on_batch_end();
+		}
+	}
+
+	void PtpPort::on_event_transmitted(uint32 id, Time time)
+	{
+		const auto type = transmit_type(id);
+		if (type == MessageTypes::PeerDelayReq || type == MessageTypes::PeerDelayResp) {
+			peer_delay_.on_transmitted(id, time);
+		} else {
+			// link delay stays on the timebase, the states work in domain time
+			auto* state = statemachine_.get_state_interface<states::PtpStateBase>();
+			if (state) {
+				state->on_transmitted(id, clock_.domain_clock().to_domain(time));
+			}
+		}
+	}
+
+	bool PtpPort::is_peer_delay(const msg::Header& header) const
+	{
+		return header.is(MessageTypes::PeerDelayReq) || header.is(MessageTypes::PeerDelayResp) || header.is(MessageTypes::PeerDelayRespFollowUp);
+	}
+
+	void PtpPort::dispatch(const msg::Header& header, PacketHandle packet)
+	{
+		if (is_peer_delay(header)) {
+			// link delay runs independently of the port state
+			if (Config::delay_mechanism == Config::DelayMechanism::P2P && !is<states::Disabled>()) {
+				peer_delay_.on_message(header, packet);
+			}
+		} else {
+			if (Config::unicast && header.is(MessageTypes::Signaling)) {
+				// grants for us as a slave, the Master state takes the requests
+				unicast_client_.on_signaling(header, packet);
+			}
+
+			auto* state = statemachine_.get_state_interface<states::PtpStateBase>();
+			if (state) {
+				state->on_message(header, std::move(packet));
+			}
+		}
+	}
+
+	bool PtpPort::read_header(const PacketHandle& packet, msg::Header& header)
+	{
+		const size_t size = packet->size();
+		if (!msg::layouts::header::fits(size)) {
+			return false;
+		}
+
+		msg::deserialize(packet->get_data(), header);
+		if (!Config::any_domain && header.domain_number != get_config().domain_number) {
+			return false;
+		}
+
+		return msg::validate(header, size);
+	}
+
+	msg::Header make_header(const PortIdentity& source, const Config& config, MessageTypes type)
+	{
+		msg::Header header;
+		header.source_port_identity = source;
+		header.log_message_interval = 0x7F;
+		header.control_field = msg::control_field(type);
+		header.flag_field0 = header.flag_field1 = 0;
+		header.correction_field = 0;
+		header.domain_number = config.domain_number;
+		header.message_length = 0;
+		header.version_ptp = 2;
+		header.transport_specific = Config::gptp_profile ? 1 : 8;	// majorSdoId 1: 802.1AS
+		header.message_type = static_cast<uint8>(type);
+		header.sequence_id = 0;
+		return header;
+	}
+
+	void build_peer_delay_templates(TransmitTemplates& templates, const PortIdentity& source, const Config& config)
+	{
+		auto pdelay_req_header = make_header(source, config, MessageTypes::PeerDelayReq);
+		pdelay_req_header.log_message_interval = config.log_min_pdelay_req_interval;
+		msg::PDelayReq pdreq;
+		pdreq.timestamp = Time();
+		templates.pdelay_req.build(pdelay_req_header, pdreq);
+
+		auto pdelay_resp_header = make_header(source, config, MessageTypes::PeerDelayResp);
+		pdelay_resp_header.flag_field0 |= uint8(msg::Header::Field0Flags::TwoStep);
+		msg::PDelayResp pdresp;
+		pdresp.timestamp = Time();
+		pdresp.port_identity = PortIdentity();
+		templates.pdelay_resp.build(pdelay_resp_header, pdresp);
+
+		msg::PDelayRespFollowUp pdresp_follow_up;
+		pdresp_follow_up.precise_origin_timestamp = Time();
+		pdresp_follow_up.port_identity = PortIdentity();
+		templates.pdelay_resp_follow_up.build(make_header(source, config, MessageTypes::PeerDelayRespFollowUp), pdresp_follow_up);
+	}
+
+	msg::Header PtpPort::make_header(MessageTypes type) const
+	{
+		auto header = uptp::make_header(port_identity_, get_config(), type);
+
+		const bool peer_delay = type == MessageTypes::PeerDelayReq || type == MessageTypes::PeerDelayResp || type == MessageTypes::PeerDelayRespFollowUp;
+		if (Config::unicast && !peer_delay) {
+			header.flag_field0 = uint8(msg::Header::Field0Flags::Unicast);
+		}
+		return header;
+	}
+
+	void PtpPort::send_signaling(const NetAddress& address, const PortIdentity& target, const msg::UnicastTransmissionTlv& tlv)
+	{
+		auto& port = general_port();
+		if (!port || !address) {
+			return;
+		}
+
+		auto handle = port->acquire_transmit_handle();
+		const size_t size = msg::message_size<msg::Signaling>() + msg::TlvHeader::size + tlv.length_field;
+		if (!handle || handle->capacity() < size) {
+			return;
+		}
+
+		auto header = make_header(MessageTypes::Signaling);
+		header.message_length = static_cast<uint16>(size);
+		header.sequence_id = signaling_sequence_id_++;
+
+		msg::Signaling signaling;
+		signaling.target_port_identity = target;
+
+		auto* data = static_cast<uint8*>(handle->get_data());
+		msg::serialize(data, header);
+		msg::serialize(data, signaling);
+		msg::serialize(data + msg::message_size<msg::Signaling>(), tlv);
+		handle->set_size(size);
+
+		port->send(address, general_port_number, std::move(handle), untracked_transmit_id);
+	}
+
+	uint32 PtpPort::transmit_id(MessageTypes type, uint16 sequence_id) const
+	{
+		return uptp::transmit_id(type, sequence_id, get_config().domain_number);
+	}
+
+	Time PtpPort::receive_time(const PacketHandle& packet) const
+	{
+		return clock_.domain_clock().to_domain(packet->time());
+	}
+
+	void PtpPort::build_transmit_templates()
+	{
+		auto delay_req_header = make_header(MessageTypes::DelayRequest);
+		msg::DelayReq dreq;
+		dreq.timestamp = Time();
+		transmit_templates_.delay_req.build(delay_req_header, dreq);
+
+		build_peer_delay_templates(transmit_templates_, port_identity_, get_config());
+
+#if !UPTP_SLAVE_ONLY
+		const auto& config = get_config();
+
+		auto announce_header = make_header(MessageTypes::Announce);
+		announce_header.log_message_interval = config.log_announce_interval;
+		announce_header.flag_field1 = uint8(msg::Header::Field1Flags::PtpTimescale);
+		transmit_templates_.announce.build(announce_header, clock_.make_announce());
+
+		auto sync_header = make_header(MessageTypes::Synch);
+		sync_header.log_message_interval = config.log_sync_interval;
+		sync_header.flag_field0 |= uint8(msg::Header::Field0Flags::TwoStep);
+		msg::Sync sync;
+		sync.origin_timestamp = Time();
+		transmit_templates_.sync.build(sync_header, sync);
+
+		auto follow_up_header = make_header(MessageTypes::FollowUp);
+		follow_up_header.log_message_interval = config.log_sync_interval;
+		TransmitTemplates::follow_up_message follow_up;
+		follow_up.precise_origin_timestamp = Time();
+		init_follow_up_information(follow_up);
+		transmit_templates_.follow_up.build(follow_up_header, follow_up);
+
+		auto delay_resp_header = make_header(MessageTypes::DelayResp);
+		delay_resp_header.log_message_interval = config.log_min_delay_req_interval;
+		msg::DelayResp delay_resp;
+		delay_resp.timestamp = Time();
+		delay_resp.port_identity = PortIdentity();
+		transmit_templates_.delay_resp.build(delay_resp_header, delay_resp);
+#endif
+	}
+
+	const TransmitTemplates& PtpPort::transmit_templates() const
+	{
+		return transmit_templates_;
+	}
+
+	const PeerDelay& PtpPort::peer_delay() const
+	{
+		return peer_delay_;
+	}
+
+	const UnicastClient& PtpPort::unicast_client() const
+	{
+		return unicast_client_;
+	}
+
+	NetHandle& PtpPort::event_port()
+	{
+		return *event_port_;
+	}
+
+	NetHandle& PtpPort::general_port()
+	{
+		return *general_port_;
+	}
+
+	PortIdentity& PtpPort::get_identity()
+	{
+		return port_identity_;
+	}
+
+	const PortIdentity& PtpPort::get_identity() const
+	{
+		return port_identity_;
+	}
+
+}
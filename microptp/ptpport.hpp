@@ -0,0 +1,282 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_PTPPORT_HPP__
+#define MICROPTP_PTPPORT_HPP__
+
+#include <array>
+#include <microlib/statemachine.hpp>
+#include <microptp/ports/systemportapi.hpp>
+#include <microptp/messages.hpp>
+#include <microptp/clockservo.hpp>
+#include <microptp/ptpdatatypes.hpp>
+#include <microptp/mastertracker.hpp>
+#include <microptp/transmit_template.hpp>
+#include <microptp/peer_delay.hpp>
+#include <microptp/unicast_client.hpp>
+#include <microptp/state_slave.hpp>
+#include <microptp/state_disabled.hpp>
+#include <microptp/state_master.hpp>
+
+namespace uptp {
+
+	class PtpClock;
+	class PtpPort;
+	class SystemPort;
+
+	// PTP over UDP/IPv4: the 224.0.1.129 group (network byte order) and the event/general ports
+	constexpr uint32 ptp_multicast_address = (224 << 0) | (0<<8) | (1<<16) | (129 << 24);
+	constexpr uint16 event_port_number = 319;
+	constexpr uint16 general_port_number = 320;
+
+	// 224.0.0.107, peer delay messages are not forwarded by boundary clocks
+	constexpr uint32 ptp_peer_multicast_address = (224 << 0) | (0<<8) | (0<<16) | (107 << 24);
+
+	// Groups of the configured transport. Ethernet uses the IPv4 ones, its NetReps map them to MACs.
+	constexpr bool ptp_over_ipv6 = Config::transport == Config::Transport::UdpIpv6;
+	constexpr NetAddress::Family ptp_address_family = ptp_over_ipv6 ? NetAddress::Family::Ipv6 : NetAddress::Family::Ipv4;
+	constexpr NetAddress ptp_multicast_group =
+		ptp_over_ipv6 ? NetAddress::ipv6_multicast(Config::ipv6_multicast_scope, 0x181) : NetAddress::ipv4(ptp_multicast_address);
+	constexpr NetAddress ptp_peer_multicast_group =
+		ptp_over_ipv6 ? NetAddress::ipv6_multicast(0x2, 0x6B) : NetAddress::ipv4(ptp_peer_multicast_address);
+
+	// PTP over Ethernet (Annex F): the ethertype and the MAC groups standing in for the IPv4 groups above
+	constexpr uint16 ptp_ethertype = 0x88F7;
+	constexpr std::array<uint8, 6> ptp_multicast_mac = {{ 0x01, 0x1B, 0x19, 0x00, 0x00, 0x00 }};
+	constexpr std::array<uint8, 6> ptp_peer_multicast_mac = {{ 0x01, 0x80, 0xC2, 0x00, 0x00, 0x0E }};
+
+	// Id of sends nobody waits for the transmit timestamp of. Over Ethernet event
+	// and general messages share a NetRep, so its type must not match any message.
+	constexpr uint32 untracked_transmit_id = 0xFFFFFFFF;
+
+	// Event message transmit ids: domain number in the upper byte, message type
+	// in the low nibble of the byte below, sequence id in the lower half. The
+	// high nibble is a tag of the sender for sends sharing a sequence id.
+	constexpr uint32 transmit_id(MessageTypes type, uint16 sequence_id, uint8 domain_number = 0)
+	{
+		return (static_cast<uint32>(domain_number) << 24) | (static_cast<uint32>(type) << 16) | sequence_id;
+	}
+
+	constexpr MessageTypes transmit_type(uint32 id)
+	{
+		return static_cast<MessageTypes>((id >> 16) & 0x0F);
+	}
+
+	constexpr uint32 tag_transmit_id(uint32 id, uint8 tag)
+	{
+		return id | (static_cast<uint32>(tag & 0x0F) << 20);
+	}
+
+	constexpr uint8 transmit_tag(uint32 id)
+	{
+		return static_cast<uint8>((id >> 20) & 0x0F);
+	}
+
+	constexpr uint8 transmit_domain(uint32 id)
+	{
+		return static_cast<uint8>(id >> 24);
+	}
+
+	// Header from [source] with the defaults for the given message type
+	msg::Header make_header(const PortIdentity& source, const Config& config, MessageTypes type);
+
+	// Pdelay_Req, Pdelay_Resp and Pdelay_Resp_Follow_Up templates of a PeerDelayLink
+	void build_peer_delay_templates(TransmitTemplates& templates, const PortIdentity& source, const Config& config);
+
+	namespace states {
+
+		class Initializing : public PtpStateBase
+		{
+		public:
+			Initializing(PtpPort& port);
+			~Initializing();
+
+			void on_announce_timeout();
+			void on_best_master_changed();
+			void on_message(const msg::Header& header, PacketHandle) override;
+
+		private:
+			PtpPort& port_;
+		};
+
+		class Faulty : public PtpStateBase
+		{
+		public:
+			Faulty(PtpPort& port);
+		};
+
+		class Listening : public PtpStateBase
+		{
+		public:
+			Listening(PtpPort& port);
+			~Listening();
+
+			void on_message(const msg::Header&, PacketHandle) override;
+			void on_best_master_changed();
+
+		private:
+#if !UPTP_SLAVE_ONLY
+			void on_announce_receipt_timeout();
+
+			TimerHandle announce_receipt_timer_;
+#endif
+			PtpPort& port_;
+		};
+
+		// Boundary clock port with another path to the grandmaster: neither
+		// synchronizes to it nor serves time on it.
+		class Passive : public PtpStateBase
+		{
+		public:
+			Passive(PtpPort& port);
+			~Passive();
+
+			void on_message(const msg::Header&, PacketHandle) override;
+			void on_best_master_changed();
+
+		private:
+			PtpPort& port_;
+		};
+
+		class Uncalibrated : public PtpStateBase
+		{
+		public:
+			Uncalibrated(PtpPort&);
+		};
+
+	}
+
+	// Recommended state of a port, see PtpClock::state_decision
+	enum class PortRole {
+		Listening,
+		Master,
+		Slave,
+		Passive
+	};
+
+	//
+	// A PTP port: one event/general socket pair with its own port state,
+	// foreign master tracking, transmit templates and link delay measurement.
+	// The local clock, servo and the state decision are shared through PtpClock.
+	//
+	class PtpPort : public PeerDelayLink
+	{
+	public:
+		PtpPort(PtpClock& clock, uint16 number);
+
+	public:
+		void enable();
+		void disable();
+
+		// Take over the sockets of this port, their callbacks are set by the port.
+		void attach(NetHandle event, NetHandle general);
+
+		// PTP over Ethernet: one NetRep carries event and general messages
+		void attach(NetHandle net);
+
+		// Send over sockets owned by someone else (MultiDomainClock), who
+		// forwards this port's messages and transmit completions.
+		void share(NetHandle& event, NetHandle& general);
+
+		// Rebuild the transmit templates after identity or parent changes
+		void on_identity_changed();
+
+		void on_general_message(PacketHandle packet);
+		void on_event_message(PacketHandle packet);
+
+		// Several received messages at once, see [NetRep]::on_received_batch.
+		// The packets are moved from.
+		void on_general_messages(PacketHandle* packets, size_t count);
+		void on_event_messages(PacketHandle* packets, size_t count);
+		void on_event_transmitted(uint32 id, Time time);
+
+		// Moves to the given role if the port isn't already in it
+		void apply(PortRole role, bool restart_slave);
+
+	public:
+		PtpClock& clock();
+		const PtpClock& clock() const;
+		SystemPort& get_system_port() override;
+		Config& get_config();
+		const Config& get_config() const override;
+		MasterTracker& master_tracker();
+		const MasterTracker& master_tracker() const;
+
+		NetHandle& event_port() override;
+		NetHandle& general_port() override;
+
+		PortIdentity& get_identity();
+		const PortIdentity& get_identity() const override;
+
+		// Header with this port's identity and the defaults for the given message type
+		msg::Header make_header(MessageTypes type) const;
+		uint32 transmit_id(MessageTypes type, uint16 sequence_id) const override;
+
+		// Receive timestamp of a packet in the time of this port's domain
+		Time receive_time(const PacketHandle& packet) const;
+
+		const TransmitTemplates& transmit_templates() const override;
+		const PeerDelay& peer_delay() const;
+		const UnicastClient& unicast_client() const;
+
+		// Signaling message with a single TLV to [address] on the general port
+		void send_signaling(const NetAddress& address, const PortIdentity& target, const msg::UnicastTransmissionTlv& tlv);
+
+		// Shared by all ports, only a Slave port drives it
+		ClockServo& servo();
+
+		bool is_locked() const;
+		void set_locked();
+
+	public:
+		// State machine
+		template< typename State, typename... Args >
+		void to_state(Args&&... args)
+		{
+			statemachine_.template to_state<State>(*this, std::forward<Args>(args)...);
+		}
+
+		template< typename T >
+		bool is() const {
+			return statemachine_.template is_state<T>();
+		}
+
+	private:
+		bool read_header(const PacketHandle& packet, msg::Header& header);
+		bool is_peer_delay(const msg::Header& header) const;
+		void dispatch(const msg::Header& header, PacketHandle packet);
+		void end_batch();
+		void build_transmit_templates();
+
+		NetHandle own_event_;
+		NetHandle own_general_;
+		NetHandle* event_port_;
+		NetHandle* general_port_;
+
+		PtpClock& clock_;
+		PortIdentity port_identity_;
+		MasterTracker master_tracker_;
+		TransmitTemplates transmit_templates_;
+		PeerDelay peer_delay_;
+		UnicastClient unicast_client_;
+		uint16 signaling_sequence_id_;
+
+		ulib::state_machine<
+			states::Initializing,
+			//states::Faulty,
+			states::Disabled,
+			states::Listening,
+			states::Slave,
+			states::Passive
+#if !UPTP_SLAVE_ONLY
+			, states::Master
+#endif
+			//states::Uncalibrated
+		> statemachine_;
+	};
+
+}
+
+#endif
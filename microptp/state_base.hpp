@@ -6,6 +6,8 @@
 #ifndef MICROPTP_STATE_BASE_HPP_
 #define MICROPTP_STATE_BASE_HPP_
 
+#include <microptp/ptpdatatypes.hpp>
+
 namespace uptp {
 
 	class PacketHandle;
@@ -22,6 +24,12 @@ namespace uptp {
 		{
 		public:
 			virtual void on_message(const msg::Header& header, PacketHandle) = 0;
+
+			// transmit timestamp of an event message the state sent
+			virtual void on_transmitted(uint32 id, Time time) { (void) id; (void) time; }
+
+			// the last message of a batch of received messages has been dispatched
+			virtual void on_batch_end() {}
 			virtual ~PtpStateBase() {}
 		};
 
@@ -13,9 +13,9 @@ namespace uptp { namespace states {
 	// Yup... disabled means... nothing
 	//
 
-	Disabled::Disabled(PtpClock& clock)
+	Disabled::Disabled(PtpPort& port)
 	{
-		clock.get_system_port().discipline(0);
+		port.clock().domain_clock().discipline(0);
 	}
 
 	void Disabled::on_message(const msg::Header&, PacketHandle)
@@ -10,14 +10,14 @@
 
 namespace uptp {
 
-	class PtpClock;
+	class PtpPort;
 
 namespace states {
 
 	class Disabled : public PtpStateBase
 	{
 	public:
-		Disabled(PtpClock& clock);
+		Disabled(PtpPort& port);
 
 		void on_message(const msg::Header&, PacketHandle) override;
 
@@ -9,10 +9,10 @@ namespace uptp {
 
 	namespace states {
 
-		Initializing::Initializing( PtpClock& clock )
-			: clock_(clock)
+		Initializing::Initializing( PtpPort& port )
+			: port_(port)
 		{
-			clock_.to_state<Disabled>();
+			port_.to_state<Disabled>();
 		}
 
 		Initializing::~Initializing()
@@ -4,19 +4,30 @@
 //          http://www.boost.org/LICENSE_1_0.txt)
 
 #include <microptp/ptpclock.hpp>
+#include <microptp/ports/systemport.hpp>
 
 namespace uptp {
 
 	namespace states {
 
-		Listening::Listening(PtpClock& clock)
-		: clock_(clock)
+		Listening::Listening(PtpPort& port)
+		: port_(port)
 		{
-			if(clock_.master_tracker().best_foreign()) {
-				on_best_master_changed();
-			} else {
-				clock_.master_tracker().best_master_changed = ulib::function<void()>(this, &Listening::on_best_master_changed);
+#if !UPTP_SLAVE_ONLY
+			// No better master announced itself within announce_receipt_timeout
+			// announce intervals: take over.
+			const auto& cfg = port_.get_config();
+			const int8 log_interval = cfg.log_announce_interval;
+			const uint32 interval_msecs = (log_interval >= 0) ? (1000u << log_interval) : (1000u >> -log_interval);
+
+			announce_receipt_timer_ = port_.get_system_port().make_timer(ulib::function<void()>(this, &Listening::on_announce_receipt_timeout));
+			if(announce_receipt_timer_) {
+				announce_receipt_timer_->start(cfg.announce_receipt_timeout * interval_msecs);
 			}
+#endif
+
+			// the clock decides across all ports, a better master may turn up on any of them
+			port_.master_tracker().best_master_changed = ulib::function<void()>(this, &Listening::on_best_master_changed);
 		}
 
 		void Listening::on_message(const msg::Header&, PacketHandle)
@@ -25,12 +36,27 @@ namespace uptp {
 
 		void Listening::on_best_master_changed()
 		{
-			clock_.to_state<Slave>();
+			port_.clock().state_decision(&port_);
 		}
 
+#if !UPTP_SLAVE_ONLY
+		void Listening::on_announce_receipt_timeout()
+		{
+			const auto role = port_.clock().recommended_state(port_);
+			if(role == PortRole::Listening || role == PortRole::Master) {
+				port_.to_state<Master>();
+			}
+		}
+#endif
+
 		Listening::~Listening()
 		{
-			clock_.master_tracker().best_master_changed.reset();
+#if !UPTP_SLAVE_ONLY
+			if(announce_receipt_timer_) {
+				announce_receipt_timer_->stop();
+			}
+#endif
+			port_.master_tracker().best_master_changed.reset();
 		}
 
 	}
@@ -0,0 +1,128 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <microptp/config.hpp>
+#include <microptp/ptpclock.hpp>
+#include <microptp/ports/systemport.hpp>
+
+#if !UPTP_SLAVE_ONLY
+
+namespace uptp {
+
+	namespace states {
+
+		Master::Master(PtpPort& port)
+			: announce_timer_(port.get_system_port()),
+			  sync_timer_(port.get_system_port()),
+			  delay_responder_(port),
+			  unicast_grantor_(port),
+			  announce_sequence_id_(0),
+			  sync_sequence_id_(0),
+			  port_(port)
+		{
+			PRINT("Entering master state.\n");
+
+			port_.master_tracker().best_master_changed = ulib::function<void()>(this, &Master::on_best_master_changed);
+
+			announce_timer_.on_expired = ulib::function<void()>(this, &Master::on_announce_timer);
+			sync_timer_.on_expired     = ulib::function<void()>(this, &Master::on_sync_timer);
+
+			if(!Config::unicast) {
+				const auto& cfg = port_.get_config();
+				announce_timer_.start(cfg.log_announce_interval);
+				sync_timer_.start(cfg.log_sync_interval);
+
+				on_announce_timer();
+			}
+		}
+
+		Master::~Master()
+		{
+			announce_timer_.stop();
+			sync_timer_.stop();
+			port_.master_tracker().best_master_changed.reset();
+		}
+
+		void Master::on_best_master_changed()
+		{
+			port_.clock().state_decision(&port_);
+		}
+
+		void Master::on_message(const msg::Header& header, PacketHandle packet)
+		{
+			if(header.is(MessageTypes::DelayRequest) && Config::delay_mechanism == Config::DelayMechanism::E2E) {
+				// unicast and hybrid slaves are answered at their own address
+				const bool unicast_request = (header.flag_field0 & uint8(msg::Header::Field0Flags::Unicast)) && packet->source_address();
+				const NetAddress address = unicast_request ? packet->source_address() : ptp_multicast_group;
+				if(!Config::unicast || unicast_grantor_.granted(address, UnicastStream::DelayResp)) {
+					delay_responder_.on_delay_req(header, port_.receive_time(packet), address);
+				}
+			} else if(Config::unicast && header.is(MessageTypes::Signaling)) {
+				unicast_grantor_.on_signaling(header, packet);
+			}
+		}
+
+		void Master::on_batch_end()
+		{
+			// answer the Delay_Reqs of a receive batch right away instead of waiting for the flush timer
+			delay_responder_.flush();
+		}
+
+		void Master::on_announce_timer()
+		{
+			auto& port = port_.general_port();
+			auto handle = port_.transmit_templates().announce.make(port, announce_sequence_id_++);
+
+			if(handle) {
+				TransmitTemplate<msg::Announce>::set_timestamp(handle, port_.clock().domain_clock().get_time());
+				port->send(ptp_multicast_group, general_port_number, std::move(handle), untracked_transmit_id);
+			}
+		}
+
+		void Master::on_sync_timer()
+		{
+			if(Config::gptp_profile && !port_.peer_delay().as_capable()) {
+				return;		// 802.1AS: no time transfer over a port that isn't asCapable
+			}
+
+			auto& port = port_.event_port();
+			const uint16 sequence_id = sync_sequence_id_++;
+			auto handle = port_.transmit_templates().sync.make(port, sequence_id);
+
+			if(handle) {
+				port->send(ptp_multicast_group, event_port_number, std::move(handle), port_.transmit_id(MessageTypes::Synch, sequence_id));
+			}
+		}
+
+		void Master::on_transmitted(uint32 id, Time time)
+		{
+			if(Config::unicast) {
+				unicast_grantor_.on_transmitted(id, time);
+				return;
+			}
+
+			if(transmit_type(id) != MessageTypes::Synch) {
+				return;
+			}
+
+			auto& port = port_.general_port();
+			auto handle = port_.transmit_templates().follow_up.make(port, static_cast<uint16>(id));
+
+			if(handle) {
+				TransmitTemplate<TransmitTemplates::follow_up_message>::set_timestamp(handle, time);
+				port->send(ptp_multicast_group, general_port_number, std::move(handle), untracked_transmit_id);
+			}
+		}
+
+		const DelayResponder& Master::delay_responder() const
+		{
+			return delay_responder_;
+		}
+
+	}
+
+}
+
+#endif
@@ -0,0 +1,65 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_STATE_MASTER_HPP__
+#define MICROPTP_STATE_MASTER_HPP__
+
+#include <microptp/config.hpp>
+#include <microptp/state_base.hpp>
+#include <microptp/ptpdatatypes.hpp>
+#include <microptp/interval_timer.hpp>
+#include <microptp/delay_responder.hpp>
+#include <microptp/unicast_grantor.hpp>
+
+#if !UPTP_SLAVE_ONLY
+
+namespace uptp {
+
+	class PtpPort;
+
+	namespace states {
+
+		//
+		// Two-step master: Announce and Sync are sent from interval timers,
+		// the Follow_Up goes out once the port reports the Sync's transmit
+		// timestamp. Delay_Reqs are handed to the batching DelayResponder.
+		// With Config::unicast the UnicastGrantor sends to the granted slaves
+		// instead, and Delay_Reqs of slaves without a Delay_Resp grant are dropped.
+		//
+		class Master : public PtpStateBase
+		{
+		public:
+			Master(PtpPort& port);
+			~Master();
+
+			void on_message(const msg::Header& header, PacketHandle) override;
+			void on_transmitted(uint32 id, Time time) override;
+			void on_batch_end() override;
+			void on_best_master_changed();
+
+			const DelayResponder& delay_responder() const;
+
+		private:
+			void on_announce_timer();
+			void on_sync_timer();
+
+			IntervalTimer announce_timer_;
+			IntervalTimer sync_timer_;
+			DelayResponder delay_responder_;
+			UnicastGrantor unicast_grantor_;
+
+			uint16 announce_sequence_id_;
+			uint16 sync_sequence_id_;
+
+			PtpPort& port_;
+		};
+
+	}
+
+}
+
+#endif
+
+#endif
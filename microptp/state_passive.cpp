@@ -0,0 +1,34 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <microptp/ptpclock.hpp>
+
+namespace uptp {
+
+	namespace states {
+
+		Passive::Passive(PtpPort& port)
+			: port_(port)
+		{
+			port_.master_tracker().best_master_changed = ulib::function<void()>(this, &Passive::on_best_master_changed);
+		}
+
+		void Passive::on_message(const msg::Header&, PacketHandle)
+		{
+		}
+
+		void Passive::on_best_master_changed()
+		{
+			port_.clock().state_decision(&port_);
+		}
+
+		Passive::~Passive()
+		{
+			port_.master_tracker().best_master_changed.reset();
+		}
+
+	}
+
+}
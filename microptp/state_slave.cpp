@@ -25,33 +25,29 @@ namespace uptp {
 				one_way_delay_buffer_.set(0);
 			}
 
-			void estimating_drift::on_sync(Slave& state, Time master_time, Time slave_time)
+			void estimating_drift::on_sync(Slave& state, Time master_time, Time slave_time, TimeInterval correction)
 			{
 				(void) state;
 
 				if(num_syncs_received_ == 0) {
 					first_sync_master_  = master_time;
 					first_sync_slave_ = slave_time;
+					first_sync_correction_ = correction;
 				}
 
 				uncorrected_offset_buffer_.add((
 							(master_time-first_sync_master_) - (slave_time-first_sync_slave_)
-						).to_nanos());
+						).to_nanos() + (correction - first_sync_correction_).to_nanos());
 
 				sync_master_ = master_time;
 				sync_slave_ = slave_time;
+				sync_correction_ = correction;
 
 				++num_syncs_received_;
 			}
 
-			void estimating_drift::on_delay(Slave& slave, Time master_time, Time slave_time)
+			void estimating_drift::on_delay(Slave& slave, Time master_time, Time slave_time, TimeInterval correction)
 			{
-				(void) slave;
-
-				using namespace fix;
-				using large_nanos_type = FIXED_RANGE_I(0, 16000000000ull);
-				using drift_type = FIXED_RANGE(0.99, 1.01, 32);
-
 				// We're assuming that 8*one_way_delay doesn't reach a second!
 				if(num_syncs_received_ >= 1 ) {
 					const auto& t0 = sync_master_;
@@ -60,28 +56,56 @@ namespace uptp {
 					const auto& t2 = slave_time;
 					const auto& t3 = master_time;
 
-					const int32 delay_nanos = (t3-t0 + t2-t1).to_nanos() / 2;
+					// path delay = ((t3-t0) - (t2-t1) - sync correction - delay_resp correction) / 2
+					const TimeInterval path = TimeInterval((t3-t0) - (t2-t1)) - sync_correction_ - correction;
+					on_path_delay(slave, path / 2, slave_time);
+				}
+			}
+
+			void estimating_drift::on_path_delay(Slave& slave, TimeInterval delay, Time slave_time)
+			{
+				(void) slave_time;
+
+				using namespace fix;
+				using large_nanos_type = FIXED_RANGE_I(0, 16000000000ull);
+				using drift_type = FIXED_RANGE(0.99, 1.01, 32);
+
+				if(num_syncs_received_ >= 1 ) {
+					const int32 delay_nanos = static_cast<int32>(delay.to_nanos());
 					one_way_delay_buffer_.add(delay_nanos);
 
 					if(ulib::abs(delay_nanos) > 50000000) {
 						TRACE("Bad delay on estimating one way delay (>50ms)\n");
 					}
 
-					if(num_syncs_received_ >= 8) {
-						const auto nom    = (sync_master_ - first_sync_master_);
-						const auto den    = (sync_slave_  - first_sync_slave_);
+					// 802.1AS rate ratios syntonize right away, otherwise the drift is estimated over 8 syncs
+					const bool syntonized = slave.grandmaster_rate_known_;
 
-						const large_nanos_type nom_nanos(nom.to_nanos());
-						const drift_type drift = div<fits<1,31>, positive>(nom_nanos, large_nanos_type(den.to_nanos()));
+					if(num_syncs_received_ >= 8 || syntonized) {
+						int32 ppb;
+						int32 mean_one_way_delay;
 
-						// We're really assuming that getting the first 8 syncs took less than 16 seconds here!
-						const auto drift_minus_one = drift-FIXED_CONSTANT_I(1);
-						const auto ppb_fixed = (drift_minus_one*FIXED_CONSTANT_I(1000000000u));
-						const auto ppb = ppb_fixed.to<int32>();
+						if(syntonized) {
+							ppb = slave.grandmaster_rate_offset_.to_ppb();
+							mean_one_way_delay = delay_nanos;
 
-						TRACE("Estimated ppb: %d\n", ppb);
+							TRACE("Grandmaster rate offset ppb: %d\n", ppb);
+						} else {
+							const auto nom    = (sync_master_ - first_sync_master_);
+							const auto den    = (sync_slave_  - first_sync_slave_);
+
+							const large_nanos_type nom_nanos(nom.to_nanos());
+							const drift_type drift = div<fits<1,31>, positive>(nom_nanos, large_nanos_type(den.to_nanos()));
 
-						int32 mean_one_way_delay = one_way_delay_buffer_.average();
+							// We're really assuming that getting the first 8 syncs took less than 16 seconds here!
+							const auto drift_minus_one = drift-FIXED_CONSTANT_I(1);
+							const auto ppb_fixed = (drift_minus_one*FIXED_CONSTANT_I(1000000000u));
+							ppb = ppb_fixed.to<int32>();
+
+							TRACE("Estimated ppb: %d\n", ppb);
+
+							mean_one_way_delay = one_way_delay_buffer_.average();
+						}
 
 						if(ulib::abs(mean_one_way_delay) > 50000000) {
 							TRACE("Bad mean delay on estimating one way delay (>50ms)\n");
@@ -91,14 +115,13 @@ namespace uptp {
 
 						// Fixme: use the mean offset + 1/2 * t * drift for a better estimate!
 						Time mean_uncorrected_offset = (sync_master_-sync_slave_);
-						Time offset = mean_uncorrected_offset + Time(0, mean_one_way_delay);
-						TRACE("Offsetting clock by %d secs %d nanos.\n", static_cast<int32>(offset.secs_), offset.nanos_);
+						Time offset = mean_uncorrected_offset + Time(0, mean_one_way_delay + static_cast<int32>(sync_correction_.to_nanos()));
+						TRACE("Offsetting clock by %d secs %d nanos.\n", static_cast<int32>(offset.secs()), offset.nanos());
 
-						auto& port = slave.clock_.get_system_port();
-						port.adjust_time(offset);
-						port.discipline(ppb);
 						slave.servo_.reset(ppb);		// initialize the servo integrator!
-						slave.states_.to_state<pi_operational>(mean_one_way_delay);
+						slave.servo_.correct(offset);	// steps or slews, then disciplines to ppb
+						slave.port_.set_locked();
+						slave.states_.to_state<pi_operational>(TimeInterval::from_nanos(mean_one_way_delay));
 					}
 				}
 			}
@@ -107,52 +130,67 @@ namespace uptp {
 			// pi_operational
 			//
 
-			pi_operational::pi_operational(int32 delay_nanos)
+			pi_operational::pi_operational(TimeInterval delay)
 				: last_time_(0,0)
 			{
 				//one_way_delay_buffer_.set(delay_nanos);
 				uncorrected_offset_buffer_.set(0);
-				one_way_delay_filter_.feed(delay_nanos);
+				one_way_delay_filter_.feed(delay.scaled_nanos_);
 			}
 
-			void pi_operational::on_sync(Slave& slave, Time master_time, Time slave_time)
+			void pi_operational::on_sync(Slave& slave, Time master_time, Time slave_time, TimeInterval correction)
 			{
-				(void) slave;
-
 				sync_master_ = master_time;
 				sync_slave_  = slave_time;
+				sync_correction_ = correction;
 				Time offset  = master_time - slave_time;
 
-				if(offset.secs_ != 0 || ulib::abs(offset.nanos_) > 50000000) {
-					TRACE("Bad estimatation preset! (secs: %d nanos: %d)\n", static_cast<int32>(offset.secs_), offset.nanos_);
+				if(offset.secs() != 0 || ulib::abs(offset.nanos()) > 50000000) {
+					TRACE("Bad estimatation preset! (secs: %d nanos: %d)\n", static_cast<int32>(offset.secs()), offset.nanos());
 				}
 
-				if(offset.secs_ == 0) {
+				if(offset.secs() == 0 && !slave.servo_.slewing()) {
 					//uncorrected_offset_filter_.feed(offset.nanos_);
-					uncorrected_offset_buffer_.add(offset.nanos_);
+					uncorrected_offset_buffer_.add((TimeInterval(offset) + correction).scaled_nanos_);
 				}
 			}
 
-			void pi_operational::on_delay(Slave& slave, Time master_time, Time slave_time)
+			void pi_operational::on_delay(Slave& slave, Time master_time, Time slave_time, TimeInterval correction)
 			{
 				const auto& t0 = sync_master_;
 				const auto& t1 = sync_slave_;
 				const auto& t2 = slave_time;
 				const auto& t3 = master_time;
 
-				const Time one_way_delay = ((t3-t0)-(t2-t1))/2;
+				const Time round_trip = (t3-t0)-(t2-t1);
 
-				if((one_way_delay.secs_ != 0) || (ulib::abs(one_way_delay.nanos_) > 50000000)) {
-					TRACE("PI Operational: Bad One-Way Delay: %d\n", one_way_delay.nanos_);
-				}
+				if(round_trip.secs() == 0) {
+					const TimeInterval one_way_delay = (TimeInterval(round_trip) - sync_correction_ - correction) / 2;
 
-				if(one_way_delay.secs_ == 0) {
-					one_way_delay_filter_.feed(one_way_delay.nanos_);
+					if(ulib::abs(one_way_delay.to_nanos()) > 50000000) {
+						TRACE("PI Operational: Bad One-Way Delay: %d\n", static_cast<int32>(one_way_delay.to_nanos()));
+					}
+
+					one_way_delay_filter_.feed(one_way_delay.scaled_nanos_);
 					//one_way_delay_buffer_.add(one_way_delay.nanos_);
+				} else {
+					TRACE("PI Operational: Bad One-Way Delay (secs: %d)\n", static_cast<int32>(round_trip.secs()));
 				}
 
-				if(last_time_.secs_ != 0) {
-					int32 offset = uncorrected_offset_buffer_.average() + one_way_delay_filter_.get();
+				update_servo(slave, slave_time);
+			}
+
+			void pi_operational::on_path_delay(Slave& slave, TimeInterval delay, Time slave_time)
+			{
+				one_way_delay_filter_.feed(delay.scaled_nanos_);
+				update_servo(slave, slave_time);
+			}
+
+			void pi_operational::update_servo(Slave& slave, Time slave_time)
+			{
+				if(last_time_.secs() != 0) {
+					const TimeInterval filtered(uncorrected_offset_buffer_.average() + one_way_delay_filter_.get());
+					int32 offset = static_cast<int32>(filtered.to_nanos());
 					//int32 offset = uncorrected_offset_filter_.get() + one_way_delay_filter_.get();
 					uint32 dt    = static_cast<uint32>((slave_time - last_time_).to_nanos());
 					slave.servo_.feed(dt, offset);
@@ -163,96 +201,102 @@ namespace uptp {
 
 		}
 
-		Slave::Slave(PtpClock& clock)
+		Slave::Slave(PtpPort& port)
 			:
 			  sync_serial_(0),
 			  delay_req_id_(4434),
 			  sync_state_(slave_detail::SyncState::Initial),
 			  dreq_state_(slave_detail::DreqState::Initial),
-			  servo_(clock),
-			  clock_(clock)
+			  grandmaster_rate_known_(false),
+			  servo_(port.servo()),
+			  port_(port)
 		{
-			clock_.master_tracker().best_master_changed = ulib::function<void()>(this, &Slave::on_best_master_changed);
-			servo_.output = ulib::function<void(int32)>(&clock.get_system_port(), &SystemPort::discipline);
-			clock_.event_port()->on_transmit_completed = ulib::function<void(uint32, Time)>(this, &Slave::on_delay_request_transmitted);
+			port_.master_tracker().best_master_changed = ulib::function<void()>(this, &Slave::on_best_master_changed);
+			servo_.output = ulib::function<void(int32)>(&port.clock().domain_clock(), &VirtualClock::discipline);
 
 			states_.to_state<slave_detail::estimating_drift>();
 		}
 
 		Slave::~Slave()
 		{
-			clock_.master_tracker().best_master_changed.reset();
+			servo_.cancel_slew();
+			port_.master_tracker().best_master_changed.reset();
 			servo_.output.reset();
-			clock_.event_port()->on_transmit_completed.reset();
 		}
 
 		void Slave::on_message(const msg::Header& header, PacketHandle packet_handle)
 		{
+			if (Config::gptp_profile && !port_.peer_delay().as_capable() && (header.is(MessageTypes::Synch) || header.is(MessageTypes::FollowUp))) {
+				return;		// 802.1AS: no time transfer over a port that isn't asCapable
+			}
+
 			if (header.is(MessageTypes::Synch)) {
 				msg::Sync sync;
 				msg::deserialize(packet_handle->get_data(), sync);
 
+				const TimeInterval correction(header.correction_field);
+
 				if(header.flag_field0 & uint8(msg::Header::Field0Flags::TwoStep)) {
-					on_sync(header.sequence_id, packet_handle->time());
+					on_sync(header.sequence_id, port_.receive_time(packet_handle), correction);
 				} else {
-					on_sync(header.sequence_id, packet_handle->time(), sync.origin_timestamp);
+					on_sync(header.sequence_id, port_.receive_time(packet_handle), sync.origin_timestamp, correction);
+				}
+				if(Config::delay_mechanism == Config::DelayMechanism::E2E) {
+					send_delay_request();	// no timers yet :(
 				}
-				send_delay_request();	// no timers yet :(
 			} else if( header.is(MessageTypes::FollowUp)) {
 				msg::FollowUp follow_up;
 				msg::deserialize(packet_handle->get_data(), follow_up);
-				on_sync_followup(header.sequence_id, follow_up.precise_origin_timestamp);
+
+				if (Config::gptp_profile && header.message_length >= msg::message_size<msg::GptpFollowUp>()) {
+					on_follow_up_information(packet_handle);
+				}
+
+				on_sync_followup(header.sequence_id, follow_up.precise_origin_timestamp, TimeInterval(header.correction_field));
 			} else if (header.is(MessageTypes::DelayResp)) {
 				msg::DelayResp delayresp;
 				msg::deserialize(packet_handle->get_data(), delayresp);
 				auto& source_identity = header.source_port_identity;
-				auto& best_identity   = clock_.master_tracker().best_foreign()->port_identity;
+				auto& best_identity   = port_.master_tracker().best_foreign()->port_identity;
 				auto& dresp_identity  = delayresp.port_identity;
-				auto& this_identity   = clock_.get_identity();
+				auto& this_identity   = port_.get_identity();
 
 				if ( source_identity == best_identity && dresp_identity == this_identity )
 				{
-					on_request_answered(delayresp.timestamp);
+					on_request_answered(delayresp.timestamp, TimeInterval(header.correction_field));
 				}
 			}
 		}
 
 		void Slave::send_delay_request()
 		{
-			auto& port = clock_.event_port();
-			auto buffer_handle = port->acquire_transmit_handle();
-
-			msg::Header header;
-			msg::DelayReq dreq;
-			header.source_port_identity = clock_.get_identity();
-			header.log_message_interval = 0x7F;
-			header.control_field = 1;
-			header.flag_field0 = header.flag_field1 = 0;
-			header.correction_field = 0;
-			header.domain_number = 0;
-			header.message_length = 44;
-			header.version_ptp = 2;
-			header.transport_specific = 8;
-			header.message_type = static_cast<uint8>(MessageTypes::DelayRequest);
-			header.sequence_id = 0xFFFF0000 | delay_req_id_;
-
-			dreq.timestamp = Time(0ull);
-
-			msg::serialize(buffer_handle->get_data(), header);
-			msg::serialize(buffer_handle->get_data(), dreq);
-
-			buffer_handle->set_size(44);
-
-			port->send((224 << 0) | (0<<8) | (1<<16) | (129 << 24), 319, std::move(buffer_handle), 0xFFFF0000 | delay_req_id_);
+			auto& port = port_.event_port();
+			const auto* master = port_.master_tracker().best_foreign();
+			NetAddress address = ptp_multicast_group;
+			if(Config::unicast) {
+				address = master ? port_.unicast_client().master_address(master->port_identity) : NetAddress();
+			} else if(Config::hybrid && master && master->address) {
+				address = master->address;	// only the master sees our requests, only we see its responses
+			}
+
+			if(!address) {
+				return;
+			}
+
+			auto buffer_handle = port_.transmit_templates().delay_req.make(port, delay_req_id_);
+
+			if(buffer_handle) {
+				// hybrid requests fall back to multicast while the master's address is unknown
+				if(Config::hybrid && address != ptp_multicast_group) {
+					TransmitTemplate<msg::DelayReq>::set<msg::layouts::header_flag_field0>(buffer_handle, uint8(msg::Header::Field0Flags::Unicast));
+				}
+				port->send(address, event_port_number, std::move(buffer_handle), port_.transmit_id(MessageTypes::DelayRequest, delay_req_id_));
+			}
 		}
 
 		void Slave::on_best_master_changed()
 		{
-			if(clock_.master_tracker().best_foreign()) {
-				clock_.to_state<Slave>();
-			} else {
-				clock_.to_state<Listening>();
-			}
+			port_.clock().state_decision(&port_);
 		}
 
 		void Slave::on_delay_req_timer()
@@ -260,55 +304,84 @@ namespace uptp {
 			// Timers to be implemented
 		}
 
-		void Slave::on_delay_request_transmitted(uint32 id, Time when)
+		void Slave::on_transmitted(uint32 id, Time when)
 		{
-			(void) id;
+			if(transmit_type(id) != MessageTypes::DelayRequest) {
+				return;
+			}
 
 			dreq_send_ = when;
 			dreq_state_ = slave_detail::DreqState::DreqSent;
 			++delay_req_id_;
 		}
 
-		void Slave::on_request_answered(const Time& dreq_receive)
+		void Slave::on_request_answered(const Time& dreq_receive, const TimeInterval& correction)
 		{
 			if(dreq_state_ == slave_detail::DreqState::DreqSent) {
 				states_.dispatch_self <
 					ulib::case_<slave_detail::pi_operational, METHOD(&slave_detail::pi_operational::on_delay)>,
 					ulib::case_<slave_detail::estimating_drift, METHOD(&slave_detail::estimating_drift::on_delay)>
-				>(*this, dreq_receive, dreq_send_);
+				>(*this, dreq_receive, dreq_send_, correction);
 				
 				dreq_state_ = slave_detail::DreqState::Initial;
 			}
 		}
 
-		void Slave::on_sync(uint16 serial, const Time& receive_time, const Time& send_time)
+		void Slave::on_sync(uint16 serial, const Time& receive_time, const Time& send_time, const TimeInterval& correction)
 		{
 			(void) serial;
 
 			states_.dispatch_self <
 				ulib::case_<slave_detail::pi_operational,   METHOD(&slave_detail::pi_operational::on_sync)>,
 				ulib::case_<slave_detail::estimating_drift, METHOD(&slave_detail::estimating_drift::on_sync)>
-			>(*this, send_time, receive_time);
+			>(*this, send_time, receive_time, correction);
 
+			on_sync_completed(receive_time);
 			sync_state_ = slave_detail::SyncState::Initial;
 		}
 
+		void Slave::on_follow_up_information(const PacketHandle& packet_handle)
+		{
+			msg::GptpFollowUp follow_up;
+			msg::deserialize(packet_handle->get_data(), follow_up);
+
+			// grandmaster rate / our rate = (grandmaster rate / master rate) * (master rate / our rate)
+			if (msg::is_follow_up_information(follow_up.information) && port_.peer_delay().rate_ratio_valid()) {
+				grandmaster_rate_offset_ = RateOffset(follow_up.information.cumulative_scaled_rate_offset) * port_.peer_delay().neighbor_rate_offset();
+				grandmaster_rate_known_ = true;
+			}
+		}
+
+		void Slave::on_sync_completed(const Time& receive_time)
+		{
+			// P2P: the Sync's correction already holds the upstream link delays,
+			// only our own link is left, measured by the port's PeerDelay.
+			if(Config::delay_mechanism == Config::DelayMechanism::P2P && port_.peer_delay().valid()) {
+				states_.dispatch_self <
+					ulib::case_<slave_detail::pi_operational, METHOD(&slave_detail::pi_operational::on_path_delay)>,
+					ulib::case_<slave_detail::estimating_drift, METHOD(&slave_detail::estimating_drift::on_path_delay)>
+				>(*this, port_.peer_delay().link_delay(), receive_time);
+			}
+		}
+
 		// Two-Step
-		void Slave::on_sync(uint16 serial, const Time& receive_time)
+		void Slave::on_sync(uint16 serial, const Time& receive_time, const TimeInterval& correction)
 		{
 			sync_receive_ = receive_time;
+			sync_correction_ = correction;
 			sync_serial_ = serial;
 			sync_state_ = slave_detail::SyncState::SyncTwoStepReceived;
 		}
 
-		void Slave::on_sync_followup(uint16 serial, const Time& send_time)
+		void Slave::on_sync_followup(uint16 serial, const Time& send_time, const TimeInterval& correction)
 		{
 			if(sync_state_ == slave_detail::SyncState::SyncTwoStepReceived && serial == sync_serial_) {
 				states_.dispatch_self <
 					ulib::case_<slave_detail::pi_operational, METHOD(&slave_detail::pi_operational::on_sync)>,
 					ulib::case_<slave_detail::estimating_drift, METHOD(&slave_detail::estimating_drift::on_sync)>
-				>(*this, send_time, sync_receive_);
+				>(*this, send_time, sync_receive_, sync_correction_ + correction);
 
+				on_sync_completed(sync_receive_);
 				sync_state_ = slave_detail::SyncState::Initial;
 			} else {
 				sync_state_ = slave_detail::SyncState::Initial;
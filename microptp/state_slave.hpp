@@ -13,7 +13,7 @@
 
 namespace uptp {
 
-	class PtpClock;
+	class PtpPort;
 
 	namespace states {
 
@@ -65,35 +65,42 @@ namespace uptp {
 				// PTP-Delay-Calculation introduces an error term linear in drift!
 				estimating_drift();
 
-				void on_sync (Slave& state,  Time master_time, Time slave_time);
-				void on_delay(Slave& state,  Time master_time, Time slave_time);
+				void on_sync (Slave& state,  Time master_time, Time slave_time, TimeInterval correction);
+				void on_delay(Slave& state,  Time master_time, Time slave_time, TimeInterval correction);
+				void on_path_delay(Slave& state, TimeInterval delay, Time slave_time);
 
 				uint16 num_syncs_received_;
 				Time   first_sync_master_;
 				Time   first_sync_slave_;
+				TimeInterval first_sync_correction_;
 
 				Time sync_master_;
 				Time sync_slave_;
+				TimeInterval sync_correction_;
 
 				ulib::circular_averaging_buffer<int32, 8> one_way_delay_buffer_;		// if the drift is bad, delay can actually be negative!
 				ulib::circular_averaging_buffer<int64,  8> uncorrected_offset_buffer_;
 			};
 
 			struct pi_operational {
-				pi_operational(int32 delay_nanos);
+				pi_operational(TimeInterval delay);
 
-				void on_sync(Slave& state, Time master_time, Time slave_time);
-				void on_delay(Slave& state, Time master_time, Time slave_time);
+				void on_sync(Slave& state, Time master_time, Time slave_time, TimeInterval correction);
+				void on_delay(Slave& state, Time master_time, Time slave_time, TimeInterval correction);
+				void on_path_delay(Slave& state, TimeInterval delay, Time slave_time);
+				void update_servo(Slave& state, Time slave_time);
 
 				Time sync_master_;
 				Time sync_slave_;
+				TimeInterval sync_correction_;
 				Time last_time_;
 
-				median_filter<int32, 7, 3> one_way_delay_filter_;
+				// filters run on TimeInterval::scaled_nanos_ to keep the sub-nanosecond part of corrections
+				median_filter<int64, 7, 3> one_way_delay_filter_;
 //				median_filter<int32, 7, 3> uncorrected_offset_filter_;
 
 //				ulib::circular_averaging_buffer<int32, 4> one_way_delay_buffer_;		// if the drift is bad, delay can actually be negative!
-				ulib::circular_averaging_buffer<int32, 4> uncorrected_offset_buffer_;
+				ulib::circular_averaging_buffer<int64, 4> uncorrected_offset_buffer_;
 			};
 
 
@@ -111,27 +118,29 @@ namespace uptp {
 		class Slave : public PtpStateBase
 		{
 		public:
-			Slave(PtpClock& clock);
+			Slave(PtpPort& port);
 			~Slave();
 
 			void on_delay_req_timer();
 			void on_message(const msg::Header&, PacketHandle) override;
+			void on_transmitted(uint32 id, Time time) override;
 			void on_best_master_changed();
 
 		private:
 			void send_delay_request();
-			void on_delay_request_transmitted(uint32 id, Time time);
+			void on_sync_completed(const Time& receive_time);
+			void on_follow_up_information(const PacketHandle& packet_handle);
 
 			// One-Step
-			void on_sync         (uint16 serial, const Time& receive_time, const Time& send_time);
+			void on_sync         (uint16 serial, const Time& receive_time, const Time& send_time, const TimeInterval& correction);
 
 			// Two-Step
-			void on_sync         (uint16 serial, const Time& receive_time);
-			void on_sync_followup(uint16 serial, const Time& send_time);
+			void on_sync         (uint16 serial, const Time& receive_time, const TimeInterval& correction);
+			void on_sync_followup(uint16 serial, const Time& send_time, const TimeInterval& correction);
 
 			void do_delay_request();
 			void on_request_sent    (const Time& dreq_send);
-			void on_request_answered(const Time& dreq_receive);
+			void on_request_answered(const Time& dreq_receive, const TimeInterval& correction);
 
 		private:
 			friend class slave_detail::estimating_drift;
@@ -140,6 +149,7 @@ namespace uptp {
 			ulib::state_machine<slave_detail::estimating_drift, slave_detail::pi_operational> states_;
 
 			Time sync_receive_;	/* sync receive time from slave */
+			TimeInterval sync_correction_;	/* correction field of a two-step sync */
 			Time dreq_send_;	/* delay request time from slave */
 			Time dreq_receive_;	/* delay reques answer from master */
 
@@ -148,8 +158,11 @@ namespace uptp {
 			slave_detail::SyncState sync_state_;
 			slave_detail::DreqState dreq_state_;
 
-			ClockServo servo_;
-			PtpClock& clock_;
+			RateOffset grandmaster_rate_offset_;	/* 802.1AS: cumulative rate offset including our link */
+			bool grandmaster_rate_known_;
+
+			ClockServo& servo_;	/* shared by all ports of the clock */
+			PtpPort& port_;
 		};
 
 	}
@@ -0,0 +1,52 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_TESTS_BENCH_HPP__
+#define MICROPTP_TESTS_BENCH_HPP__
+
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+
+namespace uptp {
+
+	namespace bench {
+
+		// keeps the compiler from dropping a result nobody reads
+		template< typename T >
+		inline void keep(const T& value)
+		{
+			asm volatile("" : : "r,m"(value) : "memory");
+		}
+
+		//
+		// Runs body(i) for i in [0, iterations) and prints the nanoseconds per
+		// call, the best of five rounds so a preempted round doesn't count.
+		//
+		template< typename Body >
+		void run(const char* name, size_t iterations, Body&& body)
+		{
+			double best = 0;
+			for(int round = 0; round < 5; ++round) {
+				const auto start = std::chrono::steady_clock::now();
+				for(size_t i = 0; i < iterations; ++i) {
+					body(i);
+				}
+				const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+				const double per_call = elapsed.count() / iterations;
+				if(round == 0 || per_call < best) {
+					best = per_call;
+				}
+			}
+
+			std::printf("%-36s %7.2f ns\n", name, best);
+		}
+
+	}
+
+}
+
+#endif
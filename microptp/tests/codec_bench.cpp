@@ -0,0 +1,104 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// The byte order layer at unaligned offsets and whole messages through the
+// layout tables
+
+#include <microptp_config.hpp>
+#include <microptp/messages.hpp>
+#include <array>
+#include "bench.hpp"
+
+using namespace uptp;
+
+namespace {
+
+	const size_t iterations = 10000000;
+
+	msg::Header make_header(MessageTypes type)
+	{
+		msg::Header header = {};
+		header.source_port_identity.clock.identity = {{ 0x00, 0x80, 0xC2, 0xFF, 0xFE, 0x12, 0x34, 0x56 }};
+		header.source_port_identity.port = 1;
+		header.correction_field = 0x123456789ll;
+		header.message_length = 64;
+		header.sequence_id = 4711;
+		header.message_type = static_cast<uint8>(type);
+		header.version_ptp = 2;
+		header.log_message_interval = -3;
+		return header;
+	}
+
+	// the message after the header, serialized and read back
+	template< typename Message >
+	void run_message(const char* serialize_name, const char* deserialize_name, const msg::Header& header, Message body)
+	{
+		std::array<uint8, msg::message_size<Message>()> buffer = {};
+
+		bench::run(serialize_name, iterations, [&](size_t i) {
+			msg::Header patched = header;
+			patched.sequence_id = uint16(i);
+			msg::serialize(buffer.data(), patched);
+			msg::serialize(buffer.data(), body);
+			bench::keep(buffer);
+		});
+
+		bench::run(deserialize_name, iterations, [&](size_t i) {
+			buffer[31] = uint8(i);
+			msg::Header read_header;
+			Message read_body;
+			msg::deserialize(buffer.data(), read_header);
+			msg::deserialize(buffer.data(), read_body);
+			bench::keep(read_header);
+			bench::keep(read_body);
+		});
+	}
+
+}
+
+int main()
+{
+	// odd offsets, as the fields of a header at the start of a buffer mostly are
+	std::array<uint8, 64> buffer = {};
+
+	bench::run("load_net<uint16/32/64> unaligned", iterations, [&](size_t i) {
+		buffer[1] = uint8(i);
+		bench::keep(system::load_net<uint16>(buffer.data() + 1));
+		bench::keep(system::load_net<uint32>(buffer.data() + 3));
+		bench::keep(system::load_net<uint64>(buffer.data() + 7));
+	});
+
+	bench::run("store_net<uint16/32/64> unaligned", iterations, [&](size_t i) {
+		system::store_net<uint16>(buffer.data() + 1, uint16(i));
+		system::store_net<uint32>(buffer.data() + 3, uint32(i));
+		system::store_net<uint64>(buffer.data() + 7, uint64(i));
+		bench::keep(buffer);
+	});
+
+	msg::Announce announce = {};
+	announce.origin_timestamp = Time(1700000000ll, 123456789);
+	announce.grandmaster_clock_quality = { 0xFFFF, 248, 0xFE };
+	announce.current_utc_offset = 37;
+	announce.grandmaster_priority1 = 128;
+	announce.grandmaster_priority2 = 128;
+	announce.time_source = 0xA0;
+	run_message("Announce serialize", "Announce deserialize", make_header(MessageTypes::Announce), announce);
+
+	msg::Sync sync;
+	sync.origin_timestamp = Time(1700000000ll, 123456789);
+	run_message("Sync serialize", "Sync deserialize", make_header(MessageTypes::Synch), sync);
+
+	msg::DelayResp delay_resp;
+	delay_resp.timestamp = Time(1700000000ll, 123456789);
+	delay_resp.port_identity.port = 2;
+	run_message("Delay_Resp serialize", "Delay_Resp deserialize", make_header(MessageTypes::DelayResp), delay_resp);
+
+	msg::PDelayResp pdelay_resp;
+	pdelay_resp.timestamp = Time(1700000000ll, 123456789);
+	pdelay_resp.port_identity.port = 2;
+	run_message("Pdelay_Resp serialize", "Pdelay_Resp deserialize", make_header(MessageTypes::PeerDelayResp), pdelay_resp);
+
+	return 0;
+}
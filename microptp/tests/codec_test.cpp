@@ -0,0 +1,346 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// The message layout tables against hand-written wire bytes, and back
+
+#include <microptp_config.hpp>
+#include <microptp/messages.hpp>
+#include <array>
+#include <cstdio>
+#include <cstring>
+
+using namespace uptp;
+
+namespace {
+
+	int failures = 0;
+
+	void check(bool condition, const char* name, const char* what)
+	{
+		if(!condition) {
+			std::printf("FAILED: %s: %s\n", name, what);
+			++failures;
+		}
+	}
+
+	template< size_t Size >
+	void check_bytes(const char* name, const uint8* actual, const std::array<uint8, Size>& golden)
+	{
+		for(size_t i = 0; i < Size; ++i) {
+			if(actual[i] != golden[i]) {
+				std::printf("FAILED: %s: byte %zu is 0x%02X, not 0x%02X\n", name, i, actual[i], golden[i]);
+				++failures;
+				return;
+			}
+		}
+	}
+
+	// clock identities 00:80:C2:FF:FE:12:34:56 and AA:BB:CC:FF:FE:DD:EE:01
+	const PortIdentity source_identity({{ 0x00, 0x80, 0xC2, 0x12, 0x34, 0x56 }}, 1);
+	const PortIdentity requester_identity({{ 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0x01 }}, 0x0203);
+
+	const Time timestamp = Time(1700000000ll, 123456789);
+
+// 1700000000 s 123456789 ns
+#define TIMESTAMP_BYTES 0x00, 0x00, 0x65, 0x53, 0xF1, 0x00, 0x07, 0x5B, 0xCD, 0x15
+
+	msg::Header make_header(MessageTypes type, uint16 length, uint8 control, int8 log_interval)
+	{
+		msg::Header header;
+		header.source_port_identity = source_identity;
+		header.correction_field = -0x123456789ll;
+		header.message_length = length;
+		header.sequence_id = 0x1267;
+		header.transport_specific = 1;
+		header.message_type = static_cast<uint8>(type);
+		header.version_ptp = 2;
+		header.domain_number = 24;
+		header.flag_field0 = uint8(msg::Header::Field0Flags::TwoStep);
+		header.flag_field1 = uint8(msg::Header::Field1Flags::PtpTimescale);
+		header.control_field = control;
+		header.log_message_interval = log_interval;
+		return header;
+	}
+
+// the header make_header writes, with the message type, length, control field and log interval
+#define HEADER_BYTES(type, length, control, log_interval) \
+	uint8(0x10 | (type)), 0x02, uint8((length) >> 8), uint8(length), 24, 0x00, 0x02, 0x08, \
+	0xFF, 0xFF, 0xFF, 0xFE, 0xDC, 0xBA, 0x98, 0x77, \
+	0x00, 0x00, 0x00, 0x00, \
+	0x00, 0x80, 0xC2, 0xFF, 0xFE, 0x12, 0x34, 0x56, 0x00, 0x01, \
+	0x12, 0x67, (control), uint8(log_interval)
+
+	void check_header(const char* name, const msg::Header& read, const msg::Header& written)
+	{
+		check(read.source_port_identity == written.source_port_identity, name, "header source port identity");
+		check(read.correction_field == written.correction_field, name, "header correction");
+		check(read.message_length == written.message_length, name, "header message length");
+		check(read.sequence_id == written.sequence_id, name, "header sequence id");
+		check(read.transport_specific == written.transport_specific, name, "header transport specific");
+		check(read.message_type == written.message_type, name, "header message type");
+		check(read.version_ptp == written.version_ptp, name, "header version");
+		check(read.domain_number == written.domain_number, name, "header domain");
+		check(read.flag_field0 == written.flag_field0 && read.flag_field1 == written.flag_field1, name, "header flags");
+		check(read.control_field == written.control_field, name, "header control field");
+		check(read.log_message_interval == written.log_message_interval, name, "header log interval");
+	}
+
+	//
+	// Serializes header and body, compares with the golden bytes and reads both back
+	//
+	template< typename Message, size_t Size >
+	void round_trip(const char* name, const msg::Header& header, const Message& body, const std::array<uint8, Size>& golden, Message& read)
+	{
+		static_assert(msg::message_size<Message>() == Size, "golden bytes of the whole message");
+
+		std::array<uint8, Size> buffer;
+		buffer.fill(0xA5);	// reserved fields must be written
+		msg::serialize(buffer.data(), header);
+		msg::serialize(buffer.data(), body);
+		check_bytes(name, buffer.data(), golden);
+
+		msg::Header read_header;
+		msg::deserialize(golden.data(), read_header);
+		msg::deserialize(golden.data(), read);
+		check_header(name, read_header, header);
+	}
+
+	void sync()
+	{
+		const std::array<uint8, 44> golden = {{
+			HEADER_BYTES(0x0, 44, 0x00, -3),
+			TIMESTAMP_BYTES
+		}};
+
+		msg::Sync sync;
+		sync.origin_timestamp = timestamp;
+		msg::Sync read;
+		round_trip("sync", make_header(MessageTypes::Synch, 44, 0x00, -3), sync, golden, read);
+		check(read.origin_timestamp == timestamp, "sync", "origin timestamp");
+	}
+
+	void announce()
+	{
+		const std::array<uint8, 64> golden = {{
+			HEADER_BYTES(0xB, 64, 0x05, 1),
+			TIMESTAMP_BYTES,
+			0x00, 0x25,				// currentUtcOffset
+			0x00,
+			0x80,					// grandmasterPriority1
+			0xF8, 0xFE, 0xFF, 0xFF,	// grandmasterClockQuality
+			0x7F,					// grandmasterPriority2
+			0xAA, 0xBB, 0xCC, 0xFF, 0xFE, 0xDD, 0xEE, 0x01,
+			0x00, 0x02,				// stepsRemoved
+			0xA0					// timeSource
+		}};
+
+		msg::Announce announce;
+		announce.origin_timestamp = timestamp;
+		announce.grandmaster_clock_quality = { 0xFFFF, 248, 0xFE };
+		announce.grandmaster_identity = requester_identity.clock;
+		announce.current_utc_offset = 37;
+		announce.steps_removed = 2;
+		announce.grandmaster_priority1 = 128;
+		announce.grandmaster_priority2 = 127;
+		announce.time_source = 0xA0;
+
+		msg::Announce read;
+		round_trip("announce", make_header(MessageTypes::Announce, 64, 0x05, 1), announce, golden, read);
+		check(read.origin_timestamp == timestamp, "announce", "origin timestamp");
+		check(read.grandmaster_clock_quality == announce.grandmaster_clock_quality, "announce", "clock quality");
+		check(read.grandmaster_identity == announce.grandmaster_identity, "announce", "grandmaster identity");
+		check(read.current_utc_offset == 37 && read.steps_removed == 2, "announce", "utc offset and steps removed");
+		check(read.grandmaster_priority1 == 128 && read.grandmaster_priority2 == 127, "announce", "priorities");
+		check(read.time_source == 0xA0, "announce", "time source");
+	}
+
+	void delay_resp()
+	{
+		const std::array<uint8, 54> golden = {{
+			HEADER_BYTES(0x9, 54, 0x03, -4),
+			TIMESTAMP_BYTES,
+			0xAA, 0xBB, 0xCC, 0xFF, 0xFE, 0xDD, 0xEE, 0x01, 0x02, 0x03
+		}};
+
+		msg::DelayResp resp;
+		resp.timestamp = timestamp;
+		resp.port_identity = requester_identity;
+
+		msg::DelayResp read;
+		round_trip("delay_resp", make_header(MessageTypes::DelayResp, 54, 0x03, -4), resp, golden, read);
+		check(read.timestamp == timestamp, "delay_resp", "receive timestamp");
+		check(read.port_identity == requester_identity, "delay_resp", "requesting port identity");
+	}
+
+	// requestReceiptTimestamp first, requestingPortIdentity after it
+	void pdelay_resp()
+	{
+		const std::array<uint8, 54> golden = {{
+			HEADER_BYTES(0x3, 54, 0x05, 0x7F),
+			TIMESTAMP_BYTES,
+			0xAA, 0xBB, 0xCC, 0xFF, 0xFE, 0xDD, 0xEE, 0x01, 0x02, 0x03
+		}};
+
+		msg::PDelayResp resp;
+		resp.timestamp = timestamp;
+		resp.port_identity = requester_identity;
+
+		msg::PDelayResp read;
+		round_trip("pdelay_resp", make_header(MessageTypes::PeerDelayResp, 54, 0x05, 0x7F), resp, golden, read);
+		check(read.timestamp == timestamp, "pdelay_resp", "request receipt timestamp");
+		check(read.port_identity == requester_identity, "pdelay_resp", "requesting port identity");
+	}
+
+	void pdelay_resp_follow_up()
+	{
+		const std::array<uint8, 54> golden = {{
+			HEADER_BYTES(0xA, 54, 0x05, 0x7F),
+			TIMESTAMP_BYTES,
+			0xAA, 0xBB, 0xCC, 0xFF, 0xFE, 0xDD, 0xEE, 0x01, 0x02, 0x03
+		}};
+
+		msg::PDelayRespFollowUp follow_up;
+		follow_up.precise_origin_timestamp = timestamp;
+		follow_up.port_identity = requester_identity;
+
+		msg::PDelayRespFollowUp read;
+		round_trip("pdelay_resp_follow_up", make_header(MessageTypes::PeerDelayRespFollowUp, 54, 0x05, 0x7F), follow_up, golden, read);
+		check(read.precise_origin_timestamp == timestamp, "pdelay_resp_follow_up", "response origin timestamp");
+		check(read.port_identity == requester_identity, "pdelay_resp_follow_up", "requesting port identity");
+	}
+
+	// A Signaling message carrying a request, a grant and a cancel TLV
+	void signaling()
+	{
+		const char* name = "signaling";
+		const std::array<uint8, 72> golden = {{
+			HEADER_BYTES(0xC, 72, 0x05, 0x7F),
+			0xAA, 0xBB, 0xCC, 0xFF, 0xFE, 0xDD, 0xEE, 0x01, 0x02, 0x03,
+			0x00, 0x04, 0x00, 0x06, 0xB0, 0x01, 0x00, 0x00, 0x01, 0x2C,					// request Announce, 2 s, 300 s
+			0x00, 0x05, 0x00, 0x08, 0x00, 0xFC, 0x00, 0x00, 0x00, 0x3C, 0x00, 0x01,		// grant Sync, 1/16 s, 60 s, renewal invited
+			0x00, 0x06, 0x00, 0x02, 0x90, 0x00											// cancel Delay_Resp
+		}};
+
+		msg::Signaling signaling;
+		signaling.target_port_identity = requester_identity;
+		const auto request = msg::make_unicast_tlv(msg::TlvTypes::RequestUnicastTransmission, MessageTypes::Announce, 1, 300);
+		auto grant = msg::make_unicast_tlv(msg::TlvTypes::GrantUnicastTransmission, MessageTypes::Synch, -4, 60);
+		grant.flags = uint8(msg::UnicastTransmissionTlv::GrantFlags::RenewalInvited);
+		const auto cancel = msg::make_unicast_tlv(msg::TlvTypes::CancelUnicastTransmission, MessageTypes::DelayResp);
+
+		check(request.length_field == 6 && grant.length_field == 8 && cancel.length_field == 2, name, "TLV lengths");
+
+		std::array<uint8, 72> buffer;
+		buffer.fill(0xA5);
+		const auto header = make_header(MessageTypes::Signaling, 72, 0x05, 0x7F);
+		msg::serialize(buffer.data(), header);
+		msg::serialize(buffer.data(), signaling);
+		msg::serialize(buffer.data() + 44, request);
+		msg::serialize(buffer.data() + 54, grant);
+		msg::serialize(buffer.data() + 66, cancel);
+		check_bytes(name, buffer.data(), golden);
+
+		msg::Header read_header;
+		msg::Signaling read_signaling;
+		msg::deserialize(golden.data(), read_header);
+		msg::deserialize(golden.data(), read_signaling);
+		check_header(name, read_header, header);
+		check(read_signaling.target_port_identity == requester_identity, name, "target port identity");
+
+		msg::TlvHeader tlv_header;
+		msg::UnicastTransmissionTlv tlv;
+		msg::deserialize(golden.data() + 44, tlv_header);
+		msg::deserialize(golden.data() + 44, tlv);
+		check(tlv_header.is(msg::TlvTypes::RequestUnicastTransmission) && tlv_header.length_field == 6, name, "request TLV header");
+		check(tlv.message_type == uint8(MessageTypes::Announce) && tlv.log_inter_message_period == 1 && tlv.duration == 300, name, "request TLV");
+
+		msg::deserialize(golden.data() + 54, tlv);
+		check(tlv.is(msg::TlvTypes::GrantUnicastTransmission) && tlv.length_field == 8, name, "grant TLV header");
+		check(tlv.message_type == uint8(MessageTypes::Synch) && tlv.log_inter_message_period == -4 && tlv.duration == 60, name, "grant TLV");
+		check(tlv.flags == uint8(msg::UnicastTransmissionTlv::GrantFlags::RenewalInvited), name, "grant TLV flags");
+
+		msg::deserialize(golden.data() + 66, tlv);
+		check(tlv.is(msg::TlvTypes::CancelUnicastTransmission) && tlv.length_field == 2, name, "cancel TLV header");
+		check(tlv.message_type == uint8(MessageTypes::DelayResp) && tlv.duration == 0 && tlv.flags == 0, name, "cancel TLV");
+	}
+
+	// 802.1AS Follow_Up with its information TLV, 100 ppb cumulative rate offset
+	void gptp_follow_up()
+	{
+		const char* name = "gptp_follow_up";
+		const std::array<uint8, 76> golden = {{
+			HEADER_BYTES(0x8, 76, 0x02, -3),
+			TIMESTAMP_BYTES,
+			0x00, 0x03, 0x00, 0x1C,			// organization extension TLV, 28 bytes
+			0x00, 0x80, 0xC2, 0x00, 0x00, 0x01,	// IEEE 802.1 Follow_Up information
+			0x00, 0x03, 0x5A, 0xFE,			// cumulativeScaledRateOffset
+			0x00, 0x00,				// gmTimeBaseIndicator
+			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+			0x00, 0x00, 0x00, 0x00			// scaledLastGmFreqChange
+		}};
+
+		msg::GptpFollowUp follow_up;
+		follow_up.precise_origin_timestamp = timestamp;
+		follow_up.information = msg::make_follow_up_information(RateOffset::from_intervals(1000000100, 1000000000));
+		msg::GptpFollowUp read;
+		round_trip(name, make_header(MessageTypes::FollowUp, 76, 0x02, -3), follow_up, golden, read);
+		check(read.precise_origin_timestamp == timestamp, name, "precise origin timestamp");
+		check(msg::is_follow_up_information(read.information), name, "information TLV");
+		check(read.information.cumulative_scaled_rate_offset == 219902, name, "cumulative scaled rate offset");
+	}
+
+	// RateOffset is (ratio - 1) * 2^41, as in cumulativeScaledRateOffset
+	void rate_offset()
+	{
+		const char* name = "rate_offset";
+		const RateOffset fast = RateOffset::from_intervals(1000000100, 1000000000);
+		const RateOffset slow = RateOffset::from_intervals(999999900, 1000000000);
+		check(fast.scaled_ == 219902 && slow.scaled_ == -219902, name, "from_intervals");
+		check(fast.to_ppb() == 99 && RateOffset(1ll << 32).to_ppb() == 1953125, name, "to_ppb");
+
+		// (1 + 2^-3)^2 - 1 = 2^-2 + 2^-6, with a product beyond 64 bits
+		const RateOffset eighth(1ll << 38);
+		check((eighth * eighth).scaled_ == (1ll << 39) + (1ll << 35), name, "chained product");
+		check((fast * slow).scaled_ == -1, name, "chained inverse");	// -(10^-7)^2, rounded down
+		check((fast * RateOffset()).scaled_ == fast.scaled_, name, "chained identity");
+
+		const TimeInterval second = TimeInterval::from_nanos(1000000000);
+		check(fast.apply(second).to_nanos() == 1000000100, name, "apply");
+		check(slow.apply(second).to_nanos() == 999999900, name, "apply negative");
+	}
+
+	// Seconds beyond what Time holds saturate, nanoseconds are capped below a second
+	void timestamp_range()
+	{
+		const std::array<uint8, 10> golden = {{ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF }};
+		std::array<uint8, 44> buffer = {};
+		std::memcpy(buffer.data() + 34, golden.data(), golden.size());
+
+		msg::Sync read;
+		msg::deserialize(buffer.data(), read);
+		check(read.origin_timestamp == Time(static_cast<int64>(Time::max_wire_seconds), 0), "timestamp_range", "saturated seconds");
+
+		std::memset(buffer.data() + 34, 0, 6);
+		msg::deserialize(buffer.data(), read);
+		check(read.origin_timestamp == Time(0ll, 999999999), "timestamp_range", "capped nanoseconds");
+	}
+
+}
+
+int main()
+{
+	sync();
+	announce();
+	delay_resp();
+	pdelay_resp();
+	pdelay_resp_follow_up();
+	signaling();
+	gptp_follow_up();
+	rate_offset();
+	timestamp_range();
+
+	std::printf(failures ? "codec_test: %d FAILED\n" : "codec_test: passed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,228 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Delay_Req load on lo. The Linux port runs as master, and a child process
+// sends it unicast Delay_Reqs round robin from [clients] slaves at [rate]
+// requests per second. Prints the Delay_Resps sent, the send syscalls they
+// took and the master's CPU time:
+//
+//   build/delay_req_load [clients] [rate] [seconds]
+//
+// Not part of check, see the Makefile for building it without the sanitizer.
+// Build it a second time with -DUPTP_DELAY_RESP_BATCH=1 to compare against
+// one syscall per response.
+
+#include <microptp_config.hpp>
+#include <microptp/ports/linux/port.hpp>
+#include <microptp/state_master.hpp>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace uptp;
+
+// the send calls of the port, counted through -Wl,--wrap
+extern "C" {
+
+	ssize_t __real_sendto(int fd, const void* buffer, size_t length, int flags, const sockaddr* to, socklen_t to_length);
+	int __real_sendmmsg(int fd, mmsghdr* messages, unsigned int count, int flags);
+
+	static long sendto_calls = 0;
+	static long sendmmsg_calls = 0;
+	static long sendmmsg_messages = 0;
+
+	ssize_t __wrap_sendto(int fd, const void* buffer, size_t length, int flags, const sockaddr* to, socklen_t to_length)
+	{
+		++sendto_calls;
+		return __real_sendto(fd, buffer, length, flags, to, to_length);
+	}
+
+	int __wrap_sendmmsg(int fd, mmsghdr* messages, unsigned int count, int flags)
+	{
+		++sendmmsg_calls;
+		const int result = __real_sendmmsg(fd, messages, count, flags);
+		if(result > 0) {
+			sendmmsg_messages += result;
+		}
+		return result;
+	}
+
+}
+
+namespace {
+
+	// Sends [rate] Delay_Reqs per second for [seconds], in bursts of 64
+	void generate(uint32 clients, uint32 rate, uint32 seconds)
+	{
+		static const uint32 burst = 64;
+
+		const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+		sockaddr_in to = {};
+		to.sin_family = AF_INET;
+		to.sin_port = htons(event_port_number);
+		to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		Config config;
+		PortIdentity slave;
+		slave.clock.identity[0] = 0xAA;
+		slave.port = 1;
+		auto header = make_header(slave, config, MessageTypes::DelayRequest);
+		header.flag_field0 |= uint8(msg::Header::Field0Flags::Unicast);
+		header.message_length = msg::message_size<msg::DelayReq>();
+		msg::DelayReq request;
+		request.timestamp = Time();
+
+		std::array<uint8, msg::message_size<msg::DelayReq>()> data;
+		const long burst_nanos = 1000000000L / rate * burst;
+		timespec next;
+		clock_gettime(CLOCK_MONOTONIC, &next);
+
+		uint32 client = 0;
+		for(uint64 sent = 0; sent < uint64(rate) * seconds; ) {
+			for(uint32 i = 0; i < burst; ++i, ++sent) {
+				header.source_port_identity.clock.identity[1] = uint8(client >> 8);
+				header.source_port_identity.clock.identity[2] = uint8(client);
+				msg::serialize(data.data(), header);
+				msg::serialize(data.data(), request);
+				sendto(fd, data.data(), data.size(), 0, reinterpret_cast<const sockaddr*>(&to), sizeof(to));
+
+				// every slave at rate / clients per second
+				if(++client == clients) {
+					client = 0;
+					++header.sequence_id;
+				}
+			}
+
+			next.tv_nsec += burst_nanos;
+			while(next.tv_nsec >= 1000000000L) {
+				next.tv_nsec -= 1000000000L;
+				++next.tv_sec;
+			}
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+		}
+
+		close(fd);
+	}
+
+	long micros(const timeval& time)
+	{
+		return time.tv_sec * 1000000L + time.tv_usec;
+	}
+
+	//
+	// Starts the generator once the port had time to take the Master role and
+	// takes the counters and the CPU time over the generator's run.
+	//
+	class LoadDriver {
+	public:
+		static const uint32 settle_millis = 2000;
+
+		LoadDriver(SystemPort& port, uint32 clients, uint32 rate, uint32 seconds)
+			: port_(port), clients_(clients), rate_(rate), seconds_(seconds), generator_(-1),
+			  calls_(0), sent_(0), cpu_micros_(0), master_(false)
+		{
+			begin_timer_ = port.make_timer(ulib::function<void()>(this, &LoadDriver::begin));
+			end_timer_ = port.make_timer(ulib::function<void()>(this, &LoadDriver::end));
+		}
+
+		void start()
+		{
+			begin_timer_->start(settle_millis);
+			end_timer_->start(settle_millis + seconds_ * 1000 + 200);
+		}
+
+		int report()
+		{
+			if(generator_ > 0) {
+				waitpid(generator_, nullptr, 0);
+			}
+
+			if(!master_) {
+				std::printf("delay_req_load: the port did not become master\n");
+				return 1;
+			}
+
+			std::printf("%u clients, %u req/s for %u s: %ld Delay_Resps in %ld send syscalls, %ld ms CPU (%.1f%% of a core)\n",
+				clients_, rate_, seconds_, sent_, calls_, cpu_micros_ / 1000, cpu_micros_ / (seconds_ * 10000.0));
+			return 0;
+		}
+
+	private:
+		long cpu_micros() const
+		{
+			rusage usage;
+			getrusage(RUSAGE_SELF, &usage);
+			return micros(usage.ru_utime) + micros(usage.ru_stime);
+		}
+
+		void begin()
+		{
+			master_ = port_.clock().port(0).is<states::Master>();
+			calls_ = -(sendto_calls + sendmmsg_calls);
+			sent_ = -(sendto_calls + sendmmsg_messages);
+			cpu_micros_ = -cpu_micros();
+
+			generator_ = fork();
+			if(generator_ == 0) {
+				generate(clients_, rate_, seconds_);
+				_exit(0);
+			}
+		}
+
+		void end()
+		{
+			calls_ += sendto_calls + sendmmsg_calls;
+			sent_ += sendto_calls + sendmmsg_messages;
+			cpu_micros_ += cpu_micros();
+			port_.stop();
+		}
+
+		SystemPort& port_;
+		TimerHandle begin_timer_;
+		TimerHandle end_timer_;
+		uint32 clients_;
+		uint32 rate_;
+		uint32 seconds_;
+		pid_t generator_;
+
+		long calls_;
+		long sent_;
+		long cpu_micros_;
+		bool master_;
+	};
+
+}
+
+int main(int argc, char** argv)
+{
+	const uint32 clients = argc > 1 ? std::atoi(argv[1]) : 4000;
+	const uint32 rate    = argc > 2 ? std::atoi(argv[2]) : 24000;
+	const uint32 seconds = argc > 3 ? std::atoi(argv[3]) : 5;
+
+	// Announce and the Delay_Req rate limit fast enough for the load
+	Config config;
+	config.priority1 = 1;
+	config.log_announce_interval = -3;
+	config.log_min_delay_req_interval = -3;
+
+	SystemPort port(config, "lo", SystemPort::Timestamping::Software);
+	if(!port.start()) {
+		std::printf("delay_req_load: no loopback interface\n");
+		return 1;
+	}
+	port.enable();
+
+	LoadDriver driver(port, clients, rate, seconds);
+	driver.start();
+	port.run();
+
+	return driver.report();
+}
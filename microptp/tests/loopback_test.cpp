@@ -0,0 +1,272 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// The Linux port on lo: UDP over IPv4 and IPv6 and the AF_PACKET socket, each
+// on the poll loop, the receive thread and io_uring. Every datagram has to
+// come back, and every transmit timestamp has to reach the id of its own
+// send, also after a send_batch took several OPT_ID keys at once.
+
+#include <microptp_config.hpp>
+#include <microptp/ports/linux/port.hpp>
+#include <arpa/inet.h>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+using namespace uptp;
+
+namespace {
+
+	int failures = 0;
+
+	void check(bool condition, const char* name, const char* what)
+	{
+		if(!condition) {
+			std::printf("FAILED: %s: %s\n", name, what);
+			++failures;
+		}
+	}
+
+	enum class Transport {
+		Ipv4,
+		Ipv6,
+		Ethernet
+	};
+
+	const char* transport_name(Transport transport)
+	{
+		switch(transport) {
+		case Transport::Ipv4: return "ipv4";
+		case Transport::Ipv6: return "ipv6";
+		default:              return "ethernet";
+		}
+	}
+
+	//
+	// Sends in three rounds, 20 ms apart: single sends with their own ids, one
+	// send_batch sharing batch_id, single sends again, and stops the port 100 ms
+	// later. The payload carries the index of the send, so the receive stamp of
+	// each datagram can be held against the transmit stamp reported for its id.
+	//
+	class Loopback {
+	public:
+		static const uint16 udp_port = 40319;
+		static const size_t per_round = 4;
+		static const size_t total = 3 * per_round;
+		static const uint32 batch_id = 100;
+		static const size_t payload_size = 44;
+
+		Loopback(SystemPort& port, Transport transport)
+			: port_(port), round_(0), batch_completions_(0), stray_completions_(0), stray_datagrams_(0)
+		{
+			received_.fill(0);
+			completed_.fill(0);
+
+			if(transport == Transport::Ethernet) {
+				socket_ = port.make_ethernet();
+				address_ = ptp_multicast_group;
+			} else if(transport == Transport::Ipv6) {
+				static const uint8 loopback[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+				socket_ = port.make_udp(NetAddress::Family::Ipv6, udp_port);
+				address_ = NetAddress::ipv6(loopback);
+			} else {
+				socket_ = port.make_udp(NetAddress::Family::Ipv4, udp_port);
+				address_ = NetAddress::ipv4(htonl(INADDR_LOOPBACK));
+			}
+
+			if(socket_) {
+				socket_->on_received = ulib::function<void(PacketHandle)>(this, &Loopback::on_received);
+				socket_->on_transmit_completed = ulib::function<void(uint32, Time)>(this, &Loopback::on_transmit_completed);
+			}
+
+			round_timer_ = port.make_timer(ulib::function<void()>(this, &Loopback::next_round));
+		}
+
+		explicit operator bool() const
+		{
+			return static_cast<bool>(socket_);
+		}
+
+		void start()
+		{
+			round_timer_->start(20);
+		}
+
+		void verify(const char* name) const
+		{
+			for(size_t i = 0; i < total; ++i) {
+				check(received_[i] == 1, name, "datagram lost or duplicated");
+			}
+			check(!stray_datagrams_, name, "datagram that wasn't sent");
+
+			for(size_t i = 0; i < total; ++i) {
+				if(is_batched(i)) {
+					continue;
+				}
+
+				const auto id = single_id(i);
+				check(completed_[id] == 1, name, "transmit timestamp lost or reported twice");
+				if(completed_[id] == 1 && received_[i] == 1) {
+					// a timestamp matched to the wrong send is that of a later one, after our datagram arrived
+					check(transmitted_[id].to_nanos() <= arrived_[i].to_nanos(), name, "transmit timestamp of another send");
+				}
+			}
+			check(batch_completions_ == per_round, name, "send_batch timestamps");
+			check(!stray_completions_, name, "timestamp for an id that wasn't sent");
+		}
+
+	private:
+		static bool is_batched(size_t index)
+		{
+			return index >= per_round && index < 2 * per_round;
+		}
+
+		static uint32 single_id(size_t index)
+		{
+			return uint32(index + 1);
+		}
+
+		PacketHandle make_packet(size_t index)
+		{
+			auto packet = socket_->acquire_transmit_handle();
+			if(packet) {
+				auto data = static_cast<uint8*>(packet->get_data());
+				std::memset(data, 0, payload_size);
+				std::memcpy(data, "uptp", 4);
+				data[4] = uint8(index);
+				packet->set_size(payload_size);
+			}
+			return packet;
+		}
+
+		void next_round()
+		{
+			if(round_ == 3) {
+				// the timestamps are in by now
+				port_.stop();
+				return;
+			}
+
+			if(round_ == 1) {
+				std::array<PacketHandle, per_round> packets;
+				std::array<NetAddress, per_round> addresses;
+				for(size_t i = 0; i < per_round; ++i) {
+					packets[i] = make_packet(per_round + i);
+					addresses[i] = address_;
+				}
+				socket_->send_batch(addresses.data(), udp_port, packets.data(), per_round, batch_id);
+			} else {
+				const size_t first = round_ * per_round;
+				for(size_t i = first; i < first + per_round; ++i) {
+					socket_->send(address_, udp_port, make_packet(i), single_id(i));
+				}
+			}
+
+			++round_;
+			round_timer_->start(round_ < 3 ? 20 : 100);
+		}
+
+		void on_received(PacketHandle packet)
+		{
+			const auto data = static_cast<const uint8*>(packet->get_data());
+			const size_t index = data[4];
+			if(packet->size() < payload_size || std::memcmp(data, "uptp", 4) || index >= total) {
+				++stray_datagrams_;
+				return;
+			}
+
+			++received_[index];
+			arrived_[index] = packet->time();
+		}
+
+		void on_transmit_completed(uint32 id, Time time)
+		{
+			if(id == batch_id) {
+				++batch_completions_;
+			} else if(id >= 1 && id <= total && !is_batched(id - 1)) {
+				++completed_[id];
+				transmitted_[id] = time;
+			} else {
+				++stray_completions_;
+			}
+		}
+
+		SystemPort& port_;
+		NetHandle socket_;
+		NetAddress address_;
+		TimerHandle round_timer_;
+		size_t round_;
+
+		std::array<uint32, total> received_;
+		std::array<Time, total> arrived_;
+		std::array<uint32, total + 1> completed_;		// by id
+		std::array<Time, total + 1> transmitted_;
+		uint32 batch_completions_;
+		uint32 stray_completions_;
+		uint32 stray_datagrams_;
+	};
+
+	enum class Mode {
+		Poll,
+		Thread,
+		Uring
+	};
+
+	const char* mode_name(Mode mode)
+	{
+		switch(mode) {
+		case Mode::Poll:   return "poll";
+		case Mode::Thread: return "thread";
+		default:           return "uring";
+		}
+	}
+
+	void run(Transport transport, Mode mode)
+	{
+		char name[32];
+		std::snprintf(name, sizeof(name), "%s/%s", transport_name(transport), mode_name(mode));
+
+		SystemPort::ReceiveOptions options;
+		options.thread  = mode == Mode::Thread;
+		options.backend = mode == Mode::Uring ? SystemPort::Backend::Uring : SystemPort::Backend::Poll;
+
+		Config config;
+		std::unique_ptr<SystemPort> port(new SystemPort(config, "lo", SystemPort::Timestamping::Software, options));
+		if(!port->start()) {
+			check(false, name, "no loopback interface");
+			return;
+		}
+
+		Loopback loopback(*port, transport);
+		if(!loopback) {
+			// packet sockets take CAP_NET_RAW
+			std::printf("%s: skipped, no socket\n", name);
+			return;
+		}
+
+		loopback.start();
+		port->run();
+
+		const int before = failures;
+		loopback.verify(name);
+		if(failures == before) {
+			std::printf("%s: passed\n", name);
+		}
+	}
+
+}
+
+int main()
+{
+	for(auto transport : { Transport::Ipv4, Transport::Ipv6, Transport::Ethernet }) {
+		for(auto mode : { Mode::Poll, Mode::Thread, Mode::Uring }) {
+			run(transport, mode);
+		}
+	}
+
+	std::printf(failures ? "loopback_test: %d FAILED\n" : "loopback_test: passed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,26 @@
+#ifndef CONFIG_MICROPTP_CONFIG_HPP__
+#define CONFIG_MICROPTP_CONFIG_HPP__
+
+// Host build of the tests, see Makefile
+#define MICROPTP_PORT_LINUX
+
+// the master too, delay_req_load runs it
+#define UPTP_SLAVE_ONLY 0
+
+// Delay_Req service sized for a few thousand slaves
+#ifndef UPTP_DELAY_REQ_QUEUE_SIZE
+#define UPTP_DELAY_REQ_QUEUE_SIZE 64
+#endif
+#ifndef UPTP_DELAY_RESP_BATCH
+#define UPTP_DELAY_RESP_BATCH 16		// one sendmmsg, see Socket::max_batch
+#endif
+#ifndef UPTP_DELAY_RESP_CLIENTS
+#define UPTP_DELAY_RESP_CLIENTS 8192
+#endif
+
+#include <cstdio>
+
+#define PRINT(...) std::printf(__VA_ARGS__)
+#define TRACE(...)
+
+#endif
@@ -0,0 +1,164 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// MpscQueue and SpscRing across threads, meant to run under ThreadSanitizer
+
+#include <microptp/util/mpsc_queue.hpp>
+#include <microptp/util/spsc_ring.hpp>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace uptp;
+
+namespace {
+
+	int failures = 0;
+
+	void check(bool condition, const char* what)
+	{
+		if(!condition) {
+			std::printf("FAILED: %s\n", what);
+			++failures;
+		}
+	}
+
+	// Producers push (producer, sequence) pairs and retry those a full queue rejects.
+	// Every entry has to come out once and in order per producer, and every
+	// rejection has to show up as a drop.
+	void mpsc_queue()
+	{
+		static const size_t producers = 4;
+		static const uint32 per_producer = 50000;
+
+		struct Entry {
+			uint32 producer;
+			uint32 sequence;
+		};
+
+		MpscQueue<Entry, 64> queue;
+		std::atomic<uint32> rejected(0);
+		std::atomic<size_t> running(producers);
+
+		std::vector<std::thread> threads;
+		for(size_t p = 0; p < producers; ++p) {
+			threads.emplace_back([&, p] {
+				for(uint32 i = 0; i < per_producer; ++i) {
+					Entry entry = { uint32(p), i };
+					while(!queue.push(std::move(entry))) {
+						rejected.fetch_add(1, std::memory_order_relaxed);
+						std::this_thread::yield();
+					}
+				}
+				running.fetch_sub(1, std::memory_order_release);
+			});
+		}
+
+		std::array<uint32, producers> received = {};
+		bool ordered = true;
+
+		Entry entry;
+		for(;;) {
+			const bool done = running.load(std::memory_order_acquire) == 0;
+			while(queue.pop(entry)) {
+				ordered = ordered && entry.producer < producers && entry.sequence == received[entry.producer];
+				if(entry.producer < producers) {
+					++received[entry.producer];
+				}
+			}
+			if(done) {
+				break;
+			}
+			std::this_thread::yield();
+		}
+
+		for(auto& thread : threads) {
+			thread.join();
+		}
+
+		bool complete = true;
+		for(auto count : received) {
+			complete = complete && count == per_producer;
+		}
+
+		const auto stats = queue.stats();
+		check(ordered, "mpsc: entries of a producer out of order");
+		check(complete, "mpsc: entries lost");
+		check(stats.pushed == producers * per_producer, "mpsc: pushed count");
+		check(stats.dropped == rejected.load(), "mpsc: rejected pushes not counted as dropped");
+		check(stats.high_water <= 64, "mpsc: high water beyond the depth");
+		std::printf("mpsc: %u pushed, %u dropped, high water %u\n", stats.pushed, stats.dropped, stats.high_water);
+	}
+
+	// The producer fills slots in place and commits them in runs of varying length,
+	// the consumer has to see every sequence number once and in order.
+	void spsc_ring()
+	{
+		static const uint32 count = 200000;
+
+		struct Slot {
+			uint32 sequence;
+			std::array<uint8, 60> payload;
+		};
+
+		SpscRing<Slot, 64> ring;
+
+		std::thread producer([&] {
+			uint32 next = 0;
+			while(next < count) {
+				size_t run = ring.writable();
+				if(!run) {
+					std::this_thread::yield();
+					continue;
+				}
+				if(run > (next % 7) + 1) {
+					run = (next % 7) + 1;
+				}
+				if(run > count - next) {
+					run = count - next;
+				}
+
+				for(size_t i = 0; i < run; ++i) {
+					auto& slot = ring.slot(i);
+					slot.sequence = next + uint32(i);
+					slot.payload.fill(uint8(next + i));
+				}
+				ring.commit(run);
+				next += uint32(run);
+			}
+		});
+
+		uint32 expected = 0;
+		bool intact = true;
+		while(expected < count) {
+			if(!ring.readable()) {
+				std::this_thread::yield();
+				continue;
+			}
+
+			const auto& slot = ring.front();
+			intact = intact && slot.sequence == expected && slot.payload[59] == uint8(expected);
+			ring.pop();
+			++expected;
+		}
+		producer.join();
+
+		check(intact, "spsc: slot out of order or torn");
+		check(!ring.readable(), "spsc: entries left over");
+		std::printf("spsc: %u entries\n", expected);
+	}
+
+}
+
+int main()
+{
+	mpsc_queue();
+	spsc_ring();
+
+	std::printf(failures ? "queue_test: %d FAILED\n" : "queue_test: passed\n", failures);
+	return failures ? 1 : 0;
+}
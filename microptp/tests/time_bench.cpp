@@ -0,0 +1,71 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Time to and from the 48 bit seconds / 32 bit nanoseconds wire format, on
+// its own and through the timestamp field of a Sync
+
+#include <microptp_config.hpp>
+#include <microptp/messages.hpp>
+#include <array>
+#include "bench.hpp"
+
+using namespace uptp;
+
+namespace {
+
+	const size_t iterations = 10000000;
+	const size_t samples = 1024;	// power of two
+
+	uint64 next_random(uint64& state)
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state;
+	}
+
+}
+
+int main()
+{
+	// wire values as they arrive, one in sixteen out of range
+	std::array<uint64, samples> seconds;
+	std::array<uint32, samples> nanoseconds;
+	std::array<Time, samples> times;
+	uint64 state = 88172645463325252ull;
+	for(size_t i = 0; i < samples; ++i) {
+		const uint64 value = next_random(state);
+		seconds[i] = (i % 16) ? (value & 0xFFFFFFFF) : (value & 0xFFFFFFFFFFFFull);
+		nanoseconds[i] = (i % 16) ? uint32(value >> 32) % 1000000000 : uint32(value >> 32);
+		times[i] = Time::from_wire(seconds[i], nanoseconds[i]);
+	}
+
+	bench::run("Time::from_wire", iterations, [&](size_t i) {
+		bench::keep(Time::from_wire(seconds[i & (samples - 1)], nanoseconds[i & (samples - 1)]));
+	});
+
+	bench::run("Time wire_seconds/nanoseconds", iterations, [&](size_t i) {
+		const Time& time = times[i & (samples - 1)];
+		bench::keep(time.wire_seconds());
+		bench::keep(time.wire_nanoseconds());
+	});
+
+	std::array<uint8, msg::message_size<msg::Sync>()> buffer = {};
+	msg::Sync sync;
+
+	bench::run("Sync timestamp serialize", iterations, [&](size_t i) {
+		sync.origin_timestamp = times[i & (samples - 1)];
+		msg::serialize(buffer.data(), sync);
+		bench::keep(buffer);
+	});
+
+	bench::run("Sync timestamp deserialize", iterations, [&](size_t i) {
+		buffer[43] = uint8(i);
+		msg::deserialize(buffer.data(), sync);
+		bench::keep(sync.origin_timestamp);
+	});
+
+	return 0;
+}
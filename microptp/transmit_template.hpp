@@ -0,0 +1,110 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_TRANSMIT_TEMPLATE_HPP__
+#define MICROPTP_TRANSMIT_TEMPLATE_HPP__
+
+#include <array>
+#include <cstring>
+#include <type_traits>
+#include <microptp/config.hpp>
+#include <microptp/messages.hpp>
+#include <microptp/ports/systemportapi.hpp>
+
+namespace uptp {
+
+	//
+	// Pre-serialized outgoing message. Built once whenever the port identity
+	// or the network changes, every send then only copies the bytes into a
+	// transmit buffer and patches the sequence id (and timestamp/correction
+	// where the message needs it).
+	//
+	template< typename Message >
+	class TransmitTemplate {
+	public:
+		static constexpr size_t size = msg::message_size<Message>();
+
+		TransmitTemplate()
+			: valid_(false)
+		{}
+
+		void build(msg::Header header, const Message& body)
+		{
+			header.message_length = size;
+			msg::serialize(data_.data(), header);
+			msg::serialize(data_.data(), body);
+			valid_ = true;
+		}
+
+		void invalidate()
+		{
+			valid_ = false;
+		}
+
+		explicit operator bool() const
+		{
+			return valid_;
+		}
+
+		// Acquire a transmit buffer from the port, fill it from the template
+		// and set the sequence id. Returns an empty handle if either the
+		// template has not been built or the port is out of buffers.
+		PacketHandle make(NetHandle& port, uint16 sequence_id) const
+		{
+			PacketHandle handle;
+			if(valid_ && port) {
+				handle = port->acquire_transmit_handle();
+				if(handle && handle->capacity() >= size) {
+					std::memcpy(handle->get_data(), data_.data(), size);
+					handle->set_size(size);
+					msg::layouts::header_sequence_id::write<0>(handle->get_data(), sequence_id);
+				} else {
+					handle = PacketHandle();
+				}
+			}
+			return handle;
+		}
+
+		// patch a single layout field of a buffer returned by make()
+		template< typename Field, typename Value >
+		static void set(PacketHandle& handle, const Value& value)
+		{
+			Field::template write<0>(handle->get_data(), value);
+		}
+
+		static void set_timestamp(PacketHandle& handle, const Time& time)
+		{
+			set<msg::layouts::origin_timestamp>(handle, time);
+		}
+
+		static void set_correction(PacketHandle& handle, const TimeInterval& correction)
+		{
+			set<msg::layouts::header_correction>(handle, correction.scaled_nanos_);
+		}
+
+	private:
+		std::array<uint8, size> data_;
+		bool valid_;
+	};
+
+	struct TransmitTemplates {
+		// 802.1AS Follow_Ups carry the information TLV
+		using follow_up_message = std::conditional_t<Config::gptp_profile, msg::GptpFollowUp, msg::FollowUp>;
+
+		TransmitTemplate<msg::DelayReq> delay_req;
+		TransmitTemplate<msg::PDelayReq> pdelay_req;
+		TransmitTemplate<msg::PDelayResp> pdelay_resp;
+		TransmitTemplate<msg::PDelayRespFollowUp> pdelay_resp_follow_up;
+#if !UPTP_SLAVE_ONLY
+		TransmitTemplate<msg::Announce>  announce;
+		TransmitTemplate<msg::Sync>      sync;
+		TransmitTemplate<follow_up_message> follow_up;
+		TransmitTemplate<msg::DelayResp> delay_resp;
+#endif
+	};
+
+}
+
+#endif
@@ -0,0 +1,476 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <cstring>
+#include <microptp/config.hpp>
+#include <microptp/ptpclock.hpp>
+#include <microptp/transparent_clock.hpp>
+#include <microptp/ports/systemport.hpp>
+
+namespace uptp {
+
+	namespace {
+
+		bool is_p2p()
+		{
+			return Config::delay_mechanism == Config::DelayMechanism::P2P;
+		}
+
+		bool is_peer_delay(const msg::Header& header)
+		{
+			return header.is(MessageTypes::PeerDelayReq) || header.is(MessageTypes::PeerDelayResp) || header.is(MessageTypes::PeerDelayRespFollowUp);
+		}
+
+	}
+
+	// transmit ids carry the entry index in place of the domain number
+	static_assert(TransparentClock::max_pending <= 0xFF, "pending entries must be indexable by a byte");
+
+	TransparentClock::TransparentClock(SystemPort& system_port, const Config& config)
+		: TransparentClock(system_port, config, std::make_index_sequence<max_ports>())
+	{
+	}
+
+	template< size_t... Indices >
+	TransparentClock::TransparentClock(SystemPort& system_port, const Config& config, std::index_sequence<Indices...>)
+		: system_port_(system_port), config_(config),
+		  ports_{{ { *this, static_cast<uint8>(Indices) }... }},
+		  generation_(0), stats_()
+	{
+		for(auto& pending : pending_) {
+			pending.used = false;
+		}
+	}
+
+	TransparentClock::~TransparentClock()
+	{
+		for(auto& port : ports_) {
+			if(port.used) {
+				port.peer_delay.stop();
+				port.event->on_received.reset();
+				port.event->on_transmit_completed.reset();
+				port.general->on_received.reset();
+			}
+		}
+	}
+
+	void TransparentClock::set_identity(const std::array<uint8, 6>& macaddr)
+	{
+		identity_.update(macaddr);
+		for(auto& port : ports_) {
+			port.identity.clock = identity_;
+			if(port.used) {
+				port.build_transmit_templates();
+			}
+		}
+	}
+
+	int TransparentClock::add_port(NetHandle event, NetHandle general)
+	{
+		if(!event || !general) {
+			return -1;
+		}
+
+		for(auto& port : ports_) {
+			if(!port.used) {
+				port.used = true;
+				port.event = std::move(event);
+				port.general = std::move(general);
+				port.build_transmit_templates();
+
+				port.event->on_received = ulib::function<void(PacketHandle)>(&port, &Port::on_event);
+				port.event->on_transmit_completed = ulib::function<void(uint32, Time)>(&port, &Port::on_transmitted);
+				port.general->on_received = ulib::function<void(PacketHandle)>(&port, &Port::on_general);
+
+				if(is_p2p()) {
+					port.peer_delay.start();
+				}
+				return port.index;
+			}
+		}
+
+		return -1;
+	}
+
+	TimeInterval TransparentClock::link_delay(size_t port) const
+	{
+		if(port < max_ports && ports_[port].peer_delay.valid()) {
+			return ports_[port].peer_delay.link_delay();
+		}
+		return TimeInterval();
+	}
+
+	const TransparentClock::Stats& TransparentClock::stats() const
+	{
+		return stats_;
+	}
+
+	//
+	// Port
+	//
+
+	TransparentClock::Port::Port(TransparentClock& owner_, uint8 index_)
+		: owner(owner_), index(index_), used(false), peer_delay(*this)
+	{
+		identity.port = static_cast<uint16>(index + 1);
+	}
+
+	void TransparentClock::Port::on_event(PacketHandle packet)
+	{
+		owner.on_event(*this, std::move(packet));
+	}
+
+	void TransparentClock::Port::on_general(PacketHandle packet)
+	{
+		owner.on_general(*this, std::move(packet));
+	}
+
+	void TransparentClock::Port::on_transmitted(uint32 id, Time time)
+	{
+		owner.on_transmitted(*this, id, time);
+	}
+
+	void TransparentClock::Port::build_transmit_templates()
+	{
+		build_peer_delay_templates(templates, identity, owner.config_);
+	}
+
+	SystemPort& TransparentClock::Port::get_system_port()
+	{
+		return owner.system_port_;
+	}
+
+	const Config& TransparentClock::Port::get_config() const
+	{
+		return owner.config_;
+	}
+
+	const PortIdentity& TransparentClock::Port::get_identity() const
+	{
+		return identity;
+	}
+
+	NetHandle& TransparentClock::Port::event_port()
+	{
+		return event;
+	}
+
+	NetHandle& TransparentClock::Port::general_port()
+	{
+		return general;
+	}
+
+	const TransmitTemplates& TransparentClock::Port::transmit_templates() const
+	{
+		return templates;
+	}
+
+	uint32 TransparentClock::Port::transmit_id(MessageTypes type, uint16 sequence_id) const
+	{
+		return uptp::transmit_id(type, sequence_id, owner.config_.domain_number);
+	}
+
+	bool TransparentClock::read_header(const PacketHandle& packet, msg::Header& header)
+	{
+		const size_t size = packet->size();
+		if(!msg::layouts::header::fits(size)) {
+			return false;
+		}
+
+		msg::deserialize(packet->get_data(), header);
+		return msg::validate(header, size);
+	}
+
+	//
+	// Ingress
+	//
+
+	void TransparentClock::on_event(Port& ingress, PacketHandle packet)
+	{
+		msg::Header header;
+		if(!read_header(packet, header)) {
+			return;
+		}
+
+		if(is_p2p() && is_peer_delay(header)) {
+			ingress.peer_delay.on_message(header, packet);
+			return;
+		}
+
+		if(is_p2p() && header.is(MessageTypes::DelayRequest)) {
+			return;
+		}
+
+		for(auto& egress : ports_) {
+			if(egress.used && &egress != &ingress) {
+				forward_event(ingress, egress, header, packet);
+			}
+		}
+	}
+
+	bool TransparentClock::forward_event(Port& ingress, Port& egress, const msg::Header& header, const PacketHandle& packet)
+	{
+		const bool tracked = header.is(MessageTypes::Synch) || header.is(MessageTypes::DelayRequest);
+		if(!tracked) {
+			return forward(egress.event, event_port_number, packet->get_data(), packet->size(), header, TimeInterval(), untracked_transmit_id);
+		}
+
+		auto* pending = allocate();
+		pending->source       = header.source_port_identity;
+		pending->sequence_id  = header.sequence_id;
+		pending->type         = static_cast<MessageTypes>(header.message_type);
+		pending->ingress      = ingress.index;
+		pending->egress       = egress.index;
+		pending->ingress_time = packet->time();
+		pending->transmitted  = false;
+		pending->held_size    = 0;
+		pending->convert_to_two_step = header.is(MessageTypes::Synch) && !(header.flag_field0 & uint8(msg::Header::Field0Flags::TwoStep));
+
+		msg::Header out_header = header;
+		if(pending->convert_to_two_step) {
+			msg::Sync sync;
+			msg::deserialize(packet->get_data(), sync);
+
+			pending->header = header;
+			pending->origin_timestamp = sync.origin_timestamp;
+			out_header.flag_field0 |= uint8(msg::Header::Field0Flags::TwoStep);
+		}
+
+		const uint32 id = transmit_id(*pending);
+		if(!forward(egress.event, event_port_number, packet->get_data(), packet->size(), out_header, TimeInterval(), id)) {
+			release(*pending);
+			return false;
+		}
+
+		return true;
+	}
+
+	void TransparentClock::on_general(Port& ingress, PacketHandle packet)
+	{
+		msg::Header header;
+		if(!read_header(packet, header)) {
+			return;
+		}
+
+		if(is_p2p() && is_peer_delay(header)) {
+			ingress.peer_delay.on_message(header, packet);
+		} else if(header.is(MessageTypes::FollowUp)) {
+			on_follow_up(ingress, header, packet);
+		} else if(header.is(MessageTypes::DelayResp)) {
+			if(!is_p2p()) {
+				on_delay_resp(ingress, header, packet);
+			}
+		} else {
+			for(auto& egress : ports_) {
+				if(egress.used && &egress != &ingress) {
+					forward(egress.general, general_port_number, packet->get_data(), packet->size(), header, TimeInterval(), untracked_transmit_id);
+				}
+			}
+		}
+	}
+
+	void TransparentClock::on_follow_up(Port& ingress, const msg::Header& header, const PacketHandle& packet)
+	{
+		for(auto& egress : ports_) {
+			if(!egress.used || &egress == &ingress) {
+				continue;
+			}
+
+			auto* pending = find(MessageTypes::Synch, header.source_port_identity, header.sequence_id, ingress.index, egress.index);
+			if(!pending) {
+				forward(egress.general, general_port_number, packet->get_data(), packet->size(), header, TimeInterval(), untracked_transmit_id);
+			} else if(pending->transmitted) {
+				if(forward(egress.general, general_port_number, packet->get_data(), packet->size(), header, pending->residence, untracked_transmit_id)) {
+					++stats_.corrected;
+				}
+				release(*pending);
+			} else if(packet->size() <= max_held_size) {
+				// the Sync's transmit timestamp isn't in yet
+				std::memcpy(pending->held.data(), packet->get_data(), packet->size());
+				pending->held_size = packet->size();
+			} else {
+				forward(egress.general, general_port_number, packet->get_data(), packet->size(), header, TimeInterval(), untracked_transmit_id);
+				release(*pending);
+			}
+		}
+	}
+
+	void TransparentClock::on_delay_resp(Port& ingress, const msg::Header& header, const PacketHandle& packet)
+	{
+		msg::DelayResp delay_resp;
+		msg::deserialize(packet->get_data(), delay_resp);
+
+		for(auto& egress : ports_) {
+			if(!egress.used || &egress == &ingress) {
+				continue;
+			}
+
+			// the Delay_Req travelled the other way: it came in on egress and left through ingress
+			auto* pending = find(MessageTypes::DelayRequest, delay_resp.port_identity, header.sequence_id, egress.index, ingress.index);
+			if(pending && pending->transmitted) {
+				if(forward(egress.general, general_port_number, packet->get_data(), packet->size(), header, pending->residence, untracked_transmit_id)) {
+					++stats_.corrected;
+				}
+				release(*pending);
+			} else {
+				forward(egress.general, general_port_number, packet->get_data(), packet->size(), header, TimeInterval(), untracked_transmit_id);
+			}
+		}
+	}
+
+	//
+	// Egress
+	//
+
+	void TransparentClock::on_transmitted(Port& egress, uint32 id, Time time)
+	{
+		const MessageTypes type = transmit_type(id);
+		if(type == MessageTypes::PeerDelayReq || type == MessageTypes::PeerDelayResp) {
+			if(is_p2p()) {
+				egress.peer_delay.on_transmitted(id, time);
+			}
+			return;
+		}
+
+		Pending* entry = find(id);
+		if(!entry || entry->transmitted || entry->egress != egress.index) {
+			return;
+		}
+
+		auto& pending = *entry;
+
+		pending.residence = TimeInterval(time - pending.ingress_time);
+		pending.transmitted = true;
+
+		if(pending.type == MessageTypes::Synch) {
+			if(is_p2p()) {
+				pending.residence = pending.residence + link_delay(pending.ingress);
+			}
+			complete_sync(pending);
+		}
+	}
+
+	void TransparentClock::complete_sync(Pending& pending)
+	{
+		auto& port = ports_[pending.egress];
+
+		if(pending.convert_to_two_step) {
+			msg::Header header = pending.header;
+			header.message_type = static_cast<uint8>(MessageTypes::FollowUp);
+			header.control_field = msg::control_field(MessageTypes::FollowUp);
+			header.flag_field0 &= ~uint8(msg::Header::Field0Flags::TwoStep);
+			header.message_length = msg::message_size<msg::FollowUp>();
+			header.correction_field = 0;
+
+			msg::FollowUp follow_up;
+			follow_up.precise_origin_timestamp = pending.origin_timestamp;
+
+			std::array<uint8, msg::message_size<msg::FollowUp>()> data;
+			msg::serialize(data.data(), header);
+			msg::serialize(data.data(), follow_up);
+
+			if(forward(port.general, general_port_number, data.data(), data.size(), header, pending.residence, untracked_transmit_id)) {
+				++stats_.corrected;
+			}
+			release(pending);
+		} else if(pending.held_size) {
+			msg::Header header;
+			msg::deserialize(pending.held.data(), header);
+
+			if(forward(port.general, general_port_number, pending.held.data(), pending.held_size, header, pending.residence, untracked_transmit_id)) {
+				++stats_.corrected;
+			}
+			release(pending);
+		}
+	}
+
+	bool TransparentClock::forward(NetHandle& port, uint16 port_number, const void* data, size_t size, const msg::Header& header, TimeInterval correction, uint32 id)
+	{
+		auto handle = port->acquire_transmit_handle();
+		if(!handle || handle->capacity() < size) {
+			++stats_.no_buffer;
+			return false;
+		}
+
+		std::memcpy(handle->get_data(), data, size);
+		handle->set_size(size);
+
+		// header is rewritten for flag changes, the correction is only touched when it changes
+		msg::Header out = header;
+		out.correction_field += correction.scaled_nanos_;
+		msg::serialize(handle->get_data(), out);
+
+		port->send(ptp_multicast_group, port_number, std::move(handle), id);
+		++stats_.forwarded;
+		return true;
+	}
+
+	//
+	// In-flight entries
+	//
+
+	TransparentClock::Pending* TransparentClock::allocate()
+	{
+		Pending* oldest = &pending_[0];
+		for(auto& pending : pending_) {
+			if(!pending.used) {
+				oldest = &pending;
+				break;
+			}
+			if(pending.generation - oldest->generation > 0x80000000u) {
+				oldest = &pending;
+			}
+		}
+
+		if(oldest->used) {
+			++stats_.evicted;
+		}
+
+		oldest->used = true;
+		oldest->generation = generation_++;
+		return oldest;
+	}
+
+	TransparentClock::Pending* TransparentClock::find(MessageTypes type, const PortIdentity& source, uint16 sequence_id, uint8 ingress, uint8 egress)
+	{
+		for(auto& pending : pending_) {
+			if(pending.used && pending.type == type && pending.sequence_id == sequence_id
+				&& pending.ingress == ingress && pending.egress == egress && pending.source == source) {
+				return &pending;
+			}
+		}
+		return nullptr;
+	}
+
+	TransparentClock::Pending* TransparentClock::find(uint32 id)
+	{
+		const size_t index = transmit_domain(id);
+		if(index >= max_pending) {
+			return nullptr;
+		}
+
+		// an evicted and reused entry has moved on to another generation
+		auto& pending = pending_[index];
+		if(!pending.used || pending.type != transmit_type(id) || static_cast<uint16>(pending.generation) != static_cast<uint16>(id)) {
+			return nullptr;
+		}
+		return &pending;
+	}
+
+	uint32 TransparentClock::transmit_id(const Pending& pending) const
+	{
+		// laid out like a PtpPort's transmit ids, so they can't match the Pdelay
+		// messages' ids: the entry index in place of the domain number and the
+		// low half of the generation in place of the sequence id
+		const uint8 index = static_cast<uint8>(&pending - pending_.data());
+		return uptp::transmit_id(pending.type, static_cast<uint16>(pending.generation), index);
+	}
+
+	void TransparentClock::release(Pending& pending)
+	{
+		pending.used = false;
+	}
+
+}
@@ -0,0 +1,159 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_TRANSPARENT_CLOCK_HPP__
+#define MICROPTP_TRANSPARENT_CLOCK_HPP__
+
+#include <array>
+#include <utility>
+#include <microptp/config.hpp>
+#include <microptp/messages.hpp>
+#include <microptp/ptpdatatypes.hpp>
+#include <microptp/peer_delay.hpp>
+#include <microptp/transmit_template.hpp>
+#include <microptp/ports/systemportapi.hpp>
+
+namespace uptp {
+
+	//
+	// Software transparent clock bridging PTP between two or more ports.
+	// Every message is forwarded to all other ports. Event messages are
+	// timestamped on ingress and egress and the residence time is added to
+	// the correctionField. Since the correction can't go into a message that
+	// is already on the wire, it always travels two-step:
+	//
+	//  - a two-step Sync's residence goes into its Follow_Up, which is held
+	//    back if it overtakes the Sync's transmit timestamp
+	//  - a one-step Sync is forwarded as two-step and a Follow_Up is generated
+	//  - a Delay_Req's residence goes into the matching Delay_Resp on its way back
+	//
+	// In P2P mode (Config::delay_mechanism) Delay_Req/Delay_Resp are dropped
+	// and every port measures its link with its own PeerDelay, answering and
+	// sending Pdelay messages under the clock's identity. Pdelay messages stay
+	// on their link and Syncs additionally get the ingress link delay. In E2E
+	// mode Pdelay messages are forwarded like any other.
+	//
+	// The clock takes over the receive and transmit-completion callbacks of
+	// the handles passed to add_port(), they must not be shared with a PtpClock.
+	// Set the identity before adding ports, their Pdelay messages carry it.
+	//
+	class TransparentClock {
+	public:
+		static const size_t max_ports   = Config::tc_max_ports;
+		static const size_t max_pending = Config::tc_max_pending;
+
+		struct Stats {
+			uint32 forwarded;
+			uint32 corrected;
+			uint32 no_buffer;		// egress port had no transmit buffer
+			uint32 evicted;			// in-flight entry reused before its correction went out
+		};
+
+		TransparentClock(SystemPort& system_port, const Config& config);
+
+	private:
+		template< size_t... Indices >
+		TransparentClock(SystemPort& system_port, const Config& config, std::index_sequence<Indices...>);
+
+	public:
+		~TransparentClock();
+
+		void set_identity(const std::array<uint8, 6>& macaddr);
+
+		// Returns the port index or -1 if all ports are in use
+		int add_port(NetHandle event, NetHandle general);
+
+		// Link delay measured on the port, zero until its first Pdelay exchange
+		TimeInterval link_delay(size_t port) const;
+
+		const Stats& stats() const;
+
+	private:
+		class Port : public PeerDelayLink {
+		public:
+			Port(TransparentClock& owner, uint8 index);
+
+			void on_event(PacketHandle packet);
+			void on_general(PacketHandle packet);
+			void on_transmitted(uint32 id, Time time);
+
+			void build_transmit_templates();
+
+			// [PeerDelayLink]
+			SystemPort& get_system_port() override;
+			const Config& get_config() const override;
+			const PortIdentity& get_identity() const override;
+			NetHandle& event_port() override;
+			NetHandle& general_port() override;
+			const TransmitTemplates& transmit_templates() const override;
+			uint32 transmit_id(MessageTypes type, uint16 sequence_id) const override;
+
+			TransparentClock& owner;
+			uint8 index;
+			bool used;
+			NetHandle event;
+			NetHandle general;
+			PortIdentity identity;
+			TransmitTemplates templates;
+			PeerDelay peer_delay;
+		};
+
+		static const size_t max_held_size = 96;
+
+		// An event message in flight on one egress port
+		struct Pending {
+			PortIdentity source;
+			uint16 sequence_id;
+			MessageTypes type;
+			uint8 ingress;
+			uint8 egress;
+			uint32 generation;
+
+			Time ingress_time;
+			TimeInterval residence;
+			bool used;
+			bool transmitted;
+
+			// one-step Sync forwarded two-step: Follow_Up is generated from these
+			bool convert_to_two_step;
+			msg::Header header;
+			Time origin_timestamp;
+
+			// Follow_Up that arrived before the Sync's transmit timestamp
+			size_t held_size;
+			std::array<uint8, max_held_size> held;
+		};
+
+		void on_event(Port& ingress, PacketHandle packet);
+		void on_general(Port& ingress, PacketHandle packet);
+		void on_transmitted(Port& egress, uint32 id, Time time);
+
+		void on_follow_up(Port& ingress, const msg::Header& header, const PacketHandle& packet);
+		void on_delay_resp(Port& ingress, const msg::Header& header, const PacketHandle& packet);
+		void complete_sync(Pending& pending);
+
+		bool forward(NetHandle& port, uint16 port_number, const void* data, size_t size, const msg::Header& header, TimeInterval correction, uint32 id);
+		bool forward_event(Port& ingress, Port& egress, const msg::Header& header, const PacketHandle& packet);
+
+		Pending* allocate();
+		Pending* find(MessageTypes type, const PortIdentity& source, uint16 sequence_id, uint8 ingress, uint8 egress);
+		Pending* find(uint32 id);
+		uint32 transmit_id(const Pending& pending) const;
+		void release(Pending& pending);
+
+		static bool read_header(const PacketHandle& packet, msg::Header& header);
+
+		SystemPort& system_port_;
+		Config config_;
+		ClockIdentity identity_;
+		std::array<Port, max_ports> ports_;
+		std::array<Pending, max_pending> pending_;
+		uint32 generation_;
+		Stats stats_;
+	};
+
+}
+
+#endif
@@ -0,0 +1,223 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <microptp/config.hpp>
+#include <microptp/ptpclock.hpp>
+#include <microptp/unicast_client.hpp>
+#include <microptp/ports/systemport.hpp>
+
+namespace uptp {
+
+	bool to_unicast_stream(uint8 message_type, UnicastStream& stream)
+	{
+		switch(static_cast<MessageTypes>(message_type)) {
+		case MessageTypes::Announce:  stream = UnicastStream::Announce;  return true;
+		case MessageTypes::Synch:     stream = UnicastStream::Sync;      return true;
+		case MessageTypes::DelayResp: stream = UnicastStream::DelayResp; return true;
+		default:                      return false;
+		}
+	}
+
+	MessageTypes to_message_type(UnicastStream stream)
+	{
+		switch(stream) {
+		case UnicastStream::Announce: return MessageTypes::Announce;
+		case UnicastStream::Sync:     return MessageTypes::Synch;
+		default:                      return MessageTypes::DelayResp;
+		}
+	}
+
+	UnicastClient::UnicastClient(PtpPort& port)
+		: tick_timer_(port.get_system_port()),
+		  port_(port)
+	{
+		for(auto& master : masters_) {
+			master.identified = false;
+			for(auto& grant : master.grants) {
+				grant.granted = false;
+			}
+		}
+
+		tick_timer_.on_expired = ulib::function<void()>(this, &UnicastClient::on_tick);
+	}
+
+	UnicastClient::~UnicastClient()
+	{
+		tick_timer_.stop();
+	}
+
+	void UnicastClient::start()
+	{
+		tick_timer_.start(0);
+		on_tick();
+	}
+
+	void UnicastClient::stop()
+	{
+		tick_timer_.stop();
+
+		for(size_t i = 0; i < masters_.size(); ++i) {
+			for(size_t s = 0; s < num_unicast_streams; ++s) {
+				if(masters_[i].grants[s].granted) {
+					cancel(i, static_cast<UnicastStream>(s));
+				}
+			}
+		}
+	}
+
+	NetAddress UnicastClient::master_address(const PortIdentity& identity) const
+	{
+		const auto& table = port_.get_config().unicast_master_table;
+		for(size_t i = 0; i < masters_.size(); ++i) {
+			if(table[i] && masters_[i].identified && masters_[i].identity == identity) {
+				return table[i];
+			}
+		}
+
+		return NetAddress();
+	}
+
+	bool UnicastClient::wanted(const Master& master, UnicastStream stream) const
+	{
+		if(stream == UnicastStream::Announce) {
+			return true;
+		}
+
+		if(stream == UnicastStream::DelayResp && Config::delay_mechanism != Config::DelayMechanism::E2E) {
+			return false;
+		}
+
+		// time transfer only from the master we are synchronizing to
+		const auto* best = port_.master_tracker().best_foreign();
+		return port_.is<states::Slave>() && master.identified && best && best->port_identity == master.identity;
+	}
+
+	void UnicastClient::on_tick()
+	{
+		const auto& table = port_.get_config().unicast_master_table;
+
+		for(size_t i = 0; i < masters_.size(); ++i) {
+			if(!table[i]) {
+				continue;
+			}
+
+			auto& master = masters_[i];
+			for(size_t s = 0; s < num_unicast_streams; ++s) {
+				const auto stream = static_cast<UnicastStream>(s);
+				auto& grant = master.grants[s];
+
+				if(grant.granted && --grant.remaining == 0) {
+					grant.granted = false;
+				}
+
+				if(!wanted(master, stream)) {
+					if(grant.granted) {
+						cancel(i, stream);
+					}
+				} else if(!grant.granted || grant.remaining <= grant.duration / 2) {
+					request(i, stream);
+				}
+			}
+		}
+	}
+
+	int8 UnicastClient::log_interval(UnicastStream stream) const
+	{
+		const auto& config = port_.get_config();
+		switch(stream) {
+		case UnicastStream::Announce: return config.unicast_log_announce_interval;
+		case UnicastStream::Sync:     return config.unicast_log_sync_interval;
+		default:                      return config.unicast_log_delay_resp_interval;
+		}
+	}
+
+	PortIdentity UnicastClient::target(const Master& master) const
+	{
+		if(master.identified) {
+			return master.identity;
+		}
+
+		// all ones: any port of any clock
+		PortIdentity all;
+		all.clock.identity.fill(0xFF);
+		all.port = 0xFFFF;
+		return all;
+	}
+
+	void UnicastClient::request(size_t index, UnicastStream stream)
+	{
+		const auto tlv = msg::make_unicast_tlv(msg::TlvTypes::RequestUnicastTransmission, to_message_type(stream),
+			log_interval(stream), port_.get_config().unicast_grant_duration);
+		port_.send_signaling(port_.get_config().unicast_master_table[index], target(masters_[index]), tlv);
+	}
+
+	void UnicastClient::cancel(size_t index, UnicastStream stream)
+	{
+		masters_[index].grants[static_cast<size_t>(stream)].granted = false;
+
+		const auto tlv = msg::make_unicast_tlv(msg::TlvTypes::CancelUnicastTransmission, to_message_type(stream));
+		port_.send_signaling(port_.get_config().unicast_master_table[index], target(masters_[index]), tlv);
+	}
+
+	void UnicastClient::on_signaling(const msg::Header& header, const PacketHandle& packet)
+	{
+		const auto& table = port_.get_config().unicast_master_table;
+		const NetAddress address = packet->source_address();
+
+		size_t index = 0;
+		while(index < masters_.size() && !(table[index] && table[index] == address)) {
+			++index;
+		}
+
+		if(index == masters_.size()) {
+			return;
+		}
+
+		auto& master = masters_[index];
+		const auto* data = static_cast<const uint8*>(packet->get_data());
+
+		for(size_t offset = msg::message_size<msg::Signaling>(); offset + msg::TlvHeader::size <= header.message_length; ) {
+			msg::TlvHeader tlv_header;
+			msg::deserialize(data + offset, tlv_header);
+
+			const size_t tlv_size = msg::TlvHeader::size + tlv_header.length_field;
+			if(offset + tlv_size > header.message_length) {
+				break;
+			}
+
+			// too short for its layout, the fields past lengthField belong to the next TLV
+			if(tlv_header.length_field < msg::unicast_tlv_length(static_cast<msg::TlvTypes>(tlv_header.tlv_type))) {
+				offset += tlv_size;
+				continue;
+			}
+
+			if(tlv_header.is(msg::TlvTypes::GrantUnicastTransmission) || tlv_header.is(msg::TlvTypes::CancelUnicastTransmission)) {
+				msg::UnicastTransmissionTlv tlv;
+				msg::deserialize(data + offset, tlv);
+
+				UnicastStream stream;
+				if(to_unicast_stream(tlv.message_type, stream)) {
+					auto& grant = master.grants[static_cast<size_t>(stream)];
+
+					if(tlv.is(msg::TlvTypes::GrantUnicastTransmission)) {
+						master.identity = header.source_port_identity;
+						master.identified = true;
+
+						// a zero duration denies the request, it is retried on the next tick
+						grant.granted = tlv.duration != 0;
+						grant.remaining = grant.duration = tlv.duration;
+					} else {
+						grant.granted = false;
+						const auto ack = msg::make_unicast_tlv(msg::TlvTypes::AcknowledgeCancelUnicastTransmission, to_message_type(stream));
+						port_.send_signaling(address, header.source_port_identity, ack);
+					}
+				}
+			}
+
+			offset += tlv_size;
+		}
+	}
+
+}
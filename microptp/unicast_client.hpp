@@ -0,0 +1,81 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_UNICAST_CLIENT_HPP__
+#define MICROPTP_UNICAST_CLIENT_HPP__
+
+#include <array>
+#include <microptp/config.hpp>
+#include <microptp/messages.hpp>
+#include <microptp/interval_timer.hpp>
+#include <microptp/ports/systemportapi.hpp>
+
+namespace uptp {
+
+	class PtpPort;
+
+	// Message streams a unicast slave negotiates with its masters
+	enum class UnicastStream : uint8 {
+		Announce,
+		Sync,
+		DelayResp
+	};
+
+	constexpr size_t num_unicast_streams = 3;
+
+	// false for message types that can't be requested
+	bool to_unicast_stream(uint8 message_type, UnicastStream& stream);
+	MessageTypes to_message_type(UnicastStream stream);
+
+	//
+	// Slave side of unicast negotiation, owned by the port.
+	// Announce is requested from every entry of Config::unicast_master_table,
+	// so the masters take part in the BMC like multicast ones. Sync and, for
+	// E2E, Delay_Resp are only requested from the master the port is Slave to,
+	// and cancelled again once it isn't. Grants are counted down by a one
+	// second tick and renewed when half of their duration has run out.
+	//
+	class UnicastClient {
+	public:
+		UnicastClient(PtpPort& port);
+		~UnicastClient();
+
+		void start();
+		void stop();
+
+		// GRANT and CANCEL_UNICAST_TRANSMISSION from the masters
+		void on_signaling(const msg::Header& header, const PacketHandle& packet);
+
+		// Address of the table entry the master with [identity] answered from, 0 if none
+		NetAddress master_address(const PortIdentity& identity) const;
+
+	private:
+		struct Grant {
+			uint32 remaining;	// seconds
+			uint32 duration;
+			bool granted;
+		};
+
+		struct Master {
+			PortIdentity identity;
+			bool identified;
+			std::array<Grant, num_unicast_streams> grants;
+		};
+
+		void on_tick();
+		bool wanted(const Master& master, UnicastStream stream) const;
+		void request(size_t index, UnicastStream stream);
+		void cancel(size_t index, UnicastStream stream);
+		int8 log_interval(UnicastStream stream) const;
+		PortIdentity target(const Master& master) const;
+
+		IntervalTimer tick_timer_;
+		std::array<Master, Config::unicast_master_table_size> masters_;
+		PtpPort& port_;
+	};
+
+}
+
+#endif
@@ -0,0 +1,321 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <microptp/config.hpp>
+#include <microptp/ptpclock.hpp>
+#include <microptp/unicast_grantor.hpp>
+#include <microptp/ports/systemport.hpp>
+
+#if !UPTP_SLAVE_ONLY
+
+namespace uptp {
+
+	UnicastGrantor::UnicastGrantor(PtpPort& port)
+		: tick_timer_(port.get_system_port()),
+		  expiry_timer_(port.get_system_port()),
+		  tick_log_interval_(0), ticking_(false),
+		  sync_sequence_id_(0),
+		  port_(port)
+	{
+		for(auto& client : clients_) {
+			client.used = false;
+		}
+
+		tick_timer_.on_expired   = ulib::function<void()>(this, &UnicastGrantor::on_tick);
+		expiry_timer_.on_expired = ulib::function<void()>(this, &UnicastGrantor::on_expiry_timer);
+		expiry_timer_.start(0);
+	}
+
+	UnicastGrantor::~UnicastGrantor()
+	{
+		tick_timer_.stop();
+		expiry_timer_.stop();
+	}
+
+	UnicastGrantor::Client* UnicastGrantor::find(const NetAddress& address)
+	{
+		for(auto& client : clients_) {
+			if(client.used && client.address == address) {
+				return &client;
+			}
+		}
+
+		return nullptr;
+	}
+
+	const UnicastGrantor::Client* UnicastGrantor::find(const NetAddress& address) const
+	{
+		for(auto& client : clients_) {
+			if(client.used && client.address == address) {
+				return &client;
+			}
+		}
+
+		return nullptr;
+	}
+
+	UnicastGrantor::Client* UnicastGrantor::allocate(const NetAddress& address)
+	{
+		for(auto& client : clients_) {
+			if(!client.used) {
+				client.address = address;
+				client.announce_sequence_id = 0;
+				client.sync_sequence_id = 0;
+				client.follow_up_pending = false;
+				client.used = true;
+				for(auto& grant : client.grants) {
+					grant.granted = false;
+				}
+				return &client;
+			}
+		}
+
+		return nullptr;
+	}
+
+	bool UnicastGrantor::granted(const NetAddress& address, UnicastStream stream) const
+	{
+		const auto* client = find(address);
+		return client && client->grants[static_cast<size_t>(stream)].granted;
+	}
+
+	void UnicastGrantor::on_signaling(const msg::Header& header, const PacketHandle& packet)
+	{
+		const NetAddress address = packet->source_address();
+		const auto* data = static_cast<const uint8*>(packet->get_data());
+
+		for(size_t offset = msg::message_size<msg::Signaling>(); offset + msg::TlvHeader::size <= header.message_length; ) {
+			msg::TlvHeader tlv_header;
+			msg::deserialize(data + offset, tlv_header);
+
+			const size_t tlv_size = msg::TlvHeader::size + tlv_header.length_field;
+			if(offset + tlv_size > header.message_length) {
+				break;
+			}
+
+			// too short for its layout, the fields past lengthField belong to the next TLV
+			if(tlv_header.length_field < msg::unicast_tlv_length(static_cast<msg::TlvTypes>(tlv_header.tlv_type))) {
+				offset += tlv_size;
+				continue;
+			}
+
+			if(tlv_header.is(msg::TlvTypes::RequestUnicastTransmission)) {
+				msg::UnicastTransmissionTlv tlv;
+				msg::deserialize(data + offset, tlv);
+				on_request(address, header, tlv);
+			} else if(tlv_header.is(msg::TlvTypes::CancelUnicastTransmission)) {
+				msg::UnicastTransmissionTlv tlv;
+				msg::deserialize(data + offset, tlv);
+				on_cancel(address, header, tlv);
+			}
+
+			offset += tlv_size;
+		}
+	}
+
+	void UnicastGrantor::on_request(const NetAddress& address, const msg::Header& header, const msg::UnicastTransmissionTlv& tlv)
+	{
+		const auto& config = port_.get_config();
+		auto response = msg::make_unicast_tlv(msg::TlvTypes::GrantUnicastTransmission,
+			static_cast<MessageTypes>(tlv.message_type), tlv.log_inter_message_period);
+
+		UnicastStream stream;
+		const bool known = to_unicast_stream(tlv.message_type, stream);
+		const int8 min_log_interval = (known && stream == UnicastStream::Announce) ? IntervalTimer::min_log_interval : config.unicast_min_log_sync_interval;
+		// the period comes from the network, the tick counts shift by it
+		const int8 max_log_interval = (config.unicast_max_log_interval < IntervalTimer::max_log_interval) ? config.unicast_max_log_interval : IntervalTimer::max_log_interval;
+
+		Client* client = nullptr;
+		if(known && tlv.log_inter_message_period >= min_log_interval && tlv.log_inter_message_period <= max_log_interval) {
+			client = find(address);
+			if(!client) {
+				client = allocate(address);
+			}
+		}
+
+		// unknown streams, rates out of range or a full table: deny with a zero duration
+		if(client) {
+			auto& grant = client->grants[static_cast<size_t>(stream)];
+			const bool was_granted = grant.granted;
+			const bool interval_changed = !was_granted || grant.log_interval != tlv.log_inter_message_period;
+
+			grant.granted = true;
+			grant.remaining = (tlv.duration < config.unicast_max_grant_duration) ? tlv.duration : config.unicast_max_grant_duration;
+			grant.log_interval = tlv.log_inter_message_period;
+
+			response.duration = grant.remaining;
+			response.flags = uint8(msg::UnicastTransmissionTlv::GrantFlags::RenewalInvited);
+
+			if(grant.remaining == 0) {
+				grant.granted = false;
+				restart_tick();
+			} else if(interval_changed && stream != UnicastStream::DelayResp) {
+				grant.ticks_left = 1;
+				restart_tick();
+			}
+		}
+
+		port_.send_signaling(address, header.source_port_identity, response);
+	}
+
+	void UnicastGrantor::on_cancel(const NetAddress& address, const msg::Header& header, const msg::UnicastTransmissionTlv& tlv)
+	{
+		UnicastStream stream;
+		auto* client = find(address);
+		if(!client || !to_unicast_stream(tlv.message_type, stream)) {
+			return;
+		}
+
+		client->grants[static_cast<size_t>(stream)].granted = false;
+
+		const auto ack = msg::make_unicast_tlv(msg::TlvTypes::AcknowledgeCancelUnicastTransmission, static_cast<MessageTypes>(tlv.message_type));
+		port_.send_signaling(address, header.source_port_identity, ack);
+		restart_tick();
+	}
+
+	void UnicastGrantor::restart_tick()
+	{
+		bool any = false;
+		int8 fastest = 0;
+
+		for(auto& client : clients_) {
+			if(!client.used) {
+				continue;
+			}
+
+			bool any_grant = false;
+			for(size_t s = 0; s < num_unicast_streams; ++s) {
+				const auto& grant = client.grants[s];
+				if(!grant.granted) {
+					continue;
+				}
+
+				any_grant = true;
+				if(static_cast<UnicastStream>(s) != UnicastStream::DelayResp && (!any || grant.log_interval < fastest)) {
+					fastest = grant.log_interval;
+					any = true;
+				}
+			}
+
+			client.used = any_grant;
+		}
+
+		if(!any) {
+			tick_timer_.stop();
+			ticking_ = false;
+		} else if(!ticking_ || fastest != tick_log_interval_) {
+			// the tick rate changed, every stream is rescheduled from its next tick on
+			tick_log_interval_ = fastest;
+			ticking_ = true;
+			for(auto& client : clients_) {
+				for(auto& grant : client.grants) {
+					grant.ticks_left = 1;
+				}
+			}
+			tick_timer_.start(tick_log_interval_);
+		}
+	}
+
+	void UnicastGrantor::on_tick()
+	{
+		for(auto& client : clients_) {
+			if(!client.used) {
+				continue;
+			}
+
+			for(size_t s = 0; s < num_unicast_streams; ++s) {
+				const auto stream = static_cast<UnicastStream>(s);
+				auto& grant = client.grants[s];
+				if(!grant.granted || stream == UnicastStream::DelayResp || --grant.ticks_left != 0) {
+					continue;
+				}
+
+				grant.ticks_left = 1u << (grant.log_interval - tick_log_interval_);
+				if(stream == UnicastStream::Announce) {
+					send_announce(client);
+				} else {
+					send_sync(client);
+				}
+			}
+		}
+	}
+
+	void UnicastGrantor::on_expiry_timer()
+	{
+		bool expired = false;
+
+		for(auto& client : clients_) {
+			if(!client.used) {
+				continue;
+			}
+
+			for(auto& grant : client.grants) {
+				if(grant.granted && --grant.remaining == 0) {
+					grant.granted = false;
+					expired = true;
+				}
+			}
+		}
+
+		if(expired) {
+			restart_tick();
+		}
+	}
+
+	void UnicastGrantor::send_announce(Client& client)
+	{
+		auto& port = port_.general_port();
+		auto handle = port_.transmit_templates().announce.make(port, client.announce_sequence_id++);
+
+		if(handle) {
+			TransmitTemplate<msg::Announce>::set_timestamp(handle, port_.clock().domain_clock().get_time());
+			port->send(client.address, general_port_number, std::move(handle), untracked_transmit_id);
+		}
+	}
+
+	void UnicastGrantor::send_sync(Client& client)
+	{
+		if(Config::gptp_profile && !port_.peer_delay().as_capable()) {
+			return;
+		}
+
+		auto& port = port_.event_port();
+		const uint16 sequence_id = sync_sequence_id_++;
+		auto handle = port_.transmit_templates().sync.make(port, sequence_id);
+
+		if(handle) {
+			client.sync_sequence_id = sequence_id;
+			client.follow_up_pending = true;
+			port->send(client.address, event_port_number, std::move(handle), port_.transmit_id(MessageTypes::Synch, sequence_id));
+		}
+	}
+
+	void UnicastGrantor::on_transmitted(uint32 id, Time time)
+	{
+		if(transmit_type(id) != MessageTypes::Synch) {
+			return;
+		}
+
+		const uint16 sequence_id = static_cast<uint16>(id);
+		for(auto& client : clients_) {
+			if(!client.used || !client.follow_up_pending || client.sync_sequence_id != sequence_id) {
+				continue;
+			}
+
+			client.follow_up_pending = false;
+
+			auto& port = port_.general_port();
+			auto handle = port_.transmit_templates().follow_up.make(port, sequence_id);
+			if(handle) {
+				TransmitTemplate<TransmitTemplates::follow_up_message>::set_timestamp(handle, time);
+				port->send(client.address, general_port_number, std::move(handle), untracked_transmit_id);
+			}
+			break;
+		}
+	}
+
+}
+
+#endif
@@ -0,0 +1,85 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_UNICAST_GRANTOR_HPP__
+#define MICROPTP_UNICAST_GRANTOR_HPP__
+
+#include <array>
+#include <microptp/config.hpp>
+#include <microptp/unicast_client.hpp>
+
+#if !UPTP_SLAVE_ONLY
+
+namespace uptp {
+
+	class PtpPort;
+
+	//
+	// Master side of unicast negotiation, owned by the Master state.
+	// Requests are granted up to Config::unicast_max_clients slaves, for at
+	// most unicast_max_grant_duration, no faster than
+	// unicast_min_log_sync_interval and no slower than
+	// unicast_max_log_interval. Announce and Sync go out from a single
+	// timer running at the fastest granted interval, every grant counts the
+	// ticks to its next message. A second timer expires the grants.
+	// Follow_Ups go to the slave whose Sync reported its transmit timestamp,
+	// so all clients share one Sync sequence counter.
+	//
+	class UnicastGrantor {
+	public:
+		UnicastGrantor(PtpPort& port);
+		~UnicastGrantor();
+
+		// REQUEST and CANCEL_UNICAST_TRANSMISSION from the slaves
+		void on_signaling(const msg::Header& header, const PacketHandle& packet);
+		void on_transmitted(uint32 id, Time time);
+
+		bool granted(const NetAddress& address, UnicastStream stream) const;
+
+	private:
+		struct Grant {
+			uint32 remaining;	// seconds
+			uint32 ticks_left;
+			int8 log_interval;
+			bool granted;
+		};
+
+		struct Client {
+			NetAddress address;
+			uint16 announce_sequence_id;
+			uint16 sync_sequence_id;
+			bool follow_up_pending;
+			bool used;
+			std::array<Grant, num_unicast_streams> grants;
+		};
+
+		void on_request(const NetAddress& address, const msg::Header& header, const msg::UnicastTransmissionTlv& tlv);
+		void on_cancel(const NetAddress& address, const msg::Header& header, const msg::UnicastTransmissionTlv& tlv);
+		Client* find(const NetAddress& address);
+		const Client* find(const NetAddress& address) const;
+		Client* allocate(const NetAddress& address);
+
+		void on_tick();
+		void on_expiry_timer();
+		void restart_tick();
+
+		void send_announce(Client& client);
+		void send_sync(Client& client);
+
+		IntervalTimer tick_timer_;
+		IntervalTimer expiry_timer_;
+		int8 tick_log_interval_;
+		bool ticking_;
+		uint16 sync_sequence_id_;
+
+		std::array<Client, Config::unicast_max_clients> clients_;
+		PtpPort& port_;
+	};
+
+}
+
+#endif
+
+#endif
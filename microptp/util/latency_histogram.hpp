@@ -0,0 +1,117 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_UTIL_LATENCY_HISTOGRAM_HPP__
+#define MICROPTP_UTIL_LATENCY_HISTOGRAM_HPP__
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <microptp/types.hpp>
+
+namespace uptp {
+
+	//
+	// Distribution of latencies in power of two buckets: bucket i counts
+	// samples below 2^(i+1) nanoseconds, the last one everything above.
+	// One thread records, any other may read or reset, so counts taken
+	// while samples come in may be off by the samples in flight.
+	//
+	class LatencyHistogram {
+	public:
+		static const size_t num_buckets = 24;	// up to 8.4 ms (2^23 ns), then the overflow bucket
+
+		LatencyHistogram()
+		{
+			reset();
+		}
+
+		LatencyHistogram(const LatencyHistogram&) = delete;
+		LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+		void record(int64 nanos)
+		{
+			const uint32 value = nanos < 0 ? 0 : nanos > 0xFFFFFFFF ? 0xFFFFFFFF : static_cast<uint32>(nanos);
+
+			size_t bucket = 0;
+			while(bucket < num_buckets - 1 && (value >> (bucket + 1))) {
+				++bucket;
+			}
+
+			buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+			count_.fetch_add(1, std::memory_order_relaxed);
+			if(value < min_.load(std::memory_order_relaxed)) {
+				min_.store(value, std::memory_order_relaxed);
+			}
+			if(value > max_.load(std::memory_order_relaxed)) {
+				max_.store(value, std::memory_order_relaxed);
+			}
+		}
+
+		void reset()
+		{
+			for(auto& bucket : buckets_) {
+				bucket.store(0, std::memory_order_relaxed);
+			}
+			count_.store(0, std::memory_order_relaxed);
+			min_.store(0xFFFFFFFF, std::memory_order_relaxed);
+			max_.store(0, std::memory_order_relaxed);
+		}
+
+		uint32 count() const
+		{
+			return count_.load(std::memory_order_relaxed);
+		}
+
+		uint32 bucket(size_t i) const
+		{
+			return buckets_[i].load(std::memory_order_relaxed);
+		}
+
+		// upper bound of bucket [i] in nanoseconds
+		static uint32 bucket_limit(size_t i)
+		{
+			return i < num_buckets - 1 ? (uint32(2) << i) : 0xFFFFFFFF;
+		}
+
+		uint32 min() const
+		{
+			return count() ? min_.load(std::memory_order_relaxed) : 0;
+		}
+
+		uint32 max() const
+		{
+			return max_.load(std::memory_order_relaxed);
+		}
+
+		// Upper bound of the bucket holding the [permille]th sample, 0 without samples
+		uint32 percentile(uint32 permille) const
+		{
+			const uint64 total = count();
+			if(!total) {
+				return 0;
+			}
+
+			const uint64 rank = (total * permille + 999) / 1000;
+			uint64 seen = 0;
+			for(size_t i = 0; i < num_buckets; ++i) {
+				seen += bucket(i);
+				if(seen >= rank) {
+					return bucket_limit(i) < max() ? bucket_limit(i) : max();
+				}
+			}
+			return max();
+		}
+
+	private:
+		std::array<std::atomic<uint32>, num_buckets> buckets_;
+		std::atomic<uint32> count_;
+		std::atomic<uint32> min_;
+		std::atomic<uint32> max_;
+	};
+
+}
+
+#endif
@@ -0,0 +1,135 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_UTIL_MPSC_QUEUE_HPP__
+#define MICROPTP_UTIL_MPSC_QUEUE_HPP__
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <microptp/types.hpp>
+
+namespace uptp {
+
+	//
+	// Bounded multi-producer/single-consumer queue without locks, for handing
+	// packets and commands to a system port's thread from stack threads,
+	// interrupt handlers and the like. Every cell carries a sequence number
+	// (D. Vyukov's bounded queue): producers claim a cell with a CAS on the
+	// tail, the consumer alone moves the head. A full queue rejects the push
+	// and counts it, so lost events show up in stats() instead of vanishing.
+	// Needs lock-free atomics of size_t, which Cortex-M3 and up have.
+	//
+	template< typename T, size_t Depth >
+	class MpscQueue {
+		static_assert(Depth >= 2 && (Depth & (Depth - 1)) == 0, "queue depth must be a power of two");
+
+	public:
+		static const size_t depth = Depth;
+
+		struct Stats {
+			uint32 pushed;
+			uint32 dropped;
+			uint32 high_water;	// most entries queued at once
+		};
+
+		MpscQueue()
+			: tail_(0), head_(0), pushed_(0), dropped_(0), high_water_(0)
+		{
+			for(size_t i = 0; i < Depth; ++i) {
+				cells_[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		MpscQueue(const MpscQueue&) = delete;
+		MpscQueue& operator=(const MpscQueue&) = delete;
+
+		// Any thread. False if the queue is full, [value] is left alone then.
+		bool push(T&& value)
+		{
+			size_t pos = tail_.load(std::memory_order_relaxed);
+			Cell* cell;
+			for(;;) {
+				cell = &cells_[pos & (Depth - 1)];
+				const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+				const auto diff = static_cast<std::ptrdiff_t>(sequence - pos);
+				if(diff == 0) {
+					if(tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						break;
+					}
+				} else if(diff < 0) {
+					dropped_.fetch_add(1, std::memory_order_relaxed);
+					return false;
+				} else {
+					pos = tail_.load(std::memory_order_relaxed);
+				}
+			}
+
+			cell->value = std::move(value);
+			cell->sequence.store(pos + 1, std::memory_order_release);
+
+			pushed_.fetch_add(1, std::memory_order_relaxed);
+			update_high_water(static_cast<uint32>(pos + 1 - head_.load(std::memory_order_relaxed)));
+			return true;
+		}
+
+		// Consumer thread only. False if the queue is empty.
+		bool pop(T& value)
+		{
+			const size_t head = head_.load(std::memory_order_relaxed);
+			Cell& cell = cells_[head & (Depth - 1)];
+			const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			if(static_cast<std::ptrdiff_t>(sequence - (head + 1)) < 0) {
+				return false;
+			}
+
+			value = std::move(cell.value);
+			cell.sequence.store(head + Depth, std::memory_order_release);
+			head_.store(head + 1, std::memory_order_relaxed);
+			return true;
+		}
+
+		Stats stats() const
+		{
+			Stats result;
+			result.pushed     = pushed_.load(std::memory_order_relaxed);
+			result.dropped    = dropped_.load(std::memory_order_relaxed);
+			result.high_water = high_water_.load(std::memory_order_relaxed);
+			return result;
+		}
+
+		void reset_stats()
+		{
+			pushed_.store(0, std::memory_order_relaxed);
+			dropped_.store(0, std::memory_order_relaxed);
+			high_water_.store(0, std::memory_order_relaxed);
+		}
+
+	private:
+		void update_high_water(uint32 count)
+		{
+			uint32 current = high_water_.load(std::memory_order_relaxed);
+			while(count > current && !high_water_.compare_exchange_weak(current, count, std::memory_order_relaxed)) {
+			}
+		}
+
+		struct Cell {
+			std::atomic<size_t> sequence;
+			T value;
+		};
+
+		std::array<Cell, Depth> cells_;
+		std::atomic<size_t> tail_;
+		std::atomic<size_t> head_;		// written by the consumer only, read for the high water mark
+
+		std::atomic<uint32> pushed_;
+		std::atomic<uint32> dropped_;
+		std::atomic<uint32> high_water_;
+	};
+
+}
+
+#endif
@@ -4,6 +4,7 @@
 #include <cstring>
 #include <microptp/util/utiltypes.hpp>
 #include <microptp/types.hpp>
+#include <microptp/ptpdatatypes.hpp>
 #include <microptp/ports/systemport_defaults.hpp>
 
 namespace uptp {
@@ -20,6 +21,32 @@ namespace uptp {
 	using int4u = nibble_upper_type<true>;
 	using int4l = nibble_lower_type<true>;
 
+	// 48 bit seconds followed by 32 bit nanoseconds
+	struct timestamp_type {};
+
+	using timestamp = timestamp_type;
+
+	// Number of bytes a packet type occupies on the wire
+	template< typename PacketType >
+	struct wire_size {
+		static constexpr size_t value = sizeof(PacketType);
+	};
+
+	template< bool Signed >
+	struct wire_size< nibble_upper_type<Signed> > {
+		static constexpr size_t value = 1;
+	};
+
+	template< bool Signed >
+	struct wire_size< nibble_lower_type<Signed> > {
+		static constexpr size_t value = 1;
+	};
+
+	template<>
+	struct wire_size< timestamp > {
+		static constexpr size_t value = 10;
+	};
+
 	
 	namespace detail {
 
@@ -45,32 +72,21 @@ namespace uptp {
 			return reinterpret_cast<const uint8*>(buff) + offset;
 		}
 		
-		template< typename PacketType, typename HostType, size_t Offset, size_t Alignment >
+		template< typename PacketType, typename HostType, size_t Offset >
 		struct xchange {
 
 			static void serialize(void* buffer, const HostType& host) {
-				if (Alignment % std::alignment_of<PacketType>::value == 0) {
-					reinterpret<PacketType>(buffer, Offset) = static_cast<PacketType>(system::to_net_byteorder(host));
-				} else {
-					PacketType temp = static_cast<PacketType>(system::to_net_byteorder(host));
-					memcpy(offset(buffer, Offset), &temp, sizeof(PacketType));
-				}
+				system::store_net<PacketType>(offset(buffer, Offset), static_cast<PacketType>(host));
 			}
 
 			static void deserialize(const void* buffer, HostType& host) {
-				if (Alignment % std::alignment_of<PacketType>::value == 0) {
-					host = static_cast<HostType>(system::to_host_byteorder(reinterpret<PacketType>(buffer, Offset)));
-				} else {
-					PacketType temp;
-					memcpy(&temp, offset(buffer, Offset), sizeof(PacketType));
-					host = static_cast<HostType>(system::to_host_byteorder(temp));
-				}
+				host = static_cast<HostType>(system::load_net<PacketType>(offset(buffer, Offset)));
 			}
 
 		};
 
-		template<typename HostType, size_t Offset, size_t Alignment>
-		struct xchange< uint4u, HostType, Offset, Alignment > {
+		template<typename HostType, size_t Offset>
+		struct xchange< uint4u, HostType, Offset > {
 			static void serialize(void* buffer, const HostType& host) {
 				reinterpret<uint8>(buffer, Offset) = (reinterpret<uint8>(buffer, Offset) & 0x0F) | ((host & 0x0F) << 4);
 			}
@@ -80,8 +96,8 @@ namespace uptp {
 			}
 		};
 
-		template< typename HostType, size_t Offset, size_t Alignment >
-		struct xchange< uint4l, HostType, Offset, Alignment > {
+		template< typename HostType, size_t Offset >
+		struct xchange< uint4l, HostType, Offset > {
 			static void serialize(void* buffer, const HostType& host) {
 				reinterpret<uint8>(buffer, Offset) = (reinterpret<uint8>(buffer, Offset) & 0xF0) | (host & 0x0F);
 			}
@@ -91,8 +107,8 @@ namespace uptp {
 			}
 		};
 
-		template< typename HostType, size_t Offset, size_t Alignment >
-		struct xchange< int4u, HostType, Offset, Alignment > {
+		template< typename HostType, size_t Offset >
+		struct xchange< int4u, HostType, Offset > {
 			static void serialize(void* buffer, const HostType& host) {
 				reinterpret<uint8>(buffer, Offset) = (reinterpret<uint8>(buffer, Offset) & 0x0F) | ((host & 0x0F) << 4);
 			}
@@ -103,8 +119,8 @@ namespace uptp {
 			}
 		};
 
-		template< typename HostType, size_t Offset, size_t Alignment >
-		struct xchange< int4l, HostType, Offset, Alignment > {
+		template< typename HostType, size_t Offset >
+		struct xchange< int4l, HostType, Offset > {
 			static void serialize(void* buffer, const HostType& host) {
 				reinterpret<uint8>(buffer, Offset) = (reinterpret<uint8>(buffer, Offset) & 0xF0) | (host & 0x0F);
 			}
@@ -115,14 +131,30 @@ namespace uptp {
 			}
 		};
 
+		template< size_t Offset >
+		struct xchange< timestamp, Time, Offset > {
+			static void serialize(void* buffer, const Time& host) {
+				const uint64 seconds = host.wire_seconds();
+				system::store_net<uint16>(offset(buffer, Offset), static_cast<uint16>(seconds >> 32));
+				system::store_net<uint32>(offset(buffer, Offset + 2), static_cast<uint32>(seconds));
+				system::store_net<uint32>(offset(buffer, Offset + 6), host.wire_nanoseconds());
+			}
+
+			static void deserialize(const void* buffer, Time& host) {
+				const uint64 seconds_upper = system::load_net<uint16>(offset(buffer, Offset));
+				const uint64 seconds_lower = system::load_net<uint32>(offset(buffer, Offset + 2));
+				host = Time::from_wire((seconds_upper << 32) | seconds_lower, system::load_net<uint32>(offset(buffer, Offset + 6)));
+			}
+		};
+
 		// Arrays
-		template< typename HostType, size_t Offset, typename TargetType, size_t Size, size_t Alignment >
-		struct xchange< TargetType[Size], HostType, Offset, Alignment >
+		template< typename HostType, size_t Offset, typename TargetType, size_t Size >
+		struct xchange< TargetType[Size], HostType, Offset >
 		{
 			template< size_t Index >
 			static void write(void* buffer, const HostType& host, util::size_t_type<Index>)
 			{
-				xchange<TargetType, std::decay_t<decltype(host[0])>, Offset + Index * sizeof(TargetType), Alignment>::serialize(buffer, host[Index]);
+				xchange<TargetType, std::decay_t<decltype(host[0])>, Offset + Index * sizeof(TargetType)>::serialize(buffer, host[Index]);
 				write(buffer, host, util::size_t_type<Index + 1>());
 			}
 
@@ -140,7 +172,7 @@ namespace uptp {
 			template< size_t Index >
 			static void read(const void* buffer, HostType& host, util::size_t_type<Index>)
 			{
-				xchange<TargetType, std::decay_t<decltype(host[0])>, Offset + Index * sizeof(TargetType), Alignment>::deserialize(buffer, host[Index]);
+				xchange<TargetType, std::decay_t<decltype(host[0])>, Offset + Index * sizeof(TargetType)>::deserialize(buffer, host[Index]);
 				read(buffer, host, util::size_t_type<Index + 1>());
 			}
 
@@ -172,7 +204,7 @@ namespace uptp {
 		template< typename PacketType, size_t offset, typename HostType >
 		net_const_buffer& deserialize(HostType& host)
 		{
-			detail::xchange<PacketType, HostType, offset, 2>::deserialize(ptr_, host);
+			detail::xchange<PacketType, HostType, offset>::deserialize(ptr_, host);
 			return *this;
 		}
 
@@ -200,14 +232,21 @@ namespace uptp {
 		template< typename PacketType, size_t offset, typename HostType >
 		net_buffer& deserialize(HostType& host)
 		{
-			detail::xchange<PacketType, HostType, offset, 2>::deserialize(ptr_, host);
+			detail::xchange<PacketType, HostType, offset>::deserialize(ptr_, host);
 			return *this;
 		}
 
 		template< typename PacketType, size_t offset, typename HostType >
 		net_buffer& serialize(const HostType& host)
 		{
-			detail::xchange<PacketType, HostType, offset, 2>::serialize(ptr_, host);
+			detail::xchange<PacketType, HostType, offset>::serialize(ptr_, host);
+			return *this;
+		}
+
+		template< size_t offset, size_t size >
+		net_buffer& zero()
+		{
+			std::memset(detail::offset(ptr_, offset), 0, size);
 			return *this;
 		}
 
@@ -222,6 +261,147 @@ namespace uptp {
 		void* ptr_;
 	};
 
+	//
+	// Message layouts
+	// A layout is a table of fields at fixed wire offsets, from which the encoder,
+	// the decoder and the static size are generated. Describe each message once:
+	//
+	//   using announce = layout::table<
+	//       UPTP_FIELD(uint16, 44, &Announce::current_utc_offset),
+	//       UPTP_NESTED(clock_quality, 48, &Announce::grandmaster_clock_quality),
+	//       ...
+	//   >;
+	//
+	namespace layout {
+
+		namespace detail {
+
+			constexpr size_t max_end()
+			{
+				return 0;
+			}
+
+			template< typename... Ends >
+			constexpr size_t max_end(size_t end, Ends... ends)
+			{
+				return (end > max_end(ends...)) ? end : max_end(ends...);
+			}
+
+		}
+
+		// PacketType on the wire at Offset, mapped to the host member Member
+		template< typename PacketType, size_t Offset, typename MemberPtr, MemberPtr Member >
+		struct field {
+			static constexpr size_t end = Offset + wire_size<PacketType>::value;
+
+			template< size_t Base, typename Host >
+			static void serialize(net_buffer buff, const Host& host)
+			{
+				buff.serialize<PacketType, Base + Offset>(host.*Member);
+			}
+
+			template< size_t Base, typename Host >
+			static void deserialize(net_const_buffer buff, Host& host)
+			{
+				buff.deserialize<PacketType, Base + Offset>(host.*Member);
+			}
+
+			// write a single value, used to patch pre-serialized messages
+			template< size_t Base, typename Value >
+			static void write(net_buffer buff, const Value& value)
+			{
+				buff.serialize<PacketType, Base + Offset>(value);
+			}
+		};
+
+		// Another layout at Offset, mapped to the host member Member
+		template< typename Layout, size_t Offset, typename MemberPtr, MemberPtr Member >
+		struct nested {
+			static constexpr size_t end = Offset + Layout::size;
+
+			template< size_t Base, typename Host >
+			static void serialize(net_buffer buff, const Host& host)
+			{
+				Layout::template serialize<Base + Offset>(buff, host.*Member);
+			}
+
+			template< size_t Base, typename Host >
+			static void deserialize(net_const_buffer buff, Host& host)
+			{
+				Layout::template deserialize<Base + Offset>(buff, host.*Member);
+			}
+
+			template< size_t Base, typename Value >
+			static void write(net_buffer buff, const Value& value)
+			{
+				Layout::template serialize<Base + Offset>(buff, value);
+			}
+		};
+
+		// Written as zero, ignored on reception
+		template< typename PacketType, size_t Offset >
+		struct reserved {
+			static constexpr size_t end = Offset + wire_size<PacketType>::value;
+
+			template< size_t Base, typename Host >
+			static void serialize(net_buffer buff, const Host&)
+			{
+				buff.serialize<PacketType, Base + Offset>(0);
+			}
+
+			template< size_t Base, typename Host >
+			static void deserialize(net_const_buffer, Host&)
+			{
+			}
+		};
+
+		template< typename PacketType, size_t Size, size_t Offset >
+		struct reserved< PacketType[Size], Offset > {
+			static constexpr size_t end = Offset + Size * wire_size<PacketType>::value;
+
+			template< size_t Base, typename Host >
+			static void serialize(net_buffer buff, const Host&)
+			{
+				buff.zero<Base + Offset, Size * wire_size<PacketType>::value>();
+			}
+
+			template< size_t Base, typename Host >
+			static void deserialize(net_const_buffer, Host&)
+			{
+			}
+		};
+
+		template< typename... Fields >
+		struct table {
+			// offset one past the last byte of the last field
+			static constexpr size_t size = detail::max_end(Fields::end...);
+
+			template< size_t Base = 0, typename Host >
+			static void serialize(net_buffer buff, const Host& host)
+			{
+				using expand = int[];
+				(void) expand{ 0, (Fields::template serialize<Base>(buff, host), 0)... };
+			}
+
+			template< size_t Base = 0, typename Host >
+			static void deserialize(net_const_buffer buff, Host& host)
+			{
+				using expand = int[];
+				(void) expand{ 0, (Fields::template deserialize<Base>(buff, host), 0)... };
+			}
+
+			// true if a packet of packet_size bytes holds the whole table
+			static constexpr bool fits(size_t packet_size)
+			{
+				return packet_size >= size;
+			}
+		};
+
+	}
+
 }
 
+#define UPTP_FIELD(PacketType, Offset, Member) ::uptp::layout::field<PacketType, Offset, decltype(Member), Member>
+#define UPTP_NESTED(Layout, Offset, Member) ::uptp::layout::nested<Layout, Offset, decltype(Member), Member>
+
 #endif
@@ -0,0 +1,79 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_UTIL_SPSC_RING_HPP__
+#define MICROPTP_UTIL_SPSC_RING_HPP__
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace uptp {
+
+	//
+	// Wait-free ring between exactly one producer and one consumer thread.
+	// Entries are filled and read in place, so large ones (whole datagrams)
+	// are never copied: the producer writes slot(i) of the free slots and
+	// commits them, the consumer reads front() and pops it. Each side only
+	// ever stores its own index.
+	//
+	template< typename T, size_t Depth >
+	class SpscRing {
+		static_assert(Depth >= 2 && (Depth & (Depth - 1)) == 0, "ring depth must be a power of two");
+
+	public:
+		static const size_t depth = Depth;
+
+		SpscRing()
+			: head_(0), tail_(0)
+		{}
+
+		SpscRing(const SpscRing&) = delete;
+		SpscRing& operator=(const SpscRing&) = delete;
+
+		// Producer: slots free to fill, slot(0) is the next one
+		size_t writable() const
+		{
+			return Depth - (tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_acquire));
+		}
+
+		T& slot(size_t i)
+		{
+			return cells_[(tail_.load(std::memory_order_relaxed) + i) & (Depth - 1)];
+		}
+
+		// Producer: hands the first [count] slots to the consumer
+		void commit(size_t count)
+		{
+			tail_.store(tail_.load(std::memory_order_relaxed) + count, std::memory_order_release);
+		}
+
+		// Consumer
+		size_t readable() const
+		{
+			return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_relaxed);
+		}
+
+		T& front()
+		{
+			return cells_[head_.load(std::memory_order_relaxed) & (Depth - 1)];
+		}
+
+		void pop()
+		{
+			head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+	private:
+		std::array<T, Depth> cells_;
+
+		// apart, so the two sides don't share a cache line
+		alignas(64) std::atomic<size_t> head_;
+		alignas(64) std::atomic<size_t> tail_;
+	};
+
+}
+
+#endif
@@ -0,0 +1,72 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <microptp/virtual_clock.hpp>
+#include <microptp/ports/systemport.hpp>
+
+namespace uptp {
+
+	VirtualClock::VirtualClock(SystemPort& port)
+		: port_(port), ppb_(0)
+	{
+	}
+
+	Time VirtualClock::drift(const Time& timebase) const
+	{
+		// whole seconds and the rest separately, so long runs without discipline don't overflow
+		const Time elapsed = timebase - reference_;
+		return Time::from_nanos(elapsed.secs() * ppb_ + static_cast<int64>(elapsed.nanos()) * ppb_ / Time::nanos_per_second);
+	}
+
+	Time VirtualClock::to_domain(const Time& timebase) const
+	{
+		if(!Config::virtual_clocks) {
+			return timebase;
+		}
+
+		return timebase + offset_ + drift(timebase);
+	}
+
+	Time VirtualClock::get_time()
+	{
+		return to_domain(port_.get_time());
+	}
+
+	void VirtualClock::set_time(Time absolute)
+	{
+		if(!Config::virtual_clocks) {
+			port_.set_time(absolute);
+			return;
+		}
+
+		reference_ = port_.get_time();
+		offset_ = absolute - reference_;
+	}
+
+	void VirtualClock::adjust_time(Time delta)
+	{
+		if(!Config::virtual_clocks) {
+			port_.adjust_time(delta);
+			return;
+		}
+
+		offset_ = offset_ + delta;
+	}
+
+	void VirtualClock::discipline(int32 ppb)
+	{
+		if(!Config::virtual_clocks) {
+			port_.discipline(ppb);
+			return;
+		}
+
+		// fold the drift at the old rate into the offset before switching
+		const Time now = port_.get_time();
+		offset_ = offset_ + drift(now);
+		reference_ = now;
+		ppb_ = ppb;
+	}
+
+}
@@ -0,0 +1,49 @@
+//          Copyright Michael Steinberg 2015
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MICROPTP_VIRTUAL_CLOCK_HPP__
+#define MICROPTP_VIRTUAL_CLOCK_HPP__
+
+#include <microptp/config.hpp>
+#include <microptp/ptpdatatypes.hpp>
+
+namespace uptp {
+
+	class SystemPort;
+
+	//
+	// The time of one PTP domain. With Config::virtual_clocks the system
+	// port's clock is a free running timebase and every domain keeps an offset
+	// and a frequency on top of it, so several domains can be tracked without
+	// fighting over discipline(). Otherwise the calls go straight through to
+	// the system port and domain time is the timebase.
+	//
+	// domain = timebase + offset + (timebase - reference) * ppb / 10^9
+	//
+	class VirtualClock {
+	public:
+		VirtualClock(SystemPort& port);
+
+		// Timestamps taken by the system port, converted to domain time
+		Time to_domain(const Time& timebase) const;
+		Time get_time();
+
+		// SystemPort clock interface, see systemport.hpp
+		void set_time(Time absolute);
+		void adjust_time(Time delta);
+		void discipline(int32 ppb);
+
+	private:
+		Time drift(const Time& timebase) const;
+
+		SystemPort& port_;
+		Time offset_;
+		Time reference_;
+		int32 ppb_;
+	};
+
+}
+
+#endif